@@ -8,6 +8,25 @@
 #include <chrono>
 #include <fstream>
 #include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <streambuf>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <climits>
+#include <cmath>
+#include <poll.h>
+#include <fcntl.h>
+#include <csignal>
+#include <cstddef>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include "tetris_shm.h"
+#include "tetris_bot.h"
+#include "tetris_anim.h"
+#include "tetris_render_check.h"
 using namespace std;
 
 // ANSI Color Codes
@@ -43,14 +62,813 @@ const int playWidth = fieldWidth - 2;
 const string TETROMINO_COLORS[7] = { CYAN, PINK, ORANGE, YELLOW, RED, PURPLE, GREEN };
 const string TETROMINO_NAMES[7] = { "I", "J", "L", "O", "S", "T", "Z" };
 
+// Cell styles. 0..9 are the field values themselves: empty, the seven
+// piece colors (1..7), a flashing cleared line (8) and the walls (9).
+enum CellStyle {
+    STYLE_EMPTY = 0,
+    STYLE_FLASH = 8,
+    STYLE_BORDER = 9,
+    STYLE_DEFAULT, // terminal default, as after RESET
+    STYLE_COUNT
+};
+
+enum Glyph { GLYPH_BLANK, GLYPH_BLOCK, GLYPH_MINO, GLYPH_COUNT };
+
+// Pre-encoded UTF-8 bytes for each glyph
+const struct {
+    const char *bytes;
+    size_t length;
+} GLYPHS[GLYPH_COUNT] = { { "  ", 2 }, { "■ ", 4 }, { "■", 3 } };
+
+// Writes cells while tracking the terminal's current SGR state: only the
+// attributes that differ from the previous cell are sent, taken from a
+// table of every from->to transition built once at startup. A run of
+// same-colored cells costs just the glyph bytes.
+class CellEmitter {
+public:
+    // Assumes the terminal is at default attributes (after a RESET)
+    explicit CellEmitter(ostream &o) : out(o), current(STYLE_DEFAULT) {}
+    ~CellEmitter() { finish(); }
+
+    void put(int style, Glyph glyph) {
+        if (style != current) {
+            const string &change = transitions().sequence[current][style];
+            out.write(change.data(), change.size());
+            current = style;
+        }
+        out.write(GLYPHS[glyph].bytes, GLYPHS[glyph].length);
+    }
+
+    // Back to default attributes before any plain text is written
+    void finish() {
+        if (current != STYLE_DEFAULT) {
+            const string &change = transitions().sequence[current][STYLE_DEFAULT];
+            out.write(change.data(), change.size());
+            current = STYLE_DEFAULT;
+        }
+    }
+
+private:
+    struct Transitions {
+        string sequence[STYLE_COUNT][STYLE_COUNT];
+
+        Transitions() {
+            // Foreground/background SGR parameters, taken from the color macros
+            string fg[STYLE_COUNT], bg[STYLE_COUNT];
+            for (int style = 0; style < STYLE_COUNT; style++) {
+                fg[style] = "39";
+                bg[style] = params(BG_BLACK);
+            }
+            for (int piece = 0; piece < 7; piece++) fg[piece + 1] = params(TETROMINO_COLORS[piece]);
+            fg[STYLE_FLASH] = params(BLACK);
+            bg[STYLE_FLASH] = params(BG_WHITE);
+            bg[STYLE_BORDER] = params(BG_GRAY);
+            bg[STYLE_DEFAULT] = "49";
+
+            for (int from = 0; from < STYLE_COUNT; from++) {
+                for (int to = 0; to < STYLE_COUNT; to++) {
+                    if (from == to) continue;
+                    if (to == STYLE_DEFAULT) {
+                        sequence[from][to] = RESET;
+                        continue;
+                    }
+                    string changed;
+                    if (fg[from] != fg[to]) changed = fg[to];
+                    if (bg[from] != bg[to]) changed += (changed.empty() ? "" : ";") + bg[to];
+                    if (!changed.empty()) sequence[from][to] = "\033[" + changed + "m";
+                }
+            }
+        }
+
+        // "\033[38;5;213m" -> "38;5;213"
+        static string params(const string &escape) { return escape.substr(2, escape.size() - 3); }
+    };
+
+    static const Transitions &transitions() {
+        static const Transitions table;
+        return table;
+    }
+
+    ostream &out;
+    int current;
+};
+
+// Frame instrumentation (enabled with --stats). Each phase costs two
+// steady_clock reads and one histogram increment.
+
+// Allocation counter for the HUD. Off by default: operator new then
+// pays a single predictable branch. Set by the render thread (HUD toggle),
+// read by every allocating thread.
+atomic<bool> countAllocations(false);
+atomic<uint64_t> allocationCount(0);
+
+void *operator new(size_t size) {
+    if (countAllocations.load(memory_order_relaxed)) allocationCount.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+// GCC sees a free() inlined where it can only see `new` allocate, not that
+// this operator new is malloc underneath, and warns at every inlined delete
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// Log-linear histogram: 8 linear buckets per power of two (within 12.5%).
+class LatencyHistogram {
+public:
+    void record(uint64_t v) {
+        counts[bucketOf(v)]++;
+        samples++;
+        if (v > maxValue) maxValue = v;
+    }
+
+    uint64_t count() const { return samples; }
+    uint64_t max() const { return maxValue; }
+
+    // Upper edge of the bucket holding the p-th fraction of samples
+    uint64_t percentile(double p) const {
+        if (samples == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p * samples + 0.5));
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank) return b + 1 < BUCKETS ? std::min(maxValue, bucketLow(b + 1) - 1) : maxValue;
+        }
+        return maxValue;
+    }
+
+private:
+    static const int SUB_BUCKETS = 8;
+    static const int BUCKETS = 62 * SUB_BUCKETS;
+    uint32_t counts[BUCKETS] = {};
+    uint64_t samples = 0;
+    uint64_t maxValue = 0;
+
+    static int bucketOf(uint64_t v) {
+        if (v < SUB_BUCKETS) return (int)v;
+        int e = 63 - __builtin_clzll(v);
+        return (e - 2) * SUB_BUCKETS + (int)((v >> (e - 3)) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t bucketLow(int b) {
+        if (b < SUB_BUCKETS) return (uint64_t)b;
+        return (uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS) << (b / SUB_BUCKETS - 1);
+    }
+};
+
+// Holds a whole frame in memory until flush, so compose and terminal
+// I/O can be timed separately and bytes per frame counted. While the game
+// runs it's attached to cout and writes through a non-blocking descriptor
+// of its own: frames the terminal can't take yet wait in a bounded queue,
+// and the renderer holds off until it drains, so a slow terminal costs
+// frames, never game time.
+class FrameBuffer : public streambuf {
+public:
+    static const size_t QUEUE_LIMIT = 64 * 1024; // queued bytes before sync() waits
+
+    // Redirects cout into the buffer until detach()
+    void attach() {
+        cout.flush();
+        target = cout.rdbuf(this);
+        // A private open file description, so stdin and the shell never see O_NONBLOCK
+        if (isatty(STDOUT_FILENO)) {
+            const char *tty = ttyname(STDOUT_FILENO);
+            fd = tty ? open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC) : -1;
+        }
+    }
+
+    // Writes out whatever is still queued and gives cout back
+    void detach() {
+        if (!target) return;
+        cout.flush();
+        drain();
+        if (fd >= 0) close(fd);
+        fd = -1;
+        cout.rdbuf(target);
+        target = nullptr;
+    }
+
+    // True while flushed frames are still waiting for the terminal
+    bool backlogged() const { return queueSent < queue.size(); }
+
+    // Writes as much of the queue as the terminal takes without blocking;
+    // true once it's empty
+    bool pump() {
+        while (queueSent < queue.size()) {
+            ssize_t n = write(fd, queue.data() + queueSent, queue.size() - queueSent);
+            if (n > 0) {
+                queueSent += (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                stalls++;
+                return false;
+            }
+            break; // terminal gone: nothing more can be shown
+        }
+        queue.clear();
+        queueSent = 0;
+        return true;
+    }
+
+    // Sleeps until the terminal can take more output, or `ms` passes
+    void waitWritable(int ms) {
+        if (backlogged()) {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            ::poll(&pfd, 1, ms);
+        } else {
+            this_thread::sleep_for(chrono::milliseconds(ms));
+        }
+    }
+
+    // Counted by the renderer: frames it took while the terminal was backed
+    // up (folded into the next diff), and frames it never saw at all
+    void noteCoalesced() { coalesced++; }
+    void noteDropped(uint64_t frames) { dropped += frames; }
+
+    uint64_t bytesWritten() const { return written; }
+    uint64_t framesCoalesced() const { return coalesced; }
+    uint64_t framesDropped() const { return dropped; }
+    uint64_t writeStalls() const { return stalls; }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (ch != traits_type::eof()) frame.push_back((char)ch);
+        return traits_type::not_eof(ch);
+    }
+
+    streamsize xsputn(const char *s, streamsize n) override {
+        frame.append(s, (size_t)n);
+        return n;
+    }
+
+    int sync() override {
+        if (!frame.empty()) {
+            written += frame.size();
+            if (fd < 0) {
+                target->sputn(frame.data(), (streamsize)frame.size());
+            } else {
+                if (!backlogged()) {
+                    queue.swap(frame); // reuse both strings' storage
+                    queueSent = 0;
+                } else {
+                    queue.append(frame);
+                }
+                if (queue.size() - queueSent > QUEUE_LIMIT) drain();
+                else pump();
+            }
+            frame.clear();
+        }
+        return fd < 0 ? target->pubsync() : 0;
+    }
+
+private:
+    streambuf *target = nullptr; // cout's own buffer while attached
+    int fd = -1;                 // non-blocking terminal, or -1 to write through target
+    string frame;                // being composed
+    string queue;                // flushed, not yet taken by the terminal
+    size_t queueSent = 0;
+    uint64_t written = 0;
+    uint64_t coalesced = 0, dropped = 0, stalls = 0;
+
+    // Blocks until the queue is out; gives up on a terminal stuck for seconds
+    void drain() {
+        for (int i = 0; i < 50 && !pump(); i++) waitWritable(100);
+        queue.clear();
+        queueSent = 0;
+    }
+};
+
+FrameBuffer frameOutput;
+
+enum FramePhase {
+    PHASE_INPUT,
+    PHASE_UPDATE,      // gravity and locking; includes line-clear
+    PHASE_LINE_CLEAR,  // includes the blink animation
+    PHASE_COMPOSE,
+    PHASE_FLUSH,
+    PHASE_COUNT
+};
+
+const char *const PHASE_NAMES[PHASE_COUNT] = { "input", "update", "line-clear", "compose", "flush" };
+
+// Values shown by the performance HUD, refreshed once per second
+struct HudValues {
+    double tickRate = 0;       // simulation ticks per second
+    double composeUs = 0;      // average time to draw a frame into memory
+    double bytesPerFrame = 0;  // average bytes written per frame
+    double inputLatencyMs = 0; // key read -> frame showing it flushed
+    double allocsPerSec = 0;   // operator new calls per second
+    double skippedPerSec = 0;  // frames coalesced or dropped per second
+};
+
+class FrameStats {
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    bool isActive() const { return active.load(memory_order_relaxed); }
+    bool isHudVisible() const { return hudVisible; }
+    const HudValues &hud() const { return hudValues; }
+
+    void enable(const string &path) {
+        reporting = true;
+        reportPath = path;
+        activate();
+    }
+
+    // The HUD turns collection on the first time it is shown.
+    // Called from the thread that writes to cout.
+    void setHudVisible(bool visible) {
+        hudVisible = visible;
+        if (hudVisible) activate();
+    }
+
+    Stamp begin() const { return isActive() ? chrono::steady_clock::now() : Stamp(); }
+
+    // Phases may be timed from different threads, but each phase from only one
+    void end(FramePhase phase, Stamp start) {
+        if (!isActive()) return;
+        uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        phases[phase].record(ns);
+        if (phase == PHASE_COMPOSE) windowComposeNs += ns;
+    }
+
+    // Call once per presented frame, after the flush. `inputStamp` is when the
+    // oldest key shown for the first time in this frame was read, and `tick`
+    // the simulation tick the frame was taken at.
+    void endFrame(Stamp inputStamp, uint64_t tick) {
+        if (!isActive()) return;
+        Stamp now = chrono::steady_clock::now();
+        uint64_t total = frameOutput.bytesWritten();
+        frameBytes.record(total - lastBytes);
+        windowBytes += total - lastBytes;
+        lastBytes = total;
+        windowFrames++;
+
+        if (inputStamp != Stamp()) {
+            uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(now - inputStamp).count();
+            inputLatency.record(ns);
+            windowLatencyNs += ns;
+            windowInputs++;
+        }
+
+        double seconds = chrono::duration<double>(now - windowStart).count();
+        if (seconds >= 1.0) {
+            uint64_t allocs = allocationCount.load(memory_order_relaxed);
+            uint64_t skipped = frameOutput.framesCoalesced() + frameOutput.framesDropped();
+            hudValues.tickRate = (tick - windowTick) / seconds;
+            hudValues.composeUs = windowComposeNs / 1000.0 / windowFrames;
+            hudValues.bytesPerFrame = (double)windowBytes / windowFrames;
+            if (windowInputs) hudValues.inputLatencyMs = windowLatencyNs / 1e6 / windowInputs;
+            hudValues.allocsPerSec = (allocs - windowAllocs) / seconds;
+            hudValues.skippedPerSec = (skipped - windowSkipped) / seconds;
+            windowStart = now;
+            windowTick = tick;
+            windowAllocs = allocs;
+            windowSkipped = skipped;
+            windowFrames = windowInputs = 0;
+            windowBytes = windowComposeNs = windowLatencyNs = 0;
+        }
+    }
+
+    // With --stats, writes p50/p99/max per phase, bytes per frame and the
+    // frames a slow terminal cost
+    bool writeReport() {
+        if (!isActive()) return true;
+        active = false;
+        countAllocations = false;
+        if (!reporting) return true;
+
+        ofstream file(reportPath);
+        if (!file.is_open()) {
+            cerr << "stats: cannot write " << reportPath << "\n";
+            return false;
+        }
+        char line[128];
+        file << "# Tetris frame statistics (times in microseconds)\n";
+        snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s\n", "phase", "samples", "p50", "p99", "max");
+        file << line;
+        for (int p = 0; p <= PHASE_COUNT; p++) {
+            const LatencyHistogram &h = p < PHASE_COUNT ? phases[p] : inputLatency;
+            snprintf(line, sizeof(line), "%-12s %10llu %10.1f %10.1f %10.1f\n", p < PHASE_COUNT ? PHASE_NAMES[p] : "input->frame",
+                     (unsigned long long)h.count(), h.percentile(0.50) / 1000.0,
+                     h.percentile(0.99) / 1000.0, h.max() / 1000.0);
+            file << line;
+        }
+        file << "\n";
+        snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s\n", "output", "frames", "p50", "p99", "max");
+        file << line;
+        snprintf(line, sizeof(line), "%-12s %10llu %10llu %10llu %10llu\n", "bytes/frame",
+                 (unsigned long long)frameBytes.count(), (unsigned long long)frameBytes.percentile(0.50),
+                 (unsigned long long)frameBytes.percentile(0.99), (unsigned long long)frameBytes.max());
+        file << line;
+        snprintf(line, sizeof(line), "%-12s %10s %10s %10s\n", "", "coalesced", "dropped", "stalls");
+        file << line;
+        snprintf(line, sizeof(line), "%-12s %10llu %10llu %10llu\n", "terminal", (unsigned long long)frameOutput.framesCoalesced(),
+                 (unsigned long long)frameOutput.framesDropped(), (unsigned long long)frameOutput.writeStalls());
+        file << line;
+        return true;
+    }
+
+private:
+    atomic<bool> active{false};
+    bool reporting = false;
+    bool hudVisible = false;
+    string reportPath;
+    uint64_t lastBytes = 0;
+    LatencyHistogram phases[PHASE_COUNT];
+    LatencyHistogram frameBytes;
+    LatencyHistogram inputLatency;
+
+    // One-second window behind the HUD values
+    HudValues hudValues;
+    Stamp windowStart;
+    uint64_t windowFrames = 0, windowInputs = 0, windowAllocs = 0, windowTick = 0, windowSkipped = 0;
+    uint64_t windowBytes = 0, windowComposeNs = 0, windowLatencyNs = 0;
+
+    void activate() {
+        if (isActive()) return;
+        countAllocations = true;
+        lastBytes = frameOutput.bytesWritten();
+        windowStart = chrono::steady_clock::now();
+        windowAllocs = allocationCount.load(memory_order_relaxed);
+        windowSkipped = frameOutput.framesCoalesced() + frameOutput.framesDropped();
+        active = true;
+    }
+};
+
+FrameStats frameStats;
+TetrisShmWriter shmExport;  // live state for overlays (--shm)
+TetrisBotHost botHost;      // in-process bot plugin (--bot)
+LatencyHistogram botCallNs; // time each bot call took
+
+// One line on stderr after the game: how the bot kept to its budget
+void writeBotReport() {
+    if (botHost.callCount() == 0) return;
+    fprintf(stderr, "bot %s: %llu calls, p50 %.1f us, p99 %.1f us, max %.1f us, %llu over the %u us budget%s\n",
+            botHost.name().c_str(), (unsigned long long)botHost.callCount(), botCallNs.percentile(0.5) / 1000.0,
+            botCallNs.percentile(0.99) / 1000.0, botCallNs.max() / 1000.0,
+            (unsigned long long)botHost.overrunCount(), botHost.budget(),
+            botHost.wasDisabled() ? " (switched off for overrunning too often)" : "");
+}
+
+// Lock-free triple buffer: one writer and one reader share three slots.
+// The writer always has a slot to fill and the reader always has a complete
+// one to draw; frames the reader never picked up are simply overwritten.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer: fill this slot completely, then publish()
+    T &writeSlot() { return slots[writeIndex]; }
+
+    void publish() {
+        writeIndex = middle.exchange(writeIndex | FRESH, memory_order_acq_rel) & ~FRESH;
+    }
+
+    // Reader: returns true if a newer frame than readSlot() was published
+    bool update() {
+        if (!(middle.load(memory_order_relaxed) & FRESH)) return false;
+        readIndex = middle.exchange(readIndex, memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    const T &readSlot() const { return slots[readIndex]; }
+
+private:
+    static const uint8_t FRESH = 0x80; // middle slot holds an unread frame
+    T slots[3];
+    atomic<uint8_t> middle{2};
+    uint8_t writeIndex = 0; // owned by the writer
+    uint8_t readIndex = 1;  // owned by the reader
+};
+
+// Lock-free single-producer/single-consumer ring for key events
+template <typename T, size_t N>
+class SpscRing {
+public:
+    bool push(const T &item) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == N) return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) return false;
+        item = items[h & (N - 1)];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+private:
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+    T items[N];
+    alignas(64) atomic<size_t> head{0}; // next item to read, owned by the consumer
+    alignas(64) atomic<size_t> tail{0}; // next slot to write, owned by the producer
+};
+
+struct KeyEvent {
+    char key;
+    chrono::steady_clock::time_point time;
+};
+
+// Reads the keyboard on its own thread so no key waits for a game tick.
+// The terminal must already be in raw mode (see setTerminalRawMode).
+class InputReader {
+public:
+    void start() {
+        running = true;
+        worker = thread(&InputReader::readLoop, this);
+    }
+
+    void stop() {
+        if (!running) return;
+        running = false;
+        worker.join();
+    }
+
+    bool poll(KeyEvent &event) { return queue.pop(event); }
+
+private:
+    SpscRing<KeyEvent, 256> queue;
+    atomic<bool> running{false};
+    thread worker;
+
+    void readLoop() {
+        while (running) {
+            struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+            char ch;
+            if (::poll(&pfd, 1, 10) <= 0 || read(STDIN_FILENO, &ch, 1) != 1) continue;
+            KeyEvent event = { ch, chrono::steady_clock::now() };
+            // Never drop a key: if the game falls 256 keys behind, wait for it
+            while (!queue.push(event) && running) this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+};
+
+// DAS/ARR timings in milliseconds (--das, --arr, --hold-gap)
+struct InputTiming {
+    int das = 170;     // hold this long before auto shift starts
+    int arr = 50;      // then shift once per arr ms (0 = straight to the wall)
+    int holdGap = 80;  // terminals send no key-up: a key counts as held
+                       // while its repeats arrive at most this far apart
+};
+
+InputTiming inputTiming;
+
+// Auto shift for one held key, applied at tick resolution. Keys that must not
+// repeat (rotation) only act on a fresh press.
+class AutoRepeat {
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    explicit AutoRepeat(bool repeats = true) : repeats(repeats) {}
+
+    // Returns true if the event should act like a tap. Once DAS has charged,
+    // the terminal's own repeats only keep the hold alive and due() shifts.
+    bool onEvent(Stamp time) {
+        bool continuing = held && time - lastEvent <= chrono::milliseconds(inputTiming.holdGap);
+        lastEvent = time;
+        if (!continuing) {
+            held = true;
+            nextShift = time + chrono::milliseconds(inputTiming.das);
+            return true;
+        }
+        return repeats && time < nextShift && !charged;
+    }
+
+    // Number of automatic shifts due by `now` (INT_MAX with ARR 0)
+    int due(Stamp now) {
+        if (!held) return 0;
+        if (now - lastEvent > chrono::milliseconds(inputTiming.holdGap)) {
+            held = charged = false;
+            return 0;
+        }
+        if (!repeats || now < nextShift) return 0;
+        charged = true;
+        if (inputTiming.arr <= 0) return INT_MAX;
+        chrono::milliseconds arr(inputTiming.arr);
+        int shifts = 1 + (int)((now - nextShift) / arr);
+        nextShift += shifts * arr;
+        return shifts;
+    }
+
+private:
+    bool repeats;
+    bool held = false;
+    bool charged = false;
+    Stamp lastEvent;
+    Stamp nextShift;
+};
+
+const int TICK_MS = 50;
+
+// Gravity is rows per tick in 16.16 fixed point, so a crawl and several
+// rows per tick are the same arithmetic. 1G is one row per 1/60 s frame;
+// 20G and up drops straight to the landing row.
+const int32_t GRAVITY_ONE = 1 << 16;
+const int32_t GRAVITY_INSTANT = 64 * GRAVITY_ONE; // more rows than any field
+const double G_ROWS_PER_MS = 60.0 / 1000.0;
+
+// Gravity and lock delay (--gravity, --lock-delay, --lock-resets)
+struct GravityTiming {
+    double g = 0;        // fixed gravity in G; 0 follows the level
+    int lockDelay = 500; // ms a grounded piece rests before it locks
+    int lockResets = 15; // moves per piece that restart the lock delay
+};
+
+GravityTiming gravityTiming;
+
+int32_t gravityStep(double rowsPerMs) {
+    if (rowsPerMs >= 20 * G_ROWS_PER_MS) return GRAVITY_INSTANT;
+    return max<int32_t>(1, (int32_t)(rowsPerMs * TICK_MS * GRAVITY_ONE));
+}
+
+// Lock delay on the wall clock, so it lasts the same at any tick rate
+class LockDelay {
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    // True once the piece has rested on the stack for the whole delay
+    bool expired(bool onGround, Stamp now) {
+        if (!onGround) {
+            grounded = false;
+            return false;
+        }
+        if (!grounded) {
+            grounded = true;
+            since = now;
+        }
+        return now - since >= chrono::milliseconds(gravityTiming.lockDelay);
+    }
+
+    // A move or rotation on the ground restarts the delay, a limited number of times
+    void moved(Stamp now) {
+        if (grounded && resets < gravityTiming.lockResets) {
+            resets++;
+            since = now;
+        }
+    }
+
+    // New piece, or the clock stopped (pause, undo)
+    void reset(bool newPiece) {
+        grounded = false;
+        if (newPiece) resets = 0;
+    }
+
+private:
+    bool grounded = false;
+    int resets = 0;
+    Stamp since;
+};
+
+// Everything the render thread needs for one frame; plain values only
+struct FrameSnapshot {
+    unsigned char field[fieldWidth * fieldHeight];
+    int currentPiece, currentRotation, currentX, currentY;
+    int nextPiece;
+    int level, score, totalLinesCleared, highScore;
+    bool paused;
+    bool hudVisible;
+    uint64_t tick;                // simulation tick this frame was taken at
+    FrameStats::Stamp inputStamp; // oldest key not yet shown on screen
+    uint64_t inputTick;           // tick at which that key was handled
+};
+
+// Piece randomizer (xorshift64*). Its whole state is one number, so a
+// saved game resumes with the same upcoming pieces.
+class PieceRandom {
+public:
+    explicit PieceRandom(uint64_t seed) { setState(seed); }
+
+    int nextPiece() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (int)(((state * 0x2545F4914F6CDD1Dull) >> 33) % 7);
+    }
+
+    uint64_t getState() const { return state; }
+    void setState(uint64_t s) { state = s ? s : 0x9E3779B97F4A7C15ull; }
+
+private:
+    uint64_t state;
+};
+
+// Save/resume snapshot: one fixed-layout record written with a single
+// write() and loaded through mmap. Only the 10x19 play area is stored
+// (two cells per byte); the walls are rebuilt on load.
+const char SAVE_MAGIC[8] = {'T', 'E', 'T', 'R', 'I', 'S', 'T', 0};
+const uint32_t SAVE_VERSION = 1;
+const char *const SAVE_FILE = "tetris_save.bin";
+const int SAVE_CELLS = playWidth * (fieldHeight - 1);
+
+struct SaveGame {
+    char magic[8];
+    uint32_t version;
+    uint32_t checksum; // FNV-1a of every byte after this field
+    uint64_t rngState;
+    int32_t score, level, linesCleared, totalLinesCleared;
+    int32_t speed, gravityCarry, pieceCounter, previousScore; // gravityCarry: 16.16 rows
+    int16_t currentX, currentY, previousX, previousY;
+    uint8_t currentPiece, currentRotation, nextPiece;
+    uint8_t previousPiece, previousRotation, hasUndo, reserved[2];
+    uint8_t cells[(SAVE_CELLS + 1) / 2];
+    uint8_t previousCells[(SAVE_CELLS + 1) / 2]; // board before the last lock (undo)
+};
+static_assert(sizeof(SaveGame) == 264, "SaveGame layout changed: bump SAVE_VERSION");
+
+uint32_t saveChecksum(const SaveGame &save) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&save) + offsetof(SaveGame, rngState);
+    const uint8_t *end = reinterpret_cast<const uint8_t *>(&save) + sizeof(SaveGame);
+    uint32_t hash = 2166136261u;
+    for (; p < end; p++) hash = (hash ^ *p) * 16777619u;
+    return hash;
+}
+
+void packCells(const unsigned char *from, uint8_t *to) {
+    for (int i = 0; i < SAVE_CELLS; i++) {
+        int cell = from[(i / playWidth) * fieldWidth + i % playWidth + 1] & 0x0F;
+        to[i / 2] |= (uint8_t)(i % 2 ? cell << 4 : cell);
+    }
+}
+
+// Rebuilds a full field (walls included); false if a cell isn't a piece color
+bool unpackCells(const uint8_t *from, unsigned char *to) {
+    for (int x = 0; x < fieldWidth; x++) {
+        for (int y = 0; y < fieldHeight; y++) {
+            to[y * fieldWidth + x] = (x == 0 || x == fieldWidth - 1 || y == fieldHeight - 1) ? 9 : 0;
+        }
+    }
+    for (int i = 0; i < SAVE_CELLS; i++) {
+        int cell = (from[i / 2] >> (i % 2 ? 4 : 0)) & 0x0F;
+        if (cell > 7) return false;
+        to[(i / playWidth) * fieldWidth + i % playWidth + 1] = (unsigned char)cell;
+    }
+    return true;
+}
+
+// Writes to a temporary file and renames it, so a crash never leaves half a save
+bool writeSaveFile(const string &path, const SaveGame &save) {
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = write(fd, &save, sizeof(save)) == (ssize_t)sizeof(save);
+    close(fd);
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Maps the file read-only and checks magic, version, size and checksum
+// before copying it out. Field ranges are checked by the caller.
+bool readSaveFile(const string &path, SaveGame &save) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(SaveGame)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, sizeof(SaveGame), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    memcpy(&save, map, sizeof(save));
+    munmap(map, sizeof(SaveGame));
+    return memcmp(save.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) == 0 &&
+           save.version == SAVE_VERSION && save.checksum == saveChecksum(save);
+}
+
+// Set by SIGTERM/SIGHUP/SIGINT: the game saves and exits at the end of the tick
+atomic<bool> quitRequested(false);
+
+void requestQuit(int) {
+    quitRequested = true;
+}
+
 class TetrisGame {
 public:
-    TetrisGame() : currentPiece(rand() % 7), 
+    TetrisGame() : rng((uint64_t)chrono::steady_clock::now().time_since_epoch().count() ^ (uint64_t)time(0)),
+        currentPiece(rng.nextPiece()), 
         currentRotation(0), currentX(playWidth / 2 - 1), currentY(0), speed(30), 
-        speedCounter(0), forcePieceDown(false), rotationHold(true), pieceCounter(0), 
+        gravityCarry(0), forcePieceDown(false), pieceCounter(0), 
         score(0), isGameOver(false), isPaused(false), level(1), highScore(0), 
-        nextPiece(rand() % 7), previousField(nullptr), linesCleared(0), totalLinesCleared(0) {
-        srand(time(0));
+        nextPiece(rng.nextPiece()), linesCleared(0), totalLinesCleared(0), quit(false), resumed(false),
+        hudVisible(frameStats.isHudVisible()), rendering(false), presentedTick(0), tick(0), pendingInputTick(0),
+        rotateKey(false), previousField(nullptr) {
         initializeField();
         initializePieces();
         initializeScreen();
@@ -64,36 +882,149 @@ public:
         saveHighScore();
     }
 
+    // Saves everything needed to continue this game later, undo included
+    bool saveSnapshot(const string &path) const {
+        SaveGame save;
+        memset(&save, 0, sizeof(save));
+        memcpy(save.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+        save.version = SAVE_VERSION;
+        save.rngState = rng.getState();
+        save.score = score;
+        save.level = level;
+        save.linesCleared = linesCleared;
+        save.totalLinesCleared = totalLinesCleared;
+        save.speed = speed;
+        save.gravityCarry = gravityCarry;
+        save.pieceCounter = pieceCounter;
+        save.currentX = (int16_t)currentX;
+        save.currentY = (int16_t)currentY;
+        save.currentPiece = (uint8_t)currentPiece;
+        save.currentRotation = (uint8_t)(currentRotation % 4);
+        save.nextPiece = (uint8_t)nextPiece;
+        packCells(field, save.cells);
+        if (previousField) {
+            save.hasUndo = 1;
+            save.previousScore = previousScore;
+            save.previousX = (int16_t)previousX;
+            save.previousY = (int16_t)previousY;
+            save.previousPiece = (uint8_t)previousPiece;
+            save.previousRotation = (uint8_t)(previousRotation % 4);
+            packCells(previousField, save.previousCells);
+        }
+        save.checksum = saveChecksum(save);
+        return writeSaveFile(path, save);
+    }
+
+    // Restores a snapshot; leaves the game untouched if the file is invalid
+    bool loadSnapshot(const string &path) {
+        SaveGame save;
+        if (!readSaveFile(path, save)) return false;
+        if (save.currentPiece >= 7 || save.nextPiece >= 7 || save.currentRotation >= 4 ||
+            save.level < 1 || save.score < 0 || save.speed < 1 || save.gravityCarry < 0 ||
+            save.gravityCarry >= GRAVITY_ONE || save.pieceCounter < 0 ||
+            (save.hasUndo && (save.previousPiece >= 7 || save.previousRotation >= 4))) {
+            return false;
+        }
+        unsigned char *loaded = new unsigned char[fieldWidth * fieldHeight];
+        unsigned char *loadedPrevious = save.hasUndo ? new unsigned char[fieldWidth * fieldHeight] : nullptr;
+        if (!unpackCells(save.cells, loaded) ||
+            (loadedPrevious && !unpackCells(save.previousCells, loadedPrevious))) {
+            delete[] loaded;
+            delete[] loadedPrevious;
+            return false;
+        }
+
+        swap(field, loaded);
+        currentPiece = save.currentPiece;
+        if (!doesPieceFit(currentPiece, save.currentRotation, save.currentX, save.currentY)) {
+            swap(field, loaded);
+            delete[] loaded;
+            delete[] loadedPrevious;
+            return false;
+        }
+        delete[] loaded;
+        delete[] previousField;
+        previousField = loadedPrevious;
+        currentRotation = save.currentRotation;
+        currentX = save.currentX;
+        currentY = save.currentY;
+        nextPiece = save.nextPiece;
+        score = save.score;
+        level = save.level;
+        linesCleared = save.linesCleared;
+        totalLinesCleared = save.totalLinesCleared;
+        speed = save.speed;
+        gravityCarry = save.gravityCarry;
+        lockDelay.reset(true);
+        pieceCounter = save.pieceCounter;
+        previousScore = save.previousScore;
+        previousX = save.previousX;
+        previousY = save.previousY;
+        previousPiece = save.previousPiece;
+        previousRotation = save.previousRotation;
+        rng.setState(save.rngState);
+        resumed = true;
+        return true;
+    }
+
     void run() {
-        showStartingAnimation();
         setTerminalRawMode(true);
+        input.start();
+        if (!resumed) playIntro();
+        resumed = false;
         
-        // Initial draw
+        // Initial draw; from here on a separate thread does all drawing so a
+        // slow terminal cannot stall gravity or input
         clearScreen();
-        drawGame();
+        publishFrame();
+        rendering = true;
+        frameOutput.attach();
+        thread renderer(&TetrisGame::renderLoop, this);
+        chrono::steady_clock::time_point nextTick = chrono::steady_clock::now();
         
         while (!isGameOver) {
-            if (!isPaused) {
-                this_thread::sleep_for(chrono::milliseconds(50));
-                speedCounter++;
-                forcePieceDown = (speedCounter == speed);
+            // Sleep to a fixed deadline so work done in the tick doesn't stretch it
+            nextTick += chrono::milliseconds(TICK_MS);
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (nextTick < now - chrono::milliseconds(250)) nextTick = now;
+            this_thread::sleep_until(nextTick);
+            tick++;
 
+            if (quitRequested) {
+                quit = true;
+                isGameOver = true;
+                break;
+            }
+
+            if (!isPaused) {
+                FrameStats::Stamp phaseStart = frameStats.begin();
                 handleInput();
-                updateGame();
-                drawGame();
+                frameStats.end(PHASE_INPUT, phaseStart);
 
-                fill(begin(keys), end(keys), false);
+                // The piece waits while a line clear flashes
+                phaseStart = frameStats.begin();
+                animations.run(chrono::steady_clock::now());
+                if (!animations.active()) updateGame();
+                frameStats.end(PHASE_UPDATE, phaseStart);
             } else {
-                drawPauseScreen();
                 handleInput();
-                // Clear the pause screen completely when unpausing
-                if (!isPaused) {
-                    clearScreen();
-                    drawGame();
-                }
             }
+            publishFrame();
         }
+        input.stop();
+        animations.finish(); // a save never holds a half-cleared field
+        rendering = false;
+        renderer.join();
+        frameOutput.detach();
         setTerminalRawMode(false);
+
+        // Quitting keeps the game for next time; topping out ends it
+        if (quit) saveSnapshot(SAVE_FILE);
+        else remove(SAVE_FILE);
+        if (quitRequested) {
+            cout << "\033[2J\033[H";
+            return;
+        }
         drawGameOverScreen();
         
         // Wait for restart or exit
@@ -102,6 +1033,7 @@ public:
                 char keyPressed = getch();
                 if (keyPressed == 'r' || keyPressed == 'R') {
                     initialize();
+                    quit = false;
                     run();
                     return;
                 } else if (keyPressed == 'x' || keyPressed == 'X') {
@@ -112,19 +1044,75 @@ public:
         }
     }
 
+    // --render-check: plays a script through publishFrame() and drawGame()
+    // exactly as renderLoop() would, one frame per move, with cout writing
+    // into `terminal`. A line clear adds a frame per step of its flash, on
+    // a clock of its own, so nothing depends on timing.
+    void playRenderScript(const RenderScript &script, VirtualTerminal &terminal, RenderRecorder &recorder) {
+        rng.setState(script.seed);
+        initialize();
+        highScore = 0; // not the one in highscore.txt
+        hudVisible = false;
+        frameStats.setHudVisible(false);
+
+        streambuf *previous = cout.rdbuf(&terminal);
+        FrameSnapshot shown;
+        bool haveShown = false;
+        bool kept = false;
+        AnimationScheduler::Clock::time_point clock;
+        auto draw = [&]() {
+            publishFrame();
+            frames.update();
+            const FrameSnapshot &frame = frames.readSlot();
+            drawGame(frame, haveShown ? &shown : nullptr);
+            shown = frame;
+            haveShown = true;
+            recorder.frame();
+            kept = false;
+        };
+        for (size_t i = 0;; i++) {
+            draw();
+            for (; i < script.moves.size() && script.moves[i] == '|'; i++) {
+                if (!kept) recorder.snapshot();
+                kept = true;
+            }
+            if (i == script.moves.size()) break;
+            switch (script.moves[i]) {
+                case 'L': tryMove(currentX - 1, currentY); break;
+                case 'R': tryMove(currentX + 1, currentY); break;
+                case 'U':
+                    if (doesPieceFit(currentPiece, currentRotation + 1, currentX, currentY)) currentRotation++;
+                    break;
+                case 'D': case 'G': tryMove(currentX, currentY + 1); break;
+                case 'S':
+                    dropPiece();
+                    updateGame();
+                    while (animations.active()) {
+                        animations.run(clock += chrono::milliseconds(200));
+                        if (animations.active()) draw();
+                    }
+                    break;
+                default: break;
+            }
+        }
+        if (!kept) recorder.snapshot();
+        cout.rdbuf(previous);
+        score = 0; // nor does it go into highscore.txt
+    }
+
 private:
+    PieceRandom rng;
     wstring tetrominoes[7];
     unsigned char *field;
     wchar_t *screen;
-    bool keys[4] = {false, false, false, false};
     int currentPiece;
     int currentRotation;
     int currentX;
     int currentY;
     int speed;
-    int speedCounter;
+    int32_t gravityCarry; // fraction of a row gravity still owes (16.16)
+    LockDelay lockDelay;
     bool forcePieceDown;
-    bool rotationHold;
     int pieceCounter;
     int score;
     vector<int> completedLines;
@@ -135,6 +1123,27 @@ private:
     int nextPiece;
     int linesCleared;
     int totalLinesCleared;
+    bool quit;    // left with X or a signal rather than topping out
+    bool resumed; // loaded from a snapshot: skip the intro
+    bool hudVisible;
+
+    // Simulation -> render thread hand-off
+    TripleBuffer<FrameSnapshot> frames;
+    atomic<bool> rendering;
+    atomic<uint64_t> presentedTick; // newest tick the renderer has flushed
+    uint64_t tick;
+    FrameStats::Stamp pendingInput;
+    uint64_t pendingInputTick;
+
+    // Keyboard thread and auto shift state; rotation never auto-repeats
+    InputReader input;
+    AutoRepeat shiftLeft, shiftRight, softDrop, rotateKey;
+
+    // Intro and line-clear flash, stepped by the game loop instead of sleeping
+    AnimationScheduler animations;
+
+    // Handed to the --bot plugin each tick; `pieces` counts locks
+    TetrisBotView botView = {};
 
     unsigned char *previousField;
     int previousPiece;
@@ -197,7 +1206,8 @@ private:
         }
     }
 
-    void showStartingAnimation() {
+    // Title art line by line, then a countdown; any key skips it
+    Animation introAnimation() {
         clearScreen();
         cout << BG_BLUE << WHITE << BOLD;
         
@@ -213,21 +1223,37 @@ private:
         
         for (int i = 0; i < tetrisArt.size(); i++) {
             cout << tetrisArt[i] << endl;
-            usleep(300000);
+            co_yield chrono::milliseconds(300);
         }
         
         cout << RESET << "\n\nStarting game in 3...";
         cout.flush();
-        usleep(1000000);
+        co_yield chrono::seconds(1);
         cout << "2...";
         cout.flush();
-        usleep(1000000);
+        co_yield chrono::seconds(1);
         cout << "1...";
         cout.flush();
-        usleep(1000000);
+        co_yield chrono::seconds(1);
     }
 
-    int rotate(int px, int py, int r, int pieceSize) {
+    // Plays the intro on the tick clock with input already running. Keys
+    // pressed meanwhile only skip it; they don't reach the game.
+    void playIntro() {
+        animations.start(introAnimation());
+        chrono::steady_clock::time_point nextTick = chrono::steady_clock::now();
+        while (animations.active()) {
+            KeyEvent event;
+            bool skip = quitRequested;
+            while (input.poll(event)) skip = true;
+            if (skip) animations.finish();
+            else animations.run(chrono::steady_clock::now());
+            nextTick += chrono::milliseconds(TICK_MS);
+            this_thread::sleep_until(nextTick);
+        }
+    }
+
+    int rotate(int px, int py, int r, int pieceSize) const {
         switch (r % 4) {
             case 0: return py * pieceSize + px;
             case 1: return (pieceSize - 1 - px) * pieceSize + py;
@@ -237,6 +1263,19 @@ private:
         return 0;
     }
 
+    // Calls visit(px, py) for each mino of the piece turned `rotation` times,
+    // row by row, in the coordinates of its box
+    template <class Visit>
+    void forEachMino(int piece, int rotation, Visit visit) const {
+        int pieceSize = (piece == 0) ? 4 : (piece == 3) ? 2 : 3;
+        for (int py = 0; py < pieceSize; py++) {
+            for (int px = 0; px < pieceSize; px++) {
+                size_t pi = (size_t)rotate(px, py, rotation, pieceSize);
+                if (pi < tetrominoes[piece].size() && tetrominoes[piece][pi] != L'.') visit(px, py);
+            }
+        }
+    }
+
     bool doesPieceFit(int pieceIdx, int rot, int posX, int posY) {
         int pieceSize = (pieceIdx == 0) ? 4 : (pieceIdx == 3) ? 2 : 3;
         
@@ -283,46 +1322,112 @@ private:
         }
     }
 
+    // Applies every queued key in the order it was pressed, then auto shift.
+    // A hard drop ends the batch so later keys reach the next piece.
     void handleInput() {
-        if (kbhit()) {
-            char keyPressed = getch();
-            switch (keyPressed) {
-                case 'd': case 'D': keys[0] = true; break;
-                case 'a': case 'A': keys[1] = true; break;
-                case 's': case 'S': keys[2] = true; break;
-                case 'w': case 'W': keys[3] = true; break;
-                case 'x': case 'X': isGameOver = true; break;
+        KeyEvent event;
+        bool dropped = false;
+        while (!dropped && input.poll(event)) {
+            // A key cuts a running line clear short and goes to the next piece
+            animations.finish();
+            if (frameStats.isActive() && pendingInput == FrameStats::Stamp()) {
+                pendingInput = event.time;
+                pendingInputTick = tick; // shown by the frame published at the end of this tick
+            }
+            bool moving = !isPaused;
+            switch (event.key) {
+                case 'd': case 'D':
+                    if (shiftRight.onEvent(event.time) && moving) tryMove(currentX + 1, currentY);
+                    break;
+                case 'a': case 'A':
+                    if (shiftLeft.onEvent(event.time) && moving) tryMove(currentX - 1, currentY);
+                    break;
+                case 's': case 'S':
+                    if (softDrop.onEvent(event.time) && moving) tryMove(currentX, currentY + 1);
+                    break;
+                case 'w': case 'W':
+                    if (rotateKey.onEvent(event.time) && moving &&
+                        doesPieceFit(currentPiece, currentRotation + 1, currentX, currentY)) {
+                        currentRotation++;
+                        lockDelay.moved(event.time);
+                    }
+                    break;
+                case 'x': case 'X':
+                    quit = true;
+                    isGameOver = true;
+                    break;
                 case 'r': case 'R': initialize(); break;
-                case 'p': case 'P': 
-                    isPaused = !isPaused; 
-                    if (!isPaused) {
-                        clearScreen();
-                        drawGame();
+                case 'p': case 'P':
+                    isPaused = !isPaused;
+                    lockDelay.reset(false); // time spent paused doesn't count
+                    break;
+                case ' ':
+                    if (moving) {
+                        dropPiece();
+                        dropped = true;
                     }
                     break;
-                case ' ': dropPiece(); break;
                 case 'u': case 'U': undo(); break;
+                case 'h': case 'H': hudVisible = !hudVisible; break;
                 default: break;
             }
         }
+
+        if (!isPaused && !animations.active()) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            for (int n = shiftRight.due(now); n > 0 && tryMove(currentX + 1, currentY); n--) {}
+            for (int n = shiftLeft.due(now); n > 0 && tryMove(currentX - 1, currentY); n--) {}
+            for (int n = softDrop.due(now); n > 0 && tryMove(currentX, currentY + 1); n--) {}
+            if (botHost.isActive() && !dropped) runBot();
+        }
+    }
+
+    bool tryMove(int x, int y) {
+        if (!doesPieceFit(currentPiece, currentRotation, x, y)) return false;
+        currentX = x;
+        currentY = y;
+        lockDelay.moved(chrono::steady_clock::now());
+        return true;
     }
 
     void dropPiece() {
-        while (doesPieceFit(currentPiece, currentRotation, currentX, currentY + 1)) {
-            currentY++;
-        }
+        currentY += dropDistance();
         forcePieceDown = true;
     }
 
+    // Rows the current piece can still fall, taken straight from the free
+    // run under the lowest mino of each of its columns (the floor stops it)
+    int dropDistance() const {
+        int bottoms[4] = {-1, -1, -1, -1}; // lowest mino of each box column
+        forEachMino(currentPiece, currentRotation, [&](int px, int py) { bottoms[px] = max(bottoms[px], py); });
+        int distance = fieldHeight;
+        for (int px = 0; px < 4; px++) {
+            int bottom = bottoms[px];
+            if (bottom < 0) continue;
+            int fx = currentX + px + 1;
+            int gap = 0;
+            while (field[(currentY + bottom + 1 + gap) * fieldWidth + fx] == 0) gap++;
+            distance = min(distance, gap);
+        }
+        return distance;
+    }
+
+    // Rows per tick: one row every `speed` ticks as before, then past level
+    // 14, where speed bottoms out, half again per level up to 20G
+    int32_t currentGravity() const {
+        if (gravityTiming.g > 0) return gravityStep(gravityTiming.g * G_ROWS_PER_MS);
+        return gravityStep(pow(1.5, max(0, level - 14)) / (speed * TICK_MS));
+    }
+
     void initialize() {
-        currentPiece = rand() % 7;
+        currentPiece = rng.nextPiece();
         currentRotation = 0;
         currentX = playWidth / 2 - 1;
         currentY = 0;
         speed = 30;
-        speedCounter = 0;
+        gravityCarry = 0;
+        lockDelay.reset(true);
         forcePieceDown = false;
-        rotationHold = true;
         pieceCounter = 0;
         score = 0;
         linesCleared = 0;
@@ -331,183 +1436,205 @@ private:
         completedLines.clear();
         isGameOver = false;
         isPaused = false;
-        nextPiece = rand() % 7;
+        nextPiece = rng.nextPiece();
+        delete[] field;
         initializeField();
         delete[] previousField;
         previousField = nullptr;
     }
 
+    // Gravity moves the piece by whole rows as the carry allows, straight to
+    // the landing row if that's closer; it locks once the lock delay runs out
+    // (or at once after a hard drop)
     void updateGame() {
-        if (keys[0] && doesPieceFit(currentPiece, currentRotation, currentX + 1, currentY)) currentX++;
-        if (keys[1] && doesPieceFit(currentPiece, currentRotation, currentX - 1, currentY)) currentX--;
-        if (keys[2] && doesPieceFit(currentPiece, currentRotation, currentX, currentY + 1)) currentY++;
-
-        if (keys[3]) {
-            if (rotationHold && doesPieceFit(currentPiece, currentRotation + 1, currentX, currentY)) {
-                currentRotation++;
+        if (!forcePieceDown) {
+            int distance = dropDistance();
+            if (distance > 0) {
+                gravityCarry += currentGravity();
+                int rows = gravityCarry / GRAVITY_ONE;
+                gravityCarry %= GRAVITY_ONE;
+                if (rows >= distance) {
+                    rows = distance;
+                    gravityCarry = 0;
+                }
+                currentY += rows;
+                distance -= rows;
+                for (int i = 0; i < rows; i++) {
+                    pieceCounter++;
+                    if (pieceCounter % 50 == 0 && speed >= 10) speed--;
+                }
             }
-            rotationHold = false;
-        } else {
-            rotationHold = true;
+            forcePieceDown = lockDelay.expired(distance == 0, chrono::steady_clock::now());
         }
+        if (!forcePieceDown) return;
+        forcePieceDown = false;
 
-        if (forcePieceDown) {
-            speedCounter = 0;
-            pieceCounter++;
-            if (pieceCounter % 50 == 0 && speed >= 10) speed--;
-
-            if (doesPieceFit(currentPiece, currentRotation, currentX, currentY + 1)) {
-                currentY++;
-            } else {
-                saveState();
-                int pieceSize = (currentPiece == 0) ? 4 : (currentPiece == 3) ? 2 : 3;
-                
-                for (int px = 0; px < pieceSize; px++) {
-                    for (int py = 0; py < pieceSize; py++) {
-                        int pi = rotate(px, py, currentRotation, pieceSize);
-                        if (pi < tetrominoes[currentPiece].size() && tetrominoes[currentPiece][pi] != L'.') {
-                            int fx = currentX + px + 1;
-                            int fy = currentY + py;
-                            if (fx > 0 && fx < fieldWidth - 1 && fy < fieldHeight - 1) {
-                                field[fy * fieldWidth + fx] = currentPiece + 1;
-                            }
-                        }
+        saveState();
+        botView.pieces++;
+        int pieceSize = (currentPiece == 0) ? 4 : (currentPiece == 3) ? 2 : 3;
+        
+        for (int px = 0; px < pieceSize; px++) {
+            for (int py = 0; py < pieceSize; py++) {
+                int pi = rotate(px, py, currentRotation, pieceSize);
+                if (pi < tetrominoes[currentPiece].size() && tetrominoes[currentPiece][pi] != L'.') {
+                    int fx = currentX + px + 1;
+                    int fy = currentY + py;
+                    if (fx > 0 && fx < fieldWidth - 1 && fy < fieldHeight - 1) {
+                        field[fy * fieldWidth + fx] = currentPiece + 1;
                     }
                 }
+            }
+        }
 
-                score += 250;
+        score += 250;
 
-                completedLines.clear();
-                for (int y = 0; y < fieldHeight - 1; y++) {
-                    bool lineComplete = true;
-                    for (int x = 1; x < fieldWidth - 1; x++) {
-                        if (field[y * fieldWidth + x] == 0) {
-                            lineComplete = false;
-                            break;
-                        }
-                    }
-                    if (lineComplete) {
-                        completedLines.push_back(y);
-                    }
+        FrameStats::Stamp clearStart = frameStats.begin();
+        completedLines.clear();
+        for (int y = 0; y < fieldHeight - 1; y++) {
+            bool lineComplete = true;
+            for (int x = 1; x < fieldWidth - 1; x++) {
+                if (field[y * fieldWidth + x] == 0) {
+                    lineComplete = false;
+                    break;
                 }
+            }
+            if (lineComplete) {
+                completedLines.push_back(y);
+            }
+        }
     
-                if (!completedLines.empty()) {
-                    linesCleared += completedLines.size();
-                    totalLinesCleared += completedLines.size();
-                    
-                    level = max(1, totalLinesCleared / 2 + 1);
-                    speed = max(2, 30 - (level * 2));
-
-                    switch (completedLines.size()) {
-                        case 1: score += 1000 * level; break;
-                        case 2: score += 2000 * level; break;
-                        case 3: score += 3000 * level; break;
-                        case 4: score += 5000 * level; break;
-                    }
-                    
-                    for (int i = 0; i < 2; i++) {
-                        for (int line : completedLines) {
-                            for (int x = 1; x < fieldWidth - 1; x++) {
-                                field[line * fieldWidth + x] = 8;
-                            }
-                        }
-                        drawGame();
-                        usleep(200000);
-                        
-                        for (int line : completedLines) {
-                            for (int x = 1; x < fieldWidth - 1; x++) {
-                                field[line * fieldWidth + x] = currentPiece + 1;
-                            }
-                        }
-                        drawGame();
-                        usleep(200000);
-                    }
-
-                    for (int line : completedLines) {
-                        for (int y = line; y > 0; y--) {
-                            for (int x = 1; x < fieldWidth - 1; x++) {
-                                field[y * fieldWidth + x] = field[(y - 1) * fieldWidth + x];
-                            }
-                        }
-                        for (int x = 1; x < fieldWidth - 1; x++) {
-                            field[x] = 0;
-                        }
-                    }
-                }
-
-                currentPiece = nextPiece;
-                nextPiece = rand() % 7;
-                currentX = playWidth / 2 - 1;
-                currentY = 0;
-                currentRotation = 0;
+        if (!completedLines.empty()) {
+            linesCleared += completedLines.size();
+            totalLinesCleared += completedLines.size();
+            
+            level = max(1, totalLinesCleared / 2 + 1);
+            speed = max(2, 30 - (level * 2));
 
-                isGameOver = !doesPieceFit(currentPiece, currentRotation, currentX, currentY);
+            switch (completedLines.size()) {
+                case 1: score += 1000 * level; break;
+                case 2: score += 2000 * level; break;
+                case 3: score += 3000 * level; break;
+                case 4: score += 5000 * level; break;
             }
+            
+            frameStats.end(PHASE_LINE_CLEAR, clearStart);
+            animations.start(lineClearAnimation());
+            return;
         }
+        frameStats.end(PHASE_LINE_CLEAR, clearStart);
+        spawnNextPiece();
     }
 
-    void drawField() {
-        cout << "\033[3;1H" << BG_GRAY << "  " << RESET;
-        for (int x = 1; x < fieldWidth - 1; x++) {
-            cout << BG_GRAY << "  " << RESET;
-        }
-        cout << BG_GRAY << "  " << RESET;
-
-        for (int y = 0; y < fieldHeight - 1; y++) {
-            cout << "\033[" << y + 4 << ";1H" << BG_GRAY << "  " << RESET;
-            
-            for (int x = 1; x < fieldWidth - 1; x++) {
-                unsigned char cell = field[y * fieldWidth + x];
-                if (cell >= 1 && cell <= 7) {
-                    cout << BG_BLACK << TETROMINO_COLORS[cell-1] << "■ " << RESET;
-                } else if (cell == 8) {
-                    cout << BG_WHITE << BLACK << "■ " << RESET;
-                } else {
-                    cout << BG_BLACK << "  " << RESET;
+    // Flashes the completed lines twice, then removes them. The main loop
+    // steps it between ticks, so input keeps being read while it plays.
+    Animation lineClearAnimation() {
+        for (int i = 0; i < 2; i++) {
+            for (int line : completedLines) {
+                for (int x = 1; x < fieldWidth - 1; x++) {
+                    field[line * fieldWidth + x] = 8;
                 }
             }
+            co_yield chrono::milliseconds(200);
             
-            cout << BG_GRAY << "  " << RESET;
+            for (int line : completedLines) {
+                for (int x = 1; x < fieldWidth - 1; x++) {
+                    field[line * fieldWidth + x] = currentPiece + 1;
+                }
+            }
+            co_yield chrono::milliseconds(200);
         }
 
-        cout << "\033[" << fieldHeight + 3 << ";1H" << BG_GRAY << "  " << RESET;
-        for (int x = 1; x < fieldWidth - 1; x++) {
-            cout << BG_GRAY << "  " << RESET;
+        FrameStats::Stamp clearStart = frameStats.begin();
+        for (int line : completedLines) {
+            for (int y = line; y > 0; y--) {
+                for (int x = 1; x < fieldWidth - 1; x++) {
+                    field[y * fieldWidth + x] = field[(y - 1) * fieldWidth + x];
+                }
+            }
+            for (int x = 1; x < fieldWidth - 1; x++) {
+                field[x] = 0;
+            }
         }
-        cout << BG_GRAY << "  " << RESET;
+        frameStats.end(PHASE_LINE_CLEAR, clearStart);
+        spawnNextPiece();
     }
 
-    void drawCurrentPiece() {
-        int pieceSize = (currentPiece == 0) ? 4 : (currentPiece == 3) ? 2 : 3;
-        
-        for (int py = 0; py < pieceSize; py++) {
-            for (int px = 0; px < pieceSize; px++) {
-                int pi = rotate(px, py, currentRotation, pieceSize);
-                if (pi < tetrominoes[currentPiece].size() && tetrominoes[currentPiece][pi] != L'.') {
-                    int screenY = currentY + py + 4;
-                    int screenX = (currentX + px + 1) * 2 + 1;
-                    cout << "\033[" << screenY << ";" << screenX << "H";
-                    cout << BG_BLACK << TETROMINO_COLORS[currentPiece] << "■" << RESET;
-                }
+    void spawnNextPiece() {
+        currentPiece = nextPiece;
+        nextPiece = rng.nextPiece();
+        currentX = playWidth / 2 - 1;
+        currentY = 0;
+        currentRotation = 0;
+        gravityCarry = 0;
+        lockDelay.reset(true);
+
+        isGameOver = !doesPieceFit(currentPiece, currentRotation, currentX, currentY);
+    }
+
+    // Redraws the field rows marked in `dirty` (all of them without a frame
+    // on screen), each followed by the part of the current piece on it
+    void drawField(const FrameSnapshot &frame, const bool *dirty) const {
+        // Cursor moves don't touch SGR state, so one emitter covers the whole field
+        CellEmitter cells(cout);
+        if (!dirty) {
+            cout << "\033[3;1H";
+            for (int x = 0; x < fieldWidth; x++) cells.put(STYLE_BORDER, GLYPH_BLANK);
+        }
+
+        // Field values are cell styles; the walls and floor are already in the field
+        int minos[4][2];
+        int count = pieceCells(frame, minos);
+        for (int y = 0; y < fieldHeight; y++) {
+            if (dirty && !dirty[y]) continue;
+            cout << "\033[" << y + 4 << ";1H";
+            for (int x = 0; x < fieldWidth; x++) {
+                unsigned char cell = frame.field[y * fieldWidth + x];
+                cells.put(cell, cell >= 1 && cell <= 8 ? GLYPH_BLOCK : GLYPH_BLANK);
+            }
+            for (int i = 0; i < count; i++) {
+                if (minos[i][0] != y) continue;
+                cout << "\033[" << y + 4 << ";" << minos[i][1] * 2 + 1 << "H";
+                cells.put(frame.currentPiece + 1, GLYPH_MINO);
             }
         }
     }
 
-    void clearNextPieceArea() {
+    // Field (row, column) of each cell of the frame's current piece
+    int pieceCells(const FrameSnapshot &frame, int minos[4][2]) const {
+        int count = 0;
+        forEachMino(frame.currentPiece, frame.currentRotation, [&](int px, int py) {
+            if (count < 4) {
+                minos[count][0] = frame.currentY + py;
+                minos[count][1] = frame.currentX + px + 1;
+                count++;
+            }
+        });
+        return count;
+    }
+
+    void clearNextPieceArea(CellEmitter &cells) const {
         for (int y = 4; y < 8; y++) {
             cout << "\033[" << y << ";25H";
-            for (int x = 0; x < 8; x++) {
-                cout << BG_BLACK << "  " << RESET;
-            }
+            for (int x = 0; x < 8; x++) cells.put(STYLE_EMPTY, GLYPH_BLANK);
         }
     }
 
-    void drawSidePanel() {
+    // The help text only goes out without a frame on screen, and the next
+    // piece only when it changed
+    void drawSidePanel(const FrameSnapshot &frame, const FrameSnapshot *shown) const {
+        if (!shown || shown->nextPiece != frame.nextPiece) drawNextPiece(frame);
+        if (!shown) drawHelp();
+        drawPerformanceHud(frame, shown);
+    }
+
+    void drawNextPiece(const FrameSnapshot &frame) const {
         // Next piece
         cout << "\033[3;25H" << "  Next piece: ";
         
         // Clear and draw next piece
-        clearNextPieceArea();
+        CellEmitter cells(cout);
+        clearNextPieceArea(cells);
+        int nextPiece = frame.nextPiece;
         int pieceSize = (nextPiece == 0) ? 4 : (nextPiece == 3) ? 2 : 3;
         for (int py = 0; py < pieceSize; py++) {
             for (int px = 0; px < pieceSize; px++) {
@@ -515,11 +1642,14 @@ private:
             
                 if (pi < tetrominoes[nextPiece].size() && tetrominoes[nextPiece][pi] != L'.') {
                     cout << "\033[" << (4 + py) << ";" << (27 + px*2) << "H";
-                    cout << BG_BLACK << TETROMINO_COLORS[nextPiece] << "■ " << RESET;
+                    cells.put(nextPiece + 1, GLYPH_BLOCK);
                 }
             }
         }
-        
+        cells.finish();
+    }
+
+    void drawHelp() const {
         // Scoring
         cout << "\033[10;25H" << "     Scoring System:";
         cout << "\033[11;25H" << "      Single line: " << GREEN << "1000 × level" << RESET;
@@ -534,21 +1664,231 @@ private:
         cout << "\033[19;25H" << "      S - Down"<<"      D - Right";
         cout << "\033[20;25H" << "      Space - Drop"<<"  P - Pause";
         cout << "\033[21;25H" << "      R - Restart"<<"   X - Exit";
+        cout << "\033[22;25H" << "      H - Perf HUD";
+    }
+
+    // Live counters from frameStats; blanks the area once after being hidden
+    // (a full redraw follows a cleared screen, so there is nothing to blank)
+    void drawPerformanceHud(const FrameSnapshot &frame, const FrameSnapshot *shown) const {
+        if (!frame.hudVisible) {
+            if (shown && shown->hudVisible) {
+                for (int i = 0; i < 7; i++) cout << "\033[" << 24 + i << ";25H" << string(30, ' ');
+            }
+            return;
+        }
+
+        const HudValues &hud = frameStats.hud();
+        char line[7][40];
+        snprintf(line[0], sizeof(line[0]), "     %-25s", "Performance:");
+        snprintf(line[1], sizeof(line[1]), "      Tick rate: %7.1f /s ", hud.tickRate);
+        snprintf(line[2], sizeof(line[2]), "      Compose:   %7.0f us ", hud.composeUs);
+        snprintf(line[3], sizeof(line[3]), "      Output:    %7.0f B  ", hud.bytesPerFrame);
+        snprintf(line[4], sizeof(line[4]), "      Input lag: %7.1f ms ", hud.inputLatencyMs);
+        snprintf(line[5], sizeof(line[5]), "      Allocs:    %7.0f /s ", hud.allocsPerSec);
+        snprintf(line[6], sizeof(line[6]), "      Skipped:   %7.1f /s ", hud.skippedPerSec);
+        for (int i = 0; i < 7; i++) cout << "\033[" << 24 + i << ";25H" << line[i];
+    }
+
+    // Copies the state the renderer needs into the triple buffer
+    void publishFrame() {
+        FrameSnapshot &frame = frames.writeSlot();
+        memcpy(frame.field, field, sizeof(frame.field));
+        frame.currentPiece = currentPiece;
+        frame.currentRotation = currentRotation;
+        frame.currentX = currentX;
+        frame.currentY = currentY;
+        frame.nextPiece = nextPiece;
+        frame.level = level;
+        frame.score = score;
+        frame.totalLinesCleared = totalLinesCleared;
+        frame.highScore = highScore;
+        frame.paused = isPaused;
+        frame.hudVisible = hudVisible;
+        frame.tick = tick;
+
+        // Keep reporting the oldest unseen key until a frame showing it is flushed
+        if (pendingInput != FrameStats::Stamp() && presentedTick.load(memory_order_acquire) >= pendingInputTick) {
+            pendingInput = FrameStats::Stamp();
+        }
+        frame.inputStamp = pendingInput;
+        frame.inputTick = pendingInputTick;
+
+        frames.publish();
+        if (shmExport.isOpen()) exportState();
+    }
+
+    // Same tick, for readers of the shared-memory segment: locked cells
+    // (walls left out) and the falling piece kept apart
+    void exportState() const {
+        TetrisShmSnapshot state;
+        memset(&state, 0, sizeof(state));
+        state.tick = tick;
+        state.score = score;
+        state.level = level;
+        state.lines = totalLinesCleared;
+        state.rows = fieldHeight - 1;
+        state.cols = playWidth;
+        state.piece = (uint8_t)currentPiece;
+        state.next = (uint8_t)nextPiece;
+        state.rotation = (uint8_t)(currentRotation % 4);
+        state.flags = (isPaused ? TETRIS_SHM_PAUSED : 0) | (isGameOver ? TETRIS_SHM_GAME_OVER : 0);
+        for (int y = 0; y < fieldHeight - 1; y++) {
+            for (int x = 0; x < playWidth; x++) state.cells[y][x] = field[y * fieldWidth + x + 1];
+        }
+
+        pieceMinos(state.minos);
+        shmExport.publish(state);
+    }
+
+    // (row, col) of each cell of the falling piece, in play-area columns
+    void pieceMinos(int8_t minos[4][2]) const {
+        int mino = 0;
+        forEachMino(currentPiece, currentRotation, [&](int px, int py) {
+            if (mino < 4) {
+                minos[mino][0] = (int8_t)(currentY + py);
+                minos[mino][1] = (int8_t)(currentX + px);
+                mino++;
+            }
+        });
+    }
+
+    // Lets the --bot plugin play this tick: it sees the field in place (walls
+    // skipped by the offset and stride) and its buttons act like keys
+    void runBot() {
+        botView.tick = tick;
+        botView.rows = fieldHeight - 1;
+        botView.cols = playWidth;
+        botView.rowStride = fieldWidth;
+        botView.cells = field + 1;
+        botView.score = score;
+        botView.level = level;
+        botView.lines = totalLinesCleared;
+        botView.piece = (uint8_t)currentPiece;
+        botView.next = (uint8_t)nextPiece;
+        botView.rotation = (uint8_t)(currentRotation % 4);
+        pieceMinos(botView.minos);
+
+        uint32_t buttons = botHost.call(botView);
+        botCallNs.record(botHost.lastCallNs());
+
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if ((buttons & TETRIS_BOT_ROTATE) && doesPieceFit(currentPiece, currentRotation + 1, currentX, currentY)) {
+            currentRotation++;
+            lockDelay.moved(now);
+        }
+        if (buttons & TETRIS_BOT_LEFT) tryMove(currentX - 1, currentY);
+        if (buttons & TETRIS_BOT_RIGHT) tryMove(currentX + 1, currentY);
+        if (buttons & TETRIS_BOT_HARD_DROP) dropPiece();
+        else if (buttons & TETRIS_BOT_SOFT_DROP) tryMove(currentX, currentY + 1);
     }
 
-    void drawGame() {
+    // Render thread: draws the newest published frame as a diff against the
+    // one on screen. While the terminal is still taking an earlier frame,
+    // newer frames are only picked up, and the next diff covers them all.
+    void renderLoop() {
+        bool pauseShown = false;
+        uint64_t measuredInputTick = 0;
+        FrameSnapshot shown; // what the terminal has (or will have, once the queue drains)
+        bool haveShown = false;
+        bool waiting = false; // a picked-up frame hasn't been drawn yet
+        uint64_t lastTick = 0;
+
+        // Stats for the last frame drawn, reported once it has left the queue
+        bool unreported = false;
+        FrameStats::Stamp reportInput;
+        uint64_t reportTick = 0;
+
+        while (rendering) {
+            if (frames.update()) {
+                const FrameSnapshot &next = frames.readSlot();
+                if (waiting) frameOutput.noteCoalesced();
+                if (lastTick != 0 && next.tick > lastTick + 1) frameOutput.noteDropped(next.tick - lastTick - 1);
+                lastTick = next.tick;
+                waiting = true;
+            }
+
+            if (!frameOutput.pump()) {
+                frameOutput.waitWritable(1);
+                continue;
+            }
+            if (unreported) {
+                frameStats.endFrame(reportInput, reportTick);
+                presentedTick.store(reportTick, memory_order_release);
+                unreported = false;
+            }
+            if (!waiting) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+            waiting = false;
+
+            const FrameSnapshot &frame = frames.readSlot();
+            frameStats.setHudVisible(frame.hudVisible);
+
+            if (frame.paused) {
+                // The pause screen is static: draw it once per pause
+                if (!pauseShown) drawPauseScreen();
+                pauseShown = true;
+            } else {
+                // Clear the pause screen completely when unpausing
+                if (pauseShown) {
+                    clearScreen();
+                    haveShown = false;
+                }
+                pauseShown = false;
+                drawGame(frame, haveShown ? &shown : nullptr);
+                shown = frame;
+                haveShown = true;
+            }
+
+            bool newInput = frame.inputStamp != FrameStats::Stamp() && frame.inputTick != measuredInputTick;
+            if (newInput) measuredInputTick = frame.inputTick;
+            reportInput = newInput ? frame.inputStamp : FrameStats::Stamp();
+            reportTick = frame.tick;
+            unreported = true;
+        }
+        if (unreported) {
+            frameStats.endFrame(reportInput, reportTick);
+            presentedTick.store(reportTick, memory_order_release);
+        }
+    }
+
+    // Draws only what differs from `shown`, the frame on screen, or
+    // everything without one
+    void drawGame(const FrameSnapshot &frame, const FrameSnapshot *shown) const {
+        FrameStats::Stamp phaseStart = frameStats.begin();
         // Header
-        cout << "\033[1;1H" << BG_BLUE << WHITE << BOLD << " TETRIS " << RESET << "  ";
-        cout << BG_GREEN << BLACK << " Level: " << level << " " << RESET << "  ";
-        cout << BG_YELLOW << BLACK << " Score: " << score << " " << RESET << "  ";
-        cout << BG_MAGENTA << WHITE << " Lines: " << totalLinesCleared << " " << RESET << "  ";
-        cout << BG_RED << WHITE << " High: " << highScore << " " << RESET << "\n";
-        
-        drawField();
-        drawCurrentPiece();
-        drawSidePanel();
-        
+        if (!shown || shown->level != frame.level || shown->score != frame.score ||
+            shown->totalLinesCleared != frame.totalLinesCleared || shown->highScore != frame.highScore) {
+            cout << "\033[1;1H" << BG_BLUE << WHITE << BOLD << " TETRIS " << RESET << "  ";
+            cout << BG_GREEN << BLACK << " Level: " << frame.level << " " << RESET << "  ";
+            cout << BG_YELLOW << BLACK << " Score: " << frame.score << " " << RESET << "  ";
+            cout << BG_MAGENTA << WHITE << " Lines: " << frame.totalLinesCleared << " " << RESET << "  ";
+            cout << BG_RED << WHITE << " High: " << frame.highScore << " " << RESET << "\n";
+        }
+
+        if (shown) {
+            // A row changes if its cells did or the piece moved onto or off it
+            bool dirty[fieldHeight];
+            for (int y = 0; y < fieldHeight; y++) {
+                dirty[y] = memcmp(&shown->field[y * fieldWidth], &frame.field[y * fieldWidth], fieldWidth) != 0;
+            }
+            if (shown->currentPiece != frame.currentPiece || shown->currentRotation != frame.currentRotation ||
+                shown->currentX != frame.currentX || shown->currentY != frame.currentY) {
+                int minos[4][2];
+                for (int i = 0, n = pieceCells(*shown, minos); i < n; i++) dirty[minos[i][0]] = true;
+                for (int i = 0, n = pieceCells(frame, minos); i < n; i++) dirty[minos[i][0]] = true;
+            }
+            drawField(frame, dirty);
+        } else {
+            drawField(frame, nullptr);
+        }
+        drawSidePanel(frame, shown);
+        frameStats.end(PHASE_COMPOSE, phaseStart);
+
+        phaseStart = frameStats.begin();
         cout.flush();
+        frameStats.end(PHASE_FLUSH, phaseStart);
     }
 
     void drawPauseScreen() {
@@ -563,7 +1903,6 @@ private:
         cout << "         ╚═╝     ╚═╝  ╚═╝ ╚═════╝ ╚══════╝╚══════╝       \n";
         cout << RESET << "\n\n";
         cout << BG_YELLOW << BLACK << "           Press P to continue           " << RESET << "\n";
-        usleep(1000000);
         cout.flush();
     }
 
@@ -619,15 +1958,68 @@ private:
             currentX = previousX;
             currentY = previousY;
             score = previousScore;
+            lockDelay.reset(true);
             delete[] previousField;
             previousField = nullptr;
         }
     }
 };
 
-int main() {
-    system("clear");
-    TetrisGame game;
-    game.run();
+// Usage: --render-check <script>... [--update] [--max-growth PCT]
+int runRenderCheck(int argc, char *argv[]) {
+    return runRenderScripts(argc, argv, [](const RenderScript &script, VirtualTerminal &terminal, RenderRecorder &recorder) {
+        TetrisGame game;
+        game.playRenderScript(script, terminal, recorder);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "--render-check") return runRenderCheck(argc, argv);
+    bool resume = true;
+    string shmName;
+    string botPath, botArgs;
+    int botBudgetUs = 1000, botStrikes = 10;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--new") resume = false;
+        else if (arg == "--stats") frameStats.enable("tetris_stats.txt");
+        else if (arg.compare(0, 8, "--stats=") == 0) frameStats.enable(arg.substr(8));
+        else if (arg == "--das" && i + 1 < argc) inputTiming.das = max(0, atoi(argv[++i]));
+        else if (arg == "--arr" && i + 1 < argc) inputTiming.arr = max(0, atoi(argv[++i]));
+        else if (arg == "--hold-gap" && i + 1 < argc) inputTiming.holdGap = max(1, atoi(argv[++i]));
+        else if (arg == "--gravity" && i + 1 < argc) gravityTiming.g = max(0.0, atof(argv[++i]));
+        else if (arg == "--lock-delay" && i + 1 < argc) gravityTiming.lockDelay = max(0, atoi(argv[++i]));
+        else if (arg == "--lock-resets" && i + 1 < argc) gravityTiming.lockResets = max(0, atoi(argv[++i]));
+        else if (arg == "--bot" && i + 1 < argc) botPath = argv[++i];
+        else if (arg == "--bot-args" && i + 1 < argc) botArgs = argv[++i];
+        else if (arg == "--bot-budget-us" && i + 1 < argc) botBudgetUs = max(1, atoi(argv[++i]));
+        else if (arg == "--bot-strikes" && i + 1 < argc) botStrikes = max(1, atoi(argv[++i]));
+        else if (arg == "--shm") shmName = TETRIS_SHM_CLASSIC;
+        else if (arg.compare(0, 6, "--shm=") == 0) shmName = arg.substr(6);
+    }
+    if (!shmName.empty() && !shmExport.create(shmName.c_str())) {
+        cerr << "Cannot create shared memory " << shmName << ": " << strerror(errno) << "\n";
+    }
+    if (!botPath.empty()) {
+        string error;
+        if (!botHost.load(botPath, botArgs, error)) {
+            cerr << "Cannot load bot: " << error << "\n";
+            return 1;
+        }
+        botHost.setBudget(botBudgetUs, botStrikes);
+    }
+
+    signal(SIGTERM, requestQuit);
+    signal(SIGINT, requestQuit);
+    signal(SIGHUP, requestQuit);
+
+    cout << "\033[2J\033[H";
+    {
+        TetrisGame game;
+        if (resume) game.loadSnapshot(SAVE_FILE); // a missing or invalid save starts a new game
+        game.run();
+    }
+    frameStats.writeReport();
+    writeBotReport();
     return 0;
 }
\ No newline at end of file
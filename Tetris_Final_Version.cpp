@@ -15,15 +15,48 @@
 #include <cstdlib>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdint>
+#include <cctype>
+#include <cstdio>
+#include <streambuf>
+#include <new>
+#include <climits>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <iterator>
+#include <unordered_map>
+#include "tetris_anim.h"
+#include "tetris_render_check.h"
+#include "tetris_engine.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #include <conio.h> // Windows-specific for _kbhit() and getch()
+#include <io.h>    // _commit()
 #else
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <stdio.h>
+#include "tetris_shm.h"
+#include "tetris_bot.h"
 #endif
 
 using namespace std;
@@ -137,7 +170,17 @@ inline void clearScreen()
 #ifdef _WIN32
     SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), {0, 0});
 #else
-    system("clear");
+    cout << "\033[2J\033[H";
+#endif
+}
+
+// Blanks the whole screen (clearScreen() only homes the cursor on Windows)
+inline void eraseScreen()
+{
+#ifdef _WIN32
+    system("cls");
+#else
+    cout << "\033[2J\033[H" << flush;
 #endif
 }
 
@@ -160,728 +203,6486 @@ inline void resetColor()
     cout << "\033[0m";
 }
 
-/**************************************************************
- * 3) Basic definitions for Tetris
- **************************************************************/
-const int BOARD_WIDTH = 10;  // You can adjust as you like
-const int BOARD_HEIGHT = 20; // You can adjust as you like
+// Moves the cursor home without clearing, so a full redraw overwrites the
+// previous frame in place (what clearScreen() already does on Windows)
+inline void homeCursor()
+{
+    cout << "\033[H";
+}
 
-// 7 standard Tetromino shapes (4x4)
-static const vector<vector<vector<int>>> TETROMINO_SHAPES = {
-    // I
-    {
-        {0, 0, 0, 0},
-        {1, 1, 1, 1},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}},
-    // O
-    {
-        {1, 1, 0, 0},
-        {1, 1, 0, 0},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}},
-    // T
-    {
-        {0, 1, 0, 0},
-        {1, 1, 1, 0},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}},
-    // S
-    {
-        {0, 1, 1, 0},
-        {1, 1, 0, 0},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}},
-    // Z
-    {
-        {1, 1, 0, 0},
-        {0, 1, 1, 0},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}},
-    // J
+// Cell styles used by the board and the next-piece preview.
+// 1..7 match the tetromino color indices.
+enum CellStyle
+{
+    STYLE_DEFAULT = 0,
+    STYLE_EDGE_TOP = 8, // top/bottom border corners
+    STYLE_EDGE_SIDE,    // left/right border
+    STYLE_COUNT
+};
+
+enum Glyph
+{
+    GLYPH_EMPTY, // one board cell: two columns
+    GLYPH_EDGE,  // one border column
+    GLYPH_RULE,  // one column of the top/bottom border
+    GLYPH_COUNT
+};
+
+// Pre-encoded UTF-8 bytes for each glyph
+const struct
+{
+    const char *bytes;
+    size_t length;
+} GLYPHS[GLYPH_COUNT] = {{"  ", 2}, {" ", 1}, {"-", 1}};
+
+// Writes cells while tracking the terminal's current SGR state: escape
+// sequences go out only when the style actually changes, taken from a
+// table of every from->to transition built once at startup. A run of
+// same-colored cells costs just the glyph bytes.
+class CellEmitter
+{
+private:
+    struct Transitions
     {
-        {1, 0, 0, 0},
-        {1, 1, 1, 0},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}},
-    // L
+        string sequence[STYLE_COUNT][STYLE_COUNT];
+
+        Transitions()
+        {
+            // Background SGR parameter per style; these cells never set a foreground
+            string background[STYLE_COUNT] = {"49"};
+            for (int color = 1; color <= 7; color++)
+                background[color] = to_string(40 + color % 8);
+            background[STYLE_EDGE_TOP] = "101";
+            background[STYLE_EDGE_SIDE] = "106";
+            for (int from = 0; from < STYLE_COUNT; from++)
+                for (int to = 0; to < STYLE_COUNT; to++)
+                    if (from != to)
+                        sequence[from][to] = to == STYLE_DEFAULT ? "\033[0m" : "\033[" + background[to] + "m";
+        }
+    };
+
+    static const Transitions &transitions()
     {
-        {0, 0, 1, 0},
-        {1, 1, 1, 0},
-        {0, 0, 0, 0},
-        {0, 0, 0, 0}}};
+        static const Transitions table;
+        return table;
+    }
 
-/**************************************************************
- * 4) Tetromino Base Class
- **************************************************************/
-class Tetromino
-{
-protected:
-    vector<vector<int>> shape; // 4x4
-    int colorIndex;            // for distinct color
+    ostream &out;
+    int current;
 
 public:
-    Tetromino(const vector<vector<int>> &shp, int color)
-        : shape(shp), colorIndex(color) {}
-    virtual ~Tetromino() {}
+    // Assumes the terminal is at default attributes (after a reset)
+    explicit CellEmitter(ostream &o) : out(o), current(STYLE_DEFAULT) {}
+    ~CellEmitter() { finish(); }
 
-    virtual void rotateCW()
+    void put(int style, Glyph glyph)
     {
-        // Rotate shape 90 degrees clockwise
-        vector<vector<int>> rotated(4, vector<int>(4, 0));
-        for (int r = 0; r < 4; r++)
+        if (style != current)
         {
-            for (int c = 0; c < 4; c++)
-            {
-                rotated[c][4 - 1 - r] = shape[r][c];
-            }
+            const string &change = transitions().sequence[current][style];
+            out.write(change.data(), change.size());
+            current = style;
         }
-        shape = rotated;
+        out.write(GLYPHS[glyph].bytes, GLYPHS[glyph].length);
     }
 
-    // Accessors
-    const vector<vector<int>> &getShape() const { return shape; }
-    int getColorIndex() const { return colorIndex; }
+    // Back to default attributes before any plain text is written
+    void finish()
+    {
+        if (current != STYLE_DEFAULT)
+        {
+            const string &change = transitions().sequence[current][STYLE_DEFAULT];
+            out.write(change.data(), change.size());
+            current = STYLE_DEFAULT;
+        }
+    }
 };
 
-// Concrete Tetromino Classes (for demonstration)(shape, colorIndex)
-class TetrominoI : public Tetromino
-{
-public:
-    TetrominoI() : Tetromino(TETROMINO_SHAPES[0], 1) {}
-};
-class TetrominoO : public Tetromino
-{
-public:
-    TetrominoO() : Tetromino(TETROMINO_SHAPES[1], 2) {}
-};
-class TetrominoT : public Tetromino
+/**************************************************************
+ * 2b) Frame instrumentation (enabled with --stats)
+ *     Each phase costs two steady_clock reads and one histogram
+ *     increment, so it is cheap enough to leave on all the time.
+ **************************************************************/
+
+// Allocation counter for the HUD. Off by default: operator new then
+// pays a single predictable branch. Set by the render thread (HUD toggle),
+// read by every allocating thread.
+atomic<bool> countAllocations(false);
+atomic<uint64_t> allocationCount(0);
+
+#ifndef TETRIS_LIBRARY // a library leaves its host's allocator alone
+void *operator new(size_t size)
 {
-public:
-    TetrominoT() : Tetromino(TETROMINO_SHAPES[2], 3) {}
-};
-class TetrominoS : public Tetromino
+    if (countAllocations.load(memory_order_relaxed))
+        allocationCount.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
 {
-public:
-    TetrominoS() : Tetromino(TETROMINO_SHAPES[3], 4) {}
-};
-class TetrominoZ : public Tetromino
+    return operator new(size);
+}
+
+// GCC sees a free() inlined where it can only see `new` allocate, not that
+// this operator new is malloc underneath, and warns at every inlined delete
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept
 {
-public:
-    TetrominoZ() : Tetromino(TETROMINO_SHAPES[4], 5) {}
-};
-class TetrominoJ : public Tetromino
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
 {
-public:
-    TetrominoJ() : Tetromino(TETROMINO_SHAPES[5], 6) {}
-};
-class TetrominoL : public Tetromino
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
 {
-public:
-    TetrominoL() : Tetromino(TETROMINO_SHAPES[6], 7) {}
-};
+    free(p);
+}
 
-/**************************************************************
- * 5) Board Class: Encapsulates the 2D grid
- **************************************************************/
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
 
-class Board
+// Log-linear histogram: 8 linear buckets per power of two, so any
+// reported value is within 12.5% of the true one. Fixed size, no allocation.
+class LatencyHistogram
 {
 private:
-    // board[r][c] = 0 if empty, else color index
-    vector<vector<int>> board;
+    static const int SUB_BUCKETS = 8;
+    static const int BUCKETS = 62 * SUB_BUCKETS;
+    uint32_t counts[BUCKETS] = {};
+    uint64_t samples = 0;
+    uint64_t maxValue = 0;
+
+    static int bucketOf(uint64_t v)
+    {
+        if (v < SUB_BUCKETS)
+            return (int)v;
+        int e = 63 - __builtin_clzll(v);
+        return (e - 2) * SUB_BUCKETS + (int)((v >> (e - 3)) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t bucketLow(int b)
+    {
+        if (b < SUB_BUCKETS)
+            return (uint64_t)b;
+        int e = b / SUB_BUCKETS + 2;
+        return (uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS) << (e - 3);
+    }
 
 public:
-    Board()
+    void record(uint64_t v)
     {
-        board.resize(BOARD_HEIGHT, vector<int>(BOARD_WIDTH, 0));
+        counts[bucketOf(v)]++;
+        samples++;
+        if (v > maxValue)
+            maxValue = v;
     }
 
-    bool canPlace(const Tetromino &t, int row, int col) const
+    uint64_t count() const { return samples; }
+    uint64_t max() const { return maxValue; }
+
+    // Upper edge of the bucket holding the p-th fraction of samples
+    uint64_t percentile(double p) const
     {
-        const auto &shape = t.getShape(); // 2d matrix for perticular shape
-        for (int r = 0; r < 4; r++)
+        if (samples == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(p * samples + 0.5);
+        if (rank < 1)
+            rank = 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++)
         {
-            for (int c = 0; c < 4; c++)
-            {
-                if (shape[r][c] != 0)
-                {
-                    int br = row + r;
-                    int bc = col + c;
-                    // Out of bounds?
-                    if (br < 0 || br >= BOARD_HEIGHT || bc < 0 || bc >= BOARD_WIDTH)
-                    {
-                        return false;
-                    }
-                    // Collision with existing block?
-                    if (board[br][bc] != 0)
-                    {
-                        return false;
-                    }
-                }
-            }
+            seen += counts[b];
+            if (seen >= rank)
+                return b + 1 < BUCKETS ? std::min(maxValue, bucketLow(b + 1) - 1) : maxValue;
         }
-        return true;
+        return maxValue;
     }
+};
 
-    void place(const Tetromino &t, int row, int col)
+// Collects a whole frame before handing it to the terminal, so compose
+// (writing into memory) and flush (terminal I/O) can be timed separately
+// and the bytes per frame counted.
+//
+// While the game runs the buffer is attached to cout. On a POSIX terminal
+// frames then go out through a non-blocking descriptor of our own: what
+// the terminal can't take yet waits in a bounded queue, and the renderer
+// holds off drawing until it drains. A slow terminal (e.g. over SSH) then
+// costs frames, never game time.
+class FrameBuffer : public streambuf
+{
+public:
+    static const size_t QUEUE_LIMIT = 64 * 1024; // queued bytes before sync() waits
+
+    // Redirects cout into the buffer until detach()
+    void attach()
     {
-        const auto &shape = t.getShape();
-        int color = t.getColorIndex();
-        for (int r = 0; r < 4; r++)
+        cout.flush();
+        target = cout.rdbuf(this);
+#ifndef _WIN32
+        // A private open file description, so stdin and the shell never see O_NONBLOCK
+        if (isatty(STDOUT_FILENO))
         {
-            for (int c = 0; c < 4; c++)
-            {
-                if (shape[r][c] != 0)
-                {
-                    int br = row + r;
-                    int bc = col + c;
-                    board[br][bc] = color;
-                }
-            }
+            const char *tty = ttyname(STDOUT_FILENO);
+            fd = tty ? open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC) : -1;
         }
+#endif
     }
 
-    // Clear full lines and return how many lines cleared
-    int clearLines()
+    // Writes out whatever is still queued and gives cout back
+    void detach()
     {
-        int linesCleared = 0;
-        for (int r = 0; r < BOARD_HEIGHT; r++)
+        if (!target)
+            return;
+        cout.flush();
+        drain();
+#ifndef _WIN32
+        if (fd >= 0)
+            close(fd);
+#endif
+        fd = -1;
+        cout.rdbuf(target);
+        target = nullptr;
+    }
+
+    // True while flushed frames are still waiting for the terminal
+    bool backlogged() const { return queueSent < queue.size(); }
+
+    // Writes as much of the queue as the terminal takes without blocking;
+    // true once it's empty
+    bool pump()
+    {
+#ifndef _WIN32
+        while (queueSent < queue.size())
         {
-            bool full = true;
-            for (int c = 0; c < BOARD_WIDTH; c++)
+            ssize_t n = write(fd, queue.data() + queueSent, queue.size() - queueSent);
+            if (n > 0)
             {
-                if (board[r][c] == 0)
-                {
-                    full = false;
-                    break;
-                }
+                queueSent += (size_t)n;
+                continue;
             }
-            if (full)
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
             {
-                // Shift everything down
-                for (int rr = r; rr > 0; rr--)
-                {
-                    board[rr] = board[rr - 1];
-                }
-                // Clear top row
-                board[0] = vector<int>(BOARD_WIDTH, 0);
-                linesCleared++;
+                stalls++;
+                return false;
             }
+            break; // terminal gone: nothing more can be shown
         }
-        return linesCleared;
+#endif
+        queue.clear();
+        queueSent = 0;
+        return true;
     }
 
-    bool isGameOver() const
+    // Sleeps until the terminal can take more output, or `ms` passes
+    void waitWritable(int ms)
     {
-        // If top row is non-zero, game is over
-        for (int c = 0; c < BOARD_WIDTH; c++)
+#ifndef _WIN32
+        if (backlogged())
         {
-            if (board[0][c] != 0)
-            {
-                return true;
-            }
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            ::poll(&pfd, 1, ms);
+            return;
         }
-        return false;
+#endif
+        this_thread::sleep_for(chrono::milliseconds(ms));
     }
 
-    // Accessor to read a specific cell (for drawing)
-    int getCell(int r, int c) const
+    // Counted by the renderer: frames it took while the terminal was backed
+    // up (folded into the next diff), and frames it never saw at all
+    void noteCoalesced() { coalesced++; }
+    void noteDropped(uint64_t frames) { dropped += frames; }
+
+    // Total bytes handed to the terminal so far
+    uint64_t bytesWritten() const { return written; }
+    uint64_t framesCoalesced() const { return coalesced; }
+    uint64_t framesDropped() const { return dropped; }
+    uint64_t writeStalls() const { return stalls; }
+
+protected:
+    int_type overflow(int_type ch) override
     {
-        return board[r][c];
+        if (ch != traits_type::eof())
+            frame.push_back((char)ch);
+        return traits_type::not_eof(ch);
     }
-};
 
-/**************************************************************
- * 6) Game Class: Manages game state, logic, user input, etc.
- *     Includes pause functionality (toggle with 'p')
- *     Now draws an interface resembling the screenshot
- **************************************************************/
-class Game
-{
-private:
-    Board board;
-    Tetromino *currentPiece;
-    Tetromino *nextPiece;
-    int currentRow, currentCol;
-    bool gameOver;
-    bool paused; // pause toggle
-    int level;
-    int linesClearedTotal;
+    streamsize xsputn(const char *s, streamsize n) override
+    {
+        frame.append(s, (size_t)n);
+        return n;
+    }
+
+    int sync() override
+    {
+        if (!frame.empty())
+        {
+            written += frame.size();
+            if (fd < 0)
+            {
+                target->sputn(frame.data(), (streamsize)frame.size());
+            }
+            else
+            {
+                if (!backlogged())
+                {
+                    queue.swap(frame); // reuse both strings' storage
+                    queueSent = 0;
+                }
+                else
+                {
+                    queue.append(frame);
+                }
+                if (queue.size() - queueSent > QUEUE_LIMIT)
+                    drain();
+                else
+                    pump();
+            }
+            frame.clear();
+        }
+        return fd < 0 ? target->pubsync() : 0;
+    }
+
+private:
+    streambuf *target = nullptr; // cout's own buffer while attached
+    int fd = -1;                 // non-blocking terminal, or -1 to write through target
+    string frame;                // being composed
+    string queue;                // flushed, not yet taken by the terminal
+    size_t queueSent = 0;
+    uint64_t written = 0;
+    uint64_t coalesced = 0, dropped = 0, stalls = 0;
+
+    // Blocks until the queue is out; gives up on a terminal stuck for seconds
+    void drain()
+    {
+        for (int i = 0; i < 50 && !pump(); i++)
+            waitWritable(100);
+        queue.clear();
+        queueSent = 0;
+    }
+};
+
+FrameBuffer frameOutput;
+
+enum FramePhase
+{
+    PHASE_INPUT,
+    PHASE_UPDATE,     // gravity and locking; includes line-clear
+    PHASE_LINE_CLEAR,
+    PHASE_COMPOSE,    // drawing the frame into memory
+    PHASE_FLUSH,      // writing the frame to the terminal
+    PHASE_COUNT
+};
+
+const char *const PHASE_NAMES[PHASE_COUNT] = {"input", "update", "line-clear", "compose", "flush"};
+
+// Values shown by the performance HUD, refreshed once per second
+struct HudValues
+{
+    double tickRate = 0;       // simulation ticks per second
+    double composeUs = 0;      // average time to draw a frame into memory
+    double bytesPerFrame = 0;  // average bytes written per frame
+    double inputLatencyMs = 0; // key read -> frame showing it flushed
+    double allocsPerSec = 0;   // operator new calls per second
+    double skippedPerSec = 0;  // frames coalesced or dropped per second
+};
 
+class FrameStats
+{
 public:
-    Game()
-        : currentPiece(nullptr), nextPiece(nullptr),
-          currentRow(0), currentCol(0),
-          gameOver(false), paused(false),
-          level(1), linesClearedTotal(0)
+    typedef chrono::steady_clock::time_point Stamp;
+
+    bool isActive() const { return active.load(memory_order_relaxed); }
+    bool isHudVisible() const { return hudVisible; }
+    const HudValues &hud() const { return hudValues; }
+
+    // Starts collecting; the report goes to `path` on exit
+    void enable(const string &path)
     {
-        srand((unsigned)time(nullptr));
-        currentPiece = randomTetromino();
-        nextPiece = randomTetromino();
-        // Center the initial piece
-        currentRow = 0;
-        currentCol = BOARD_WIDTH / 2 - 2;
+        reporting = true;
+        reportPath = path;
+        activate();
     }
 
-    ~Game()
+    // The HUD turns collection on the first time it is shown.
+    // Called from the thread that writes to cout.
+    void setHudVisible(bool visible)
     {
-        delete currentPiece;
-        delete nextPiece;
+        hudVisible = visible;
+        if (hudVisible)
+            activate();
     }
-    /**************************************************************
-     *Makeups: WelCome and GameOver screens
-     **************************************************************/
-    void showStartingAnimation()
+
+    Stamp begin() const
     {
-#ifdef _WIN32
-        system("cls");
-#else
-        system("clear");
+        return isActive() ? chrono::steady_clock::now() : Stamp();
+    }
+
+    // Phases may be timed from different threads, but each phase from only one
+    void end(FramePhase phase, Stamp start)
+    {
+        if (!isActive())
+            return;
+        uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        phases[phase].record(ns);
+        if (phase == PHASE_COMPOSE)
+            windowComposeNs += ns;
+    }
+
+    // Call once per presented frame, after the flush. `inputStamp` is when
+    // the oldest key shown for the first time in this frame was read, and
+    // `tick` the simulation tick the frame was taken at.
+    void endFrame(Stamp inputStamp, uint64_t tick)
+    {
+        if (!isActive())
+            return;
+        Stamp now = chrono::steady_clock::now();
+        uint64_t total = frameOutput.bytesWritten();
+        frameBytes.record(total - lastBytes);
+        windowBytes += total - lastBytes;
+        lastBytes = total;
+        windowFrames++;
+
+        if (inputStamp != Stamp())
+        {
+            uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(now - inputStamp).count();
+            inputLatency.record(ns);
+            windowLatencyNs += ns;
+            windowInputs++;
+        }
+
+        double seconds = chrono::duration<double>(now - windowStart).count();
+        if (seconds >= 1.0)
+        {
+            uint64_t allocs = allocationCount.load(memory_order_relaxed);
+            uint64_t skipped = frameOutput.framesCoalesced() + frameOutput.framesDropped();
+            hudValues.tickRate = (tick - windowTick) / seconds;
+            hudValues.composeUs = windowComposeNs / 1000.0 / windowFrames;
+            hudValues.bytesPerFrame = (double)windowBytes / windowFrames;
+            if (windowInputs)
+                hudValues.inputLatencyMs = windowLatencyNs / 1e6 / windowInputs;
+            hudValues.allocsPerSec = (allocs - windowAllocs) / seconds;
+            hudValues.skippedPerSec = (skipped - windowSkipped) / seconds;
+            windowStart = now;
+            windowTick = tick;
+            windowAllocs = allocs;
+            windowSkipped = skipped;
+            windowFrames = windowInputs = 0;
+            windowBytes = windowComposeNs = windowLatencyNs = 0;
+        }
+    }
+
+    // With --stats, writes p50/p99/max per phase, bytes per frame and the
+    // frames a slow terminal cost
+    bool writeReport()
+    {
+        if (!isActive())
+            return true;
+        active = false;
+        countAllocations = false;
+        if (!reporting)
+            return true;
+
+        ofstream file(reportPath);
+        if (!file.is_open())
+        {
+            cerr << "stats: cannot write " << reportPath << "\n";
+            return false;
+        }
+        char line[128];
+        file << "# Tetris frame statistics (times in microseconds)\n";
+        snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s\n", "phase", "samples", "p50", "p99", "max");
+        file << line;
+        for (int p = 0; p <= PHASE_COUNT; p++)
+        {
+            const LatencyHistogram &h = p < PHASE_COUNT ? phases[p] : inputLatency;
+            snprintf(line, sizeof(line), "%-12s %10llu %10.1f %10.1f %10.1f\n", p < PHASE_COUNT ? PHASE_NAMES[p] : "input->frame",
+                     (unsigned long long)h.count(), h.percentile(0.50) / 1000.0,
+                     h.percentile(0.99) / 1000.0, h.max() / 1000.0);
+            file << line;
+        }
+        file << "\n";
+        snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s\n", "output", "frames", "p50", "p99", "max");
+        file << line;
+        snprintf(line, sizeof(line), "%-12s %10llu %10llu %10llu %10llu\n", "bytes/frame",
+                 (unsigned long long)frameBytes.count(), (unsigned long long)frameBytes.percentile(0.50),
+                 (unsigned long long)frameBytes.percentile(0.99), (unsigned long long)frameBytes.max());
+        file << line;
+        snprintf(line, sizeof(line), "%-12s %10s %10s %10s\n", "", "coalesced", "dropped", "stalls");
+        file << line;
+        snprintf(line, sizeof(line), "%-12s %10llu %10llu %10llu\n", "terminal", (unsigned long long)frameOutput.framesCoalesced(),
+                 (unsigned long long)frameOutput.framesDropped(), (unsigned long long)frameOutput.writeStalls());
+        file << line;
+        return true;
+    }
+
+private:
+    atomic<bool> active{false};
+    bool reporting = false;
+    bool hudVisible = false;
+    string reportPath;
+    uint64_t lastBytes = 0;
+    LatencyHistogram phases[PHASE_COUNT];
+    LatencyHistogram frameBytes;
+    LatencyHistogram inputLatency;
+
+    // One-second window behind the HUD values
+    HudValues hudValues;
+    Stamp windowStart;
+    uint64_t windowFrames = 0, windowInputs = 0, windowAllocs = 0, windowTick = 0, windowSkipped = 0;
+    uint64_t windowBytes = 0, windowComposeNs = 0, windowLatencyNs = 0;
+
+    void activate()
+    {
+        if (isActive())
+            return;
+        countAllocations = true;
+        lastBytes = frameOutput.bytesWritten();
+        windowStart = chrono::steady_clock::now();
+        windowAllocs = allocationCount.load(memory_order_relaxed);
+        windowSkipped = frameOutput.framesCoalesced() + frameOutput.framesDropped();
+        active = true;
+    }
+};
+
+FrameStats frameStats;
+
+#ifndef _WIN32
+TetrisShmWriter shmExport;  // live state for overlays (--shm)
+TetrisBotHost botHost;      // in-process bot plugin (--bot)
+LatencyHistogram botCallNs; // time each bot call took
+
+// One line on stderr after the game: how the bot kept to its budget
+void writeBotReport()
+{
+    if (botHost.callCount() == 0)
+        return;
+    fprintf(stderr, "bot %s: %llu calls, p50 %.1f us, p99 %.1f us, max %.1f us, %llu over the %u us budget%s\n",
+            botHost.name().c_str(), (unsigned long long)botHost.callCount(), botCallNs.percentile(0.5) / 1000.0,
+            botCallNs.percentile(0.99) / 1000.0, botCallNs.max() / 1000.0,
+            (unsigned long long)botHost.overrunCount(), botHost.budget(),
+            botHost.wasDisabled() ? " (switched off for overrunning too often)" : "");
+}
 #endif
-        cout << "\033[44m" << "\033[37m" << "\033[1m";
 
-        vector<string> tetrisArt = {
-            "████████╗███████╗████████╗██████╗ ██╗███████╗",
-            "╚══██╔══╝██╔════╝╚══██╔══╝██╔══██╗██║██╔════╝",
-            "   ██║   █████╗     ██║   ██████╔╝██║███████╗",
-            "   ██║   ██╔══╝     ██║   ██╔══██╗██║╚════██║",
-            "   ██║   ███████╗   ██║   ██║  ██║██║███████║",
-            "   ╚═╝   ╚══════╝   ╚═╝   ╚═╝  ╚═╝╚═╝╚══════╝",
-            "    M A D E   B Y   T E A M   E N I G M A    "};
+/**************************************************************
+ * 2c) Lock-free triple buffer
+ *     One writer and one reader share three slots. The writer
+ *     always has a slot to fill and the reader always has a
+ *     complete one to draw; neither ever waits on the other.
+ *     Frames the reader never picked up are simply overwritten.
+ **************************************************************/
+template <typename T>
+class TripleBuffer
+{
+private:
+    static const uint8_t FRESH = 0x80; // middle slot holds an unread frame
+    T slots[3];
+    atomic<uint8_t> middle{2};
+    uint8_t writeIndex = 0; // owned by the writer
+    uint8_t readIndex = 1;  // owned by the reader
 
-        for (int i = 0; i < tetrisArt.size(); i++)
+public:
+    // Writer: fill this slot completely, then publish()
+    T &writeSlot() { return slots[writeIndex]; }
+
+    void publish()
+    {
+        writeIndex = middle.exchange(writeIndex | FRESH, memory_order_acq_rel) & ~FRESH;
+    }
+
+    // Reader: returns true if a newer frame than readSlot() was published
+    bool update()
+    {
+        if (!(middle.load(memory_order_relaxed) & FRESH))
+            return false;
+        readIndex = middle.exchange(readIndex, memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    const T &readSlot() const { return slots[readIndex]; }
+};
+
+/**************************************************************
+ * 2d) Input thread: timestamped key events through a lock-free
+ *     single-producer/single-consumer ring, plus delayed auto
+ *     shift (DAS) and auto repeat rate (ARR) for held keys.
+ **************************************************************/
+template <typename T, size_t N>
+class SpscRing
+{
+private:
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+    T items[N];
+    alignas(64) atomic<size_t> head{0}; // next item to read, owned by the consumer
+    alignas(64) atomic<size_t> tail{0}; // next slot to write, owned by the producer
+
+public:
+    bool push(const T &item)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == N)
+            return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Producer only: the next push() will succeed (the consumer only ever
+    // makes room)
+    bool canPush() const
+    {
+        return tail.load(memory_order_relaxed) - head.load(memory_order_acquire) < N;
+    }
+
+    bool pop(T &item)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire))
+            return false;
+        item = items[h & (N - 1)];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+};
+
+struct KeyEvent
+{
+    int key; // same codes getch() returns (arrows as 72/75/77/80)
+    chrono::steady_clock::time_point time;
+};
+
+// Reads the keyboard on its own thread so no key waits for a game tick
+class InputReader
+{
+private:
+    SpscRing<KeyEvent, 256> queue;
+    atomic<bool> running{false};
+    thread worker;
+#ifndef _WIN32
+    struct termios savedTerminal;
+#endif
+
+    void push(int key, chrono::steady_clock::time_point time)
+    {
+        // Never drop a key: if the game falls 256 keys behind, wait for it
+        while (!queue.push({key, time}) && running)
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+#ifndef _WIN32
+    // One byte from stdin, or -1 if none arrives within timeoutMs
+    static int readByte(int timeoutMs)
+    {
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        unsigned char ch;
+        if (::poll(&pfd, 1, timeoutMs) <= 0 || read(STDIN_FILENO, &ch, 1) != 1)
+            return -1;
+        return ch;
+    }
+#endif
+
+    void readLoop()
+    {
+        while (running)
         {
-            cout << tetrisArt[i] << endl;
 #ifdef _WIN32
-            Sleep(300);
+            if (!_kbhit())
+            {
+                Sleep(1);
+                continue;
+            }
+            push(getch(), chrono::steady_clock::now());
 #else
-            usleep(300000);
+            int ch = readByte(10);
+            if (ch < 0)
+                continue;
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (ch == 27)
+            {
+                // Arrow keys arrive as ESC [ A..D; a lone ESC is the quit key
+                int c1 = readByte(20);
+                if (c1 == '[')
+                {
+                    int c2 = readByte(20);
+                    switch (c2)
+                    {
+                    case 'A':
+                        ch = 72;
+                        break; // Up arrow → 72
+                    case 'B':
+                        ch = 80;
+                        break; // Down arrow → 80
+                    case 'C':
+                        ch = 77;
+                        break; // Right arrow → 77
+                    case 'D':
+                        ch = 75;
+                        break; // Left arrow → 75
+                    default:
+                        ch = c2;
+                        break;
+                    }
+                }
+                else if (c1 >= 0)
+                {
+                    push(27, now);
+                    ch = c1;
+                }
+            }
+            push(ch, now);
 #endif
         }
+    }
 
-        cout << "\033[0m" << "\n\nStarting game in 3...";
-        cout.flush();
-#ifdef _WIN32
-        Sleep(300);
-#else
-        usleep(300000);
-#endif
-        cout << "2...";
-        cout.flush();
-#ifdef _WIN32
-        Sleep(500);
-#else
-        usleep(300000);
+public:
+    void start()
+    {
+#ifndef _WIN32
+        // Disable canonical mode and echo for the whole game instead of per key
+        tcgetattr(STDIN_FILENO, &savedTerminal);
+        struct termios raw = savedTerminal;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
 #endif
-        cout << "1...";
-        cout.flush();
-#ifdef _WIN32
-        Sleep(500);
-#else
-        usleep(300000);
+        running = true;
+        worker = thread(&InputReader::readLoop, this);
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+#ifndef _WIN32
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTerminal);
 #endif
+    }
+
+    bool poll(KeyEvent &event) { return queue.pop(event); }
+};
 
-        system("cls");
+// DAS/ARR timings in milliseconds (--das, --arr, --hold-gap)
+struct InputTiming
+{
+    int das = 170;     // hold this long before auto shift starts
+    int arr = 50;      // then shift once per arr ms (0 = straight to the wall)
+    int holdGap = 80;  // terminals send no key-up: a key counts as held
+                       // while its repeats arrive at most this far apart
+};
+
+InputTiming inputTiming;
+
+// Auto shift for one held key, applied at tick resolution
+class AutoRepeat
+{
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    // Returns true if the event should act like a tap. Once DAS has charged,
+    // the terminal's own repeats only keep the hold alive and due() shifts.
+    bool onEvent(Stamp time)
+    {
+        bool continuing = held && time - lastEvent <= chrono::milliseconds(inputTiming.holdGap);
+        lastEvent = time;
+        if (!continuing)
+        {
+            held = true;
+            nextShift = time + chrono::milliseconds(inputTiming.das);
+            return true;
+        }
+        return time < nextShift && !charged;
     }
 
-    void drawPauseScreen()
+    // Number of automatic shifts due by `now` (INT_MAX with ARR 0)
+    int due(Stamp now)
     {
-        // Clear screen and draw pause message
-        cout << "\033[2J\033[H";
-        cout << "\033[44m" << "\033[37m" << "\033[1m" << "\n\n\n\n";
-        cout << "         ██████╗  █████╗ ██╗   ██╗███████╗███████╗       \n";
-        cout << "         ██╔══██╗██╔══██╗██║   ██║██╔════╝██╔════╝       \n";
-        cout << "         ██████╔╝███████║██║   ██║███████╗█████╗         \n";
-        cout << "         ██╔═══╝ ██╔══██║██║   ██║╚════██║██╔══╝         \n";
-        cout << "         ██║     ██║  ██║╚██████╔╝███████║███████╗       \n";
-        cout << "         ╚═╝     ╚═╝  ╚═╝ ╚═════╝ ╚══════╝╚══════╝       \n";
-        cout << "\033[0m" << "\n\n";
-        cout << "\033[43m" << "\033[30m" << "           Press P to continue           " << "\033[0m" << "\n";
-        while (paused)
+        if (!held)
+            return 0;
+        if (now - lastEvent > chrono::milliseconds(inputTiming.holdGap))
         {
-            handleInput();
+            held = charged = false;
+            return 0;
         }
+        if (now < nextShift)
+            return 0;
+        charged = true;
+        if (inputTiming.arr <= 0)
+            return INT_MAX;
+        chrono::milliseconds arr(inputTiming.arr);
+        int shifts = 1 + (int)((now - nextShift) / arr);
+        nextShift += shifts * arr;
+        return shifts;
+    }
 
-        cout.flush();
+private:
+    bool held = false;
+    bool charged = false;
+    Stamp lastEvent;
+    Stamp nextShift;
+};
 
-#ifdef _WIN32
-        system("cls");
-#else
-        system("clear");
-#endif
-    }
+// The game loop runs at a fixed rate; speed comes from gravity, not the tick
+const int TICK_MS = 10;
 
-    int drawGameOverScreen()
-    {
-        highscore = max(score, highscore);
-        clearScreen();
-        cout << "\033[41m" << "\033[37m" << "\033[1m" << "\n\n\n\n";
-        cout << "          ██████╗  █████╗ ███╗   ███╗███████╗     \n";
-        cout << "         ██╔════╝ ██╔══██╗████╗ ████║██╔════╝     \n";
-        cout << "         ██║  ███╗███████║██╔████╔██║█████╗       \n";
-        cout << "         ██║   ██║██╔══██║██║╚██╔╝██║██╔══╝       \n";
-        cout << "         ╚██████╔╝██║  ██║██║ ╚═╝ ██║███████╗     \n";
-        cout << "          ╚═════╝ ╚═╝  ╚═╝╚═╝     ╚═╝╚══════╝     \n";
-        cout << "          ██████╗ ██╗   ██╗███████╗██████╗        \n";
-        cout << "         ██╔═══██╗██║   ██║██╔════╝██╔══██╗       \n";
-        cout << "         ██║   ██║██║   ██║█████╗  ██████╔╝       \n";
-        cout << "         ██║   ██║╚██╗ ██╔╝██╔══╝  ██╔══██╗       \n";
-        cout << "         ╚██████╔╝ ╚████╔╝ ███████╗██║  ██║       \n";
-        cout << "          ╚═════╝   ╚═══╝  ╚══════╝╚═╝  ╚═╝       \n";
-        cout << "\033[0m" << "\n\n";
-        cout << "\033[42m" << "\033[30m" << "           Your Score: " << score << "           " << "\033[0m" << "\n";
-        cout << "\033[44m" << "\033[37m" << "        High Score: " << highscore << "        " << "\033[0m" << "\n\n";
-        cout << "\033[43m" << "\033[30m" << "     Press R to restart or X to exit     " << "\033[0m" << "\n";
-        cout.flush();
+// Gravity is rows per tick in 16.16 fixed point, so a crawl and several
+// rows per tick are the same arithmetic. 1G is one row per 1/60 s frame;
+// 20G and up drops straight to the landing row.
+const int32_t GRAVITY_ONE = 1 << 16;
+const int32_t GRAVITY_INSTANT = 64 * GRAVITY_ONE; // more rows than any board
+const double G_ROWS_PER_MS = 60.0 / 1000.0;
 
-        cout << "Press 'R' to Restart\n(NOTE:Any other keys terminates the game: )" << endl;
+// Gravity and lock delay (--gravity, --lock-delay, --lock-resets)
+struct GravityTiming
+{
+    double g = 0;        // fixed gravity in G; 0 follows the level
+    int lockDelay = 500; // ms a grounded piece rests before it locks
+    int lockResets = 15; // moves per piece that restart the lock delay
+};
 
-        char rest;
-        cin >> rest;
+GravityTiming gravityTiming;
 
-        if (rest == 'R' || rest == 'r')
-            return 1;
+int32_t gravityStep(double rowsPerMs)
+{
+    if (rowsPerMs >= 20 * G_ROWS_PER_MS)
+        return GRAVITY_INSTANT;
+    return max<int32_t>(1, (int32_t)(rowsPerMs * TICK_MS * GRAVITY_ONE));
+}
 
-        // Show cursor again
-        cout << "\033[?25h";
-        return 0;
+// Lock delay on the wall clock, so it lasts the same at any tick rate
+class LockDelay
+{
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    // True once the piece has rested on the stack for the whole delay
+    bool expired(bool onGround, Stamp now)
+    {
+        if (!onGround)
+        {
+            grounded = false;
+            return false;
+        }
+        if (!grounded)
+        {
+            grounded = true;
+            since = now;
+        }
+        return now - since >= chrono::milliseconds(gravityTiming.lockDelay);
+    }
+
+    // A move or rotation on the ground restarts the delay, a limited number of times
+    void moved(Stamp now)
+    {
+        if (grounded && resets < gravityTiming.lockResets)
+        {
+            resets++;
+            since = now;
+        }
+    }
+
+    // New piece, or the clock stopped (pause, resume)
+    void reset(bool newPiece)
+    {
+        grounded = false;
+        if (newPiece)
+            resets = 0;
+    }
+
+private:
+    bool grounded = false;
+    int resets = 0;
+    Stamp since;
+};
+
+/**************************************************************
+ * 3) Basic definitions for Tetris
+ **************************************************************/
+const int BOARD_WIDTH = 10;  // You can adjust as you like
+const int BOARD_HEIGHT = 20; // You can adjust as you like
+// Packed board format (saves, oracle requests): cells in row-major order,
+// two 4-bit color indices per byte, even cell in the low nibble
+const int PACKED_BOARD_BYTES = (BOARD_WIDTH * BOARD_HEIGHT + 1) / 2;
+
+// 7 standard Tetromino shapes (4x4)
+static const vector<vector<vector<int>>> TETROMINO_SHAPES = {
+    // I
+    {
+        {0, 0, 0, 0},
+        {1, 1, 1, 1},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}},
+    // O
+    {
+        {1, 1, 0, 0},
+        {1, 1, 0, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}},
+    // T
+    {
+        {0, 1, 0, 0},
+        {1, 1, 1, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}},
+    // S
+    {
+        {0, 1, 1, 0},
+        {1, 1, 0, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}},
+    // Z
+    {
+        {1, 1, 0, 0},
+        {0, 1, 1, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}},
+    // J
+    {
+        {1, 0, 0, 0},
+        {1, 1, 1, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}},
+    // L
+    {
+        {0, 0, 1, 0},
+        {1, 1, 1, 0},
+        {0, 0, 0, 0},
+        {0, 0, 0, 0}}};
+
+/**************************************************************
+ * 4) Tetromino Base Class
+ **************************************************************/
+class Tetromino
+{
+protected:
+    vector<vector<int>> shape; // 4x4
+    int colorIndex;            // for distinct color
+    int rotation;              // quarter turns from the spawn shape
+
+public:
+    Tetromino(const vector<vector<int>> &shp, int color)
+        : shape(shp), colorIndex(color), rotation(0) {}
+    virtual ~Tetromino() {}
+
+    virtual void rotateCW()
+    {
+        // Rotate shape 90 degrees clockwise
+        vector<vector<int>> rotated(4, vector<int>(4, 0));
+        for (int r = 0; r < 4; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                rotated[c][4 - 1 - r] = shape[r][c];
+            }
+        }
+        shape = rotated;
+        rotation = (rotation + 1) % 4;
+    }
+
+    // Accessors
+    const vector<vector<int>> &getShape() const { return shape; }
+    int getColorIndex() const { return colorIndex; }
+    int getType() const { return colorIndex - 1; } // index for createTetromino
+    int getRotation() const { return rotation; }
+};
+
+// Concrete Tetromino Classes (for demonstration)(shape, colorIndex)
+class TetrominoI : public Tetromino
+{
+public:
+    TetrominoI() : Tetromino(TETROMINO_SHAPES[0], 1) {}
+};
+class TetrominoO : public Tetromino
+{
+public:
+    TetrominoO() : Tetromino(TETROMINO_SHAPES[1], 2) {}
+};
+class TetrominoT : public Tetromino
+{
+public:
+    TetrominoT() : Tetromino(TETROMINO_SHAPES[2], 3) {}
+};
+class TetrominoS : public Tetromino
+{
+public:
+    TetrominoS() : Tetromino(TETROMINO_SHAPES[3], 4) {}
+};
+class TetrominoZ : public Tetromino
+{
+public:
+    TetrominoZ() : Tetromino(TETROMINO_SHAPES[4], 5) {}
+};
+class TetrominoJ : public Tetromino
+{
+public:
+    TetrominoJ() : Tetromino(TETROMINO_SHAPES[5], 6) {}
+};
+class TetrominoL : public Tetromino
+{
+public:
+    TetrominoL() : Tetromino(TETROMINO_SHAPES[6], 7) {}
+};
+
+// Factory: piece type in [0..6] follows TETROMINO_SHAPES order (I, O, T, S, Z, J, L)
+Tetromino *createTetromino(int type)
+{
+    switch (type)
+    {
+    case 0:
+        return new TetrominoI();
+    case 1:
+        return new TetrominoO();
+    case 2:
+        return new TetrominoT();
+    case 3:
+        return new TetrominoS();
+    case 4:
+        return new TetrominoZ();
+    case 5:
+        return new TetrominoJ();
+    case 6:
+        return new TetrominoL();
+    }
+    // fallback
+    return new TetrominoI();
+}
+
+// Piece randomizer (xorshift64*). Unlike rand(), its whole state is one
+// number, so a saved game resumes with the same upcoming pieces.
+class PieceRandom
+{
+private:
+    uint64_t state;
+
+public:
+    explicit PieceRandom(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    int nextType()
+    {
+        return (int)((next() >> 33) % 7);
+    }
+
+    uint64_t getState() const { return state; }
+    void setState(uint64_t s) { state = s ? s : 0x9E3779B97F4A7C15ull; }
+};
+
+/**************************************************************
+ * 5) Board Class: Encapsulates the 2D grid
+ **************************************************************/
+
+// Deepest perft or search the transposition tables can key; runPerft
+// rejects deeper counts
+const int MAX_SEARCH_DEPTH = 31;
+
+// Random keys for Zobrist hashing. A board's hash is the XOR of the keys
+// of its filled cells (occupancy only: colors never change what can be
+// placed), so filling or emptying one cell is one XOR.
+struct ZobristKeys
+{
+    uint64_t cell[BOARD_HEIGHT][BOARD_WIDTH];
+    uint64_t piece[7];
+    uint64_t next[8];                     // [7]: no next piece
+    uint64_t depth[MAX_SEARCH_DEPTH + 1]; // remaining search depth / perft ply
+    uint64_t ply[32];                     // pieces already placed by the perfect-clear search
+
+    ZobristKeys()
+    {
+        uint64_t state = 0x5EED5EED5EED5EEDull; // fixed, so hashes are stable between runs
+        auto splitmix = [&state]
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        };
+        for (int r = 0; r < BOARD_HEIGHT; r++)
+            for (int c = 0; c < BOARD_WIDTH; c++)
+                cell[r][c] = splitmix();
+        for (uint64_t &k : piece)
+            k = splitmix();
+        for (uint64_t &k : next)
+            k = splitmix();
+        for (uint64_t &k : depth)
+            k = splitmix();
+        for (uint64_t &k : ply)
+            k = splitmix();
+    }
+};
+const ZobristKeys ZOBRIST;
+
+// Shape of the stack, for the statistics panel, analytics and bots. The
+// board keeps these up to date as pieces lock and lines clear.
+struct BoardMetrics
+{
+    uint32_t pieces[7];            // pieces placed so far, by type (PIECE_LETTERS order)
+    uint8_t heights[BOARD_WIDTH];  // column heights counted from the floor
+    int aggregateHeight;           // sum of heights
+    int holes;                     // empty cells under the top of their column
+    int covered;                   // filled cells above the lowest hole of their column
+    int bumpiness;                 // sum of height differences between neighbours
+    int maxWell;                   // deepest column below both neighbours (a wall matches the other side)
+};
+
+class Board
+{
+private:
+    // board[r][c] = 0 if empty, else color index. Fixed size, so copying
+    // a Board (search, rollouts) never touches the heap.
+    uint8_t board[BOARD_HEIGHT][BOARD_WIDTH];
+    uint64_t hash; // Zobrist hash of the filled cells, kept up to date
+
+    // Per-column parts of the metrics. A lock rescans only the (at most
+    // four) columns it touched, a clear only the columns with holes, and
+    // the totals are summed from these in one pass over the columns.
+    BoardMetrics stats;
+    uint8_t columnHoles[BOARD_WIDTH];
+    uint8_t columnCovered[BOARD_WIDTH];
+
+    // Height, holes and covered cells of column c, from its cells
+    void scanColumn(int c, uint8_t &height, uint8_t &holes, uint8_t &covered) const
+    {
+        height = holes = covered = 0;
+        int filled = 0;
+        for (int r = 0; r < BOARD_HEIGHT; r++)
+        {
+            if (board[r][c] != 0)
+            {
+                if (height == 0)
+                    height = (uint8_t)(BOARD_HEIGHT - r);
+                filled++;
+            }
+            else if (height != 0)
+            {
+                holes++;
+                covered = (uint8_t)filled; // everything above this hole
+            }
+        }
+    }
+
+    static void sumColumns(BoardMetrics &m, const uint8_t *holes, const uint8_t *covered)
+    {
+        m.aggregateHeight = m.holes = m.covered = m.bumpiness = m.maxWell = 0;
+        for (int c = 0; c < BOARD_WIDTH; c++)
+        {
+            int left = c > 0 ? m.heights[c - 1] : INT_MAX;
+            int right = c + 1 < BOARD_WIDTH ? m.heights[c + 1] : INT_MAX;
+            m.aggregateHeight += m.heights[c];
+            m.holes += holes[c];
+            m.covered += covered[c];
+            if (c > 0)
+                m.bumpiness += abs(m.heights[c] - left);
+            m.maxWell = max(m.maxWell, min(left, right) - m.heights[c]);
+        }
+    }
+
+    void rescanColumn(int c)
+    {
+        scanColumn(c, stats.heights[c], columnHoles[c], columnCovered[c]);
+    }
+
+    // XOR of the keys of the filled cells in rows [0, lastRow]
+    uint64_t rowsHash(int lastRow) const
+    {
+        uint64_t h = 0;
+        for (int r = 0; r <= lastRow; r++)
+            for (int c = 0; c < BOARD_WIDTH; c++)
+                if (board[r][c] != 0)
+                    h ^= ZOBRIST.cell[r][c];
+        return h;
+    }
+
+public:
+    Board() : hash(0)
+    {
+        memset(board, 0, sizeof(board));
+        memset(&stats, 0, sizeof(stats));
+        memset(columnHoles, 0, sizeof(columnHoles));
+        memset(columnCovered, 0, sizeof(columnCovered));
+    }
+
+    bool canPlace(const Tetromino &t, int row, int col) const
+    {
+        const auto &shape = t.getShape(); // 2d matrix for perticular shape
+        for (int r = 0; r < 4; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                if (shape[r][c] != 0)
+                {
+                    int br = row + r;
+                    int bc = col + c;
+                    // Out of bounds?
+                    if (br < 0 || br >= BOARD_HEIGHT || bc < 0 || bc >= BOARD_WIDTH)
+                    {
+                        return false;
+                    }
+                    // Collision with existing block?
+                    if (board[br][bc] != 0)
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Rows the piece can still fall from (row, col), taken straight from the
+    // free run under the lowest mino of each of its columns. (row, col) must
+    // be a legal placement.
+    int dropDistance(const Tetromino &t, int row, int col) const
+    {
+        const auto &shape = t.getShape();
+        int distance = BOARD_HEIGHT;
+        for (int c = 0; c < 4; c++)
+        {
+            int bottom = -1;
+            for (int r = 0; r < 4; r++)
+            {
+                if (shape[r][c] != 0)
+                    bottom = r;
+            }
+            if (bottom < 0)
+                continue;
+            int br = row + bottom + 1;
+            int gap = 0;
+            while (br + gap < BOARD_HEIGHT && board[br + gap][col + c] == 0)
+                gap++;
+            distance = min(distance, gap);
+        }
+        return distance;
+    }
+
+    void place(const Tetromino &t, int row, int col)
+    {
+        const auto &shape = t.getShape();
+        int color = t.getColorIndex();
+        bool touched[4] = {false, false, false, false};
+        for (int r = 0; r < 4; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                if (shape[r][c] != 0)
+                {
+                    int br = row + r;
+                    int bc = col + c;
+                    if (board[br][bc] == 0)
+                        hash ^= ZOBRIST.cell[br][bc];
+                    board[br][bc] = (uint8_t)color;
+                    touched[c] = true;
+                }
+            }
+        }
+
+        if (t.getType() >= 0 && t.getType() < 7)
+            stats.pieces[t.getType()]++;
+        for (int c = 0; c < 4; c++)
+        {
+            if (touched[c])
+                rescanColumn(col + c);
+        }
+        sumColumns(stats, columnHoles, columnCovered);
+    }
+
+    // Clear full lines and return how many lines cleared
+    int clearLines()
+    {
+        int linesCleared = 0;
+        for (int r = 0; r < BOARD_HEIGHT; r++)
+        {
+            bool full = true;
+            for (int c = 0; c < BOARD_WIDTH; c++)
+            {
+                if (board[r][c] == 0)
+                {
+                    full = false;
+                    break;
+                }
+            }
+            if (full)
+            {
+                // Only rows 0..r move, so only their part of the hash changes
+                hash ^= rowsHash(r);
+                // Shift everything down
+                memmove(board[1], board[0], r * sizeof(board[0]));
+                // Clear top row
+                memset(board[0], 0, sizeof(board[0]));
+                hash ^= rowsHash(r);
+                linesCleared++;
+            }
+        }
+
+        if (linesCleared > 0)
+        {
+            // A column without holes is solid from the floor, so every
+            // cleared row took one of its cells and nothing else changed
+            for (int c = 0; c < BOARD_WIDTH; c++)
+            {
+                if (columnHoles[c] == 0)
+                    stats.heights[c] = (uint8_t)(stats.heights[c] - linesCleared);
+                else
+                    rescanColumn(c);
+            }
+            sumColumns(stats, columnHoles, columnCovered);
+        }
+        return linesCleared;
+    }
+
+    bool isGameOver() const
+    {
+        // If top row is non-zero, game is over
+        for (int c = 0; c < BOARD_WIDTH; c++)
+        {
+            if (board[0][c] != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Accessor to read a specific cell (for drawing)
+    int getCell(int r, int c) const
+    {
+        return board[r][c];
+    }
+
+    // Row-major cells, BOARD_WIDTH to a row, for read-only views (bots)
+    const uint8_t *cellData() const { return &board[0][0]; }
+
+    // Mutator used when loading a board from a text fixture
+    void setCell(int r, int c, int val)
+    {
+        if ((board[r][c] != 0) != (val != 0))
+            hash ^= ZOBRIST.cell[r][c];
+        board[r][c] = (uint8_t)val;
+        rescanColumn(c);
+        sumColumns(stats, columnHoles, columnCovered);
+    }
+
+    uint64_t getHash() const { return hash; }
+
+    // Recomputes the hash from scratch (for checking the incremental one)
+    uint64_t computeHash() const { return rowsHash(BOARD_HEIGHT - 1); }
+
+    const BoardMetrics &metrics() const { return stats; }
+
+    // Recomputes the metrics from the cells (for checking the incremental
+    // ones); piece counts can't be seen in the cells, so they are copied
+    BoardMetrics computeMetrics() const
+    {
+        BoardMetrics m = stats;
+        uint8_t holes[BOARD_WIDTH], covered[BOARD_WIDTH];
+        for (int c = 0; c < BOARD_WIDTH; c++)
+            scanColumn(c, m.heights[c], holes[c], covered[c]);
+        sumColumns(m, holes, covered);
+        return m;
+    }
+
+    // Piece counts of a resumed game (a loaded board starts at zero)
+    void setPieceCounts(const uint32_t *counts)
+    {
+        memcpy(stats.pieces, counts, sizeof(stats.pieces));
+    }
+
+    // Writes the board in the packed format (PACKED_BOARD_BYTES bytes)
+    void pack(uint8_t *out) const
+    {
+        memset(out, 0, PACKED_BOARD_BYTES);
+        for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+        {
+            int cell = board[i / BOARD_WIDTH][i % BOARD_WIDTH] & 0x0F;
+            out[i / 2] |= (uint8_t)(i % 2 ? cell << 4 : cell);
+        }
+    }
+
+    // Reads a packed board; false (board unchanged) if a cell exceeds maxColor
+    bool unpack(const uint8_t *in, int maxColor)
+    {
+        for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+            if (((in[i / 2] >> (i % 2 ? 4 : 0)) & 0x0F) > maxColor)
+                return false;
+        for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+            board[i / BOARD_WIDTH][i % BOARD_WIDTH] = (uint8_t)((in[i / 2] >> (i % 2 ? 4 : 0)) & 0x0F);
+        hash = computeHash();
+        for (int c = 0; c < BOARD_WIDTH; c++)
+            rescanColumn(c);
+        sumColumns(stats, columnHoles, columnCovered);
+        return true;
+    }
+};
+
+/**************************************************************
+ * 5b) FrameSnapshot: everything the renderer needs for one frame
+ *     Written by the simulation thread, read by the render thread
+ *     through a TripleBuffer, so it holds plain values only.
+ **************************************************************/
+struct FrameSnapshot
+{
+    uint8_t cells[BOARD_HEIGHT][BOARD_WIDTH]; // board with current piece overlaid
+    uint8_t next[4][4];                       // next piece preview (color index or 0)
+    int level;
+    int lines;
+    int score;
+    bool paused;
+    bool hudVisible;
+    BoardMetrics metrics;         // of the locked cells, for the statistics panel
+    uint64_t tick;                // simulation tick this frame was taken at
+    FrameStats::Stamp inputStamp; // oldest key not yet shown on screen
+    uint64_t inputTick;           // tick at which that key was handled
+};
+
+/**************************************************************
+ * 5c) Save/resume snapshots
+ *     A fixed-layout binary record of the whole game, written in
+ *     one write() and loaded through mmap. Byte order is the
+ *     host's; the version field guards layout changes.
+ **************************************************************/
+const char SAVE_MAGIC[8] = {'T', 'E', 'T', 'R', 'I', 'S', 'F', 0};
+const uint32_t SAVE_VERSION = 2; // 2: piece counts
+const char *const SAVE_FILE = "tetris_final_save.bin";
+
+struct SaveGame
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t checksum; // FNV-1a of every byte after this field
+    uint64_t rngState;
+    int32_t score;
+    int32_t level;
+    int32_t lines;
+    int16_t currentRow, currentCol;
+    uint8_t currentType, currentRotation, nextType, reserved;
+    uint8_t cells[PACKED_BOARD_BYTES];
+    uint32_t pieceCounts[7];    // BoardMetrics::pieces
+    uint32_t journalGeneration; // journal that continues this save, 0 = none
+};
+static_assert(sizeof(SaveGame) == 176, "SaveGame layout changed: bump SAVE_VERSION");
+
+uint32_t saveChecksum(const SaveGame &save)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&save) + offsetof(SaveGame, rngState);
+    const uint8_t *end = reinterpret_cast<const uint8_t *>(&save) + sizeof(SaveGame);
+    uint32_t hash = 2166136261u;
+    for (; p < end; p++)
+        hash = (hash ^ *p) * 16777619u;
+    return hash;
+}
+
+// Writes to a temporary file and renames it, so a crash never leaves half a
+// save. Nothing waits for the disk here; syncSaveFile() does that where the
+// order of writes matters.
+bool writeSaveFile(const string &path, const SaveGame &save)
+{
+    string tmp = path + ".tmp";
+#ifdef _WIN32
+    ofstream file(tmp, ios::binary | ios::trunc);
+    if (!file.write(reinterpret_cast<const char *>(&save), sizeof(save)))
+        return false;
+    file.close();
+    remove(path.c_str());
+#else
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = write(fd, &save, sizeof(save)) == (ssize_t)sizeof(save);
+    close(fd);
+    if (!ok)
+        return false;
+#endif
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Waits until a save written by writeSaveFile() is on disk, rename included.
+// Milliseconds, so only the journal's writer thread (before a checkpoint's
+// journal may exist) and quitting (before the journal is removed) call it.
+bool syncSaveFile(const string &path)
+{
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    // The rename itself is only durable once the directory is synced
+    size_t slash = path.rfind('/');
+    int dir = open(slash == string::npos ? "." : path.substr(0, slash + 1).c_str(), O_RDONLY);
+    if (dir >= 0)
+    {
+        ok = fsync(dir) == 0 && ok;
+        close(dir);
+    }
+    return ok;
+#endif
+}
+
+// Maps the file read-only and checks magic, version, size and checksum
+// before copying it out. Field ranges are checked by the caller.
+bool readSaveFile(const string &path, SaveGame &save)
+{
+#ifdef _WIN32
+    ifstream file(path, ios::binary);
+    if (!file.read(reinterpret_cast<char *>(&save), sizeof(save)) || file.peek() != EOF)
+        return false;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(SaveGame))
+    {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, sizeof(SaveGame), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    memcpy(&save, map, sizeof(save));
+    munmap(map, sizeof(SaveGame));
+#endif
+    return memcmp(save.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) == 0 &&
+           save.version == SAVE_VERSION && save.checksum == saveChecksum(save);
+}
+
+/**************************************************************
+ * 5d) Journal: crash-safe autosave between checkpoints
+ *     Every piece lock and every input that moves the falling
+ *     piece is appended to a journal as an 8-byte record. A
+ *     background thread writes the records and fsyncs them in
+ *     groups (every --journal-sync-ms or --journal-sync-records,
+ *     whichever comes first), so the game loop only pushes into
+ *     a ring and never waits on the disk.
+ *
+ *     Every --checkpoint-locks locks the game state is written
+ *     out as a regular save (the checkpoint) and the journal
+ *     starts over. The save names the journal generation that
+ *     continues it, so after a crash the game loads the save and
+ *     replays the journal on top; a journal left over from an
+ *     older checkpoint has the wrong generation and is ignored.
+ *     A torn record at the end fails its check and ends replay.
+ **************************************************************/
+const char JOURNAL_MAGIC[8] = {'T', 'E', 'T', 'R', 'I', 'S', 'J', 0};
+const uint32_t JOURNAL_VERSION = 1;
+const char *const JOURNAL_FILE = "tetris_final_journal.bin";
+
+enum JournalKind : uint8_t
+{
+    JOURNAL_LOCK = 1,      // the piece locked at this pose
+    JOURNAL_MOVE = 2,      // input moved the falling piece to this pose
+    JOURNAL_CHECKPOINT = 3 // in the ring only: write a checkpoint here
+};
+
+struct JournalHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t generation; // matches SaveGame::journalGeneration of its checkpoint
+};
+
+struct JournalRecord
+{
+    uint8_t kind;
+    uint8_t piece; // type | rotation << 3
+    int8_t row, col;
+    uint32_t check; // FNV-1a of the above, the generation and the record's index
+};
+static_assert(sizeof(JournalRecord) == 8, "JournalRecord is part of the file format");
+
+uint32_t journalCheck(const JournalRecord &record, uint32_t generation, uint32_t index)
+{
+    uint8_t bytes[12] = {record.kind, record.piece, (uint8_t)record.row, (uint8_t)record.col};
+    memcpy(bytes + 4, &generation, 4);
+    memcpy(bytes + 8, &index, 4);
+    uint32_t hash = 2166136261u;
+    for (uint8_t b : bytes)
+        hash = (hash ^ b) * 16777619u;
+    return hash;
+}
+
+// Group commit and checkpoint cadence (--journal-sync-ms, --journal-sync-records,
+// --checkpoint-locks, --no-journal)
+struct JournalTiming
+{
+    bool enabled = true;
+    int syncMs = 50;           // fsync at most this long after a record is written
+    int syncRecords = 64;      // or as soon as this many are waiting
+    int checkpointLocks = 200; // locks between checkpoints (0 = only at start)
+};
+
+JournalTiming journalTiming;
+
+inline bool syncFile(FILE *file)
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+class GameJournal
+{
+private:
+    // Records go through one ring, 8 bytes each. The state to checkpoint
+    // goes through a small ring of its own, and a JOURNAL_CHECKPOINT record
+    // marks where in the records it belongs.
+    SpscRing<JournalRecord, 1024> records;
+    SpscRing<SaveGame, 4> snapshots;
+    atomic<bool> running{false};
+    thread worker;
+    string savePath, journalPath;
+    bool resync = false; // game side: a record was dropped, checkpoint before the next one
+
+    // Writer thread only
+    FILE *file = nullptr;
+    uint32_t generation = 0;
+    uint32_t index = 0;
+    atomic<uint64_t> written{0}, syncs{0}, checkpoints{0}, failures{0};
+
+    void push(const JournalRecord &record)
+    {
+        if (resync || !records.push(record))
+            resync = true;
+    }
+
+    // Save first, then the new journal: a crash in between leaves a save
+    // whose journal doesn't exist yet, never a journal without its save
+    void writeCheckpoint(SaveGame &save)
+    {
+        if (file)
+        {
+            syncFile(file);
+            fclose(file);
+            file = nullptr;
+        }
+        if (++generation == 0)
+            generation = 1;
+        save.journalGeneration = generation;
+        save.checksum = saveChecksum(save);
+        index = 0;
+        if (!writeSaveFile(savePath, save) || !syncSaveFile(savePath))
+        {
+            failures++;
+            return;
+        }
+        checkpoints++;
+        file = fopen(journalPath.c_str(), "wb");
+        JournalHeader header;
+        memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header.version = JOURNAL_VERSION;
+        header.generation = generation;
+        if (file && (fwrite(&header, sizeof(header), 1, file) != 1 || !syncFile(file)))
+        {
+            fclose(file);
+            file = nullptr;
+        }
+        if (!file)
+            failures++;
+    }
+
+    void writeLoop()
+    {
+        JournalRecord batch[64];
+        int unsynced = 0;
+        chrono::steady_clock::time_point oldestUnsynced;
+        while (true)
+        {
+            bool stopping = !running; // read first so nothing pushed before stop() is missed
+            JournalRecord record;
+            int count = 0;
+            bool idle = true;
+            while (count < 64 && records.pop(record))
+            {
+                idle = false;
+                if (record.kind == JOURNAL_CHECKPOINT)
+                {
+                    if (file && count > 0 && fwrite(batch, sizeof(JournalRecord), count, file) == (size_t)count)
+                        written += count;
+                    count = unsynced = 0;
+                    SaveGame save;
+                    if (snapshots.pop(save)) // pushed before its record, so always there
+                        writeCheckpoint(save);
+                    continue;
+                }
+                record.check = journalCheck(record, generation, index++);
+                batch[count++] = record;
+            }
+
+            if (file && count > 0)
+            {
+                if (fwrite(batch, sizeof(JournalRecord), count, file) != (size_t)count || fflush(file) != 0)
+                    failures++;
+                if (unsynced == 0)
+                    oldestUnsynced = chrono::steady_clock::now();
+                unsynced += count;
+                written += count;
+            }
+            if (file && unsynced > 0 &&
+                (stopping || unsynced >= journalTiming.syncRecords ||
+                 chrono::steady_clock::now() - oldestUnsynced >= chrono::milliseconds(journalTiming.syncMs)))
+            {
+                if (!syncFile(file))
+                    failures++;
+                syncs++;
+                unsynced = 0;
+            }
+            if (stopping && idle)
+                break;
+            if (idle)
+                this_thread::sleep_for(chrono::milliseconds(2));
+        }
+        if (file)
+        {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+public:
+    ~GameJournal() { stop(); }
+
+    // Writes `initial` as the first checkpoint, then journals from there on.
+    // Generations count up from `lastGeneration`.
+    void start(const string &save, const string &journal, const SaveGame &initial, uint32_t lastGeneration)
+    {
+        savePath = save;
+        journalPath = journal;
+        generation = lastGeneration;
+        resync = false;
+        running = true;
+        worker = thread(&GameJournal::writeLoop, this);
+        checkpoint(initial);
+    }
+
+    // Writes what is queued, fsyncs it and ends the thread
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+    }
+
+    bool isRunning() const { return running; }
+
+    // Game thread: never blocks. A full ring drops the record and asks for a
+    // checkpoint instead (see needsCheckpoint()).
+    void record(JournalKind kind, int type, int rotation, int row, int col)
+    {
+        if (!running)
+            return;
+        JournalRecord record;
+        record.kind = kind;
+        record.piece = (uint8_t)(type | rotation << 3);
+        record.row = (int8_t)row;
+        record.col = (int8_t)col;
+        record.check = 0;
+        push(record);
+    }
+
+    void checkpoint(const SaveGame &save)
+    {
+        if (!running)
+            return;
+        // The snapshot goes first, so the writer finds it when it reaches
+        // the record, and only if the record is sure to follow. Otherwise
+        // the writer is behind: try again next tick.
+        resync = !records.canPush() || !snapshots.push(save);
+        if (resync)
+            return;
+        JournalRecord record;
+        memset(&record, 0, sizeof(record));
+        record.kind = JOURNAL_CHECKPOINT;
+        records.push(record);
+    }
+
+    bool needsCheckpoint() const { return running && resync; }
+
+    uint64_t recordsWritten() const { return written; }
+    uint64_t syncCount() const { return syncs; }
+    uint64_t checkpointCount() const { return checkpoints; }
+    uint64_t failureCount() const { return failures; }
+};
+
+// Reads the journal continuing checkpoint `generation`: every record up to
+// the first torn or foreign one. Empty if the journal belongs elsewhere.
+vector<JournalRecord> readJournal(const string &path, uint32_t generation)
+{
+    vector<JournalRecord> records;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return records;
+    JournalHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0 &&
+        header.version == JOURNAL_VERSION && header.generation == generation)
+    {
+        JournalRecord record;
+        while (fread(&record, sizeof(record), 1, file) == 1 &&
+               record.check == journalCheck(record, generation, (uint32_t)records.size()))
+            records.push_back(record);
+    }
+    fclose(file);
+    return records;
+}
+
+// Set by SIGTERM/SIGHUP/SIGINT: the game saves and exits at the end of the tick
+atomic<bool> quitRequested(false);
+
+void requestQuit(int)
+{
+    quitRequested = true;
+}
+
+/**************************************************************
+ * 5e) Autoplay (--autoplay): the oracle's search plays the game
+ *     Each piece goes where searchPlacement() puts it with the
+ *     next piece as lookahead. Searching when a piece appears
+ *     would stall the tick it spawns on, so while a piece falls
+ *     a background thread works out the answer for the piece
+ *     after it: for every place this one may land, and every
+ *     piece that may follow (the queue shows only one ahead).
+ *     The landing autoplay is heading for goes first, then the
+ *     others best first, so a key pressed meanwhile still tends
+ *     to land on a searched board. At the lock the answer is a
+ *     lookup; only a landing not reached yet is searched then.
+ **************************************************************/
+
+// A lock position: the piece turned rotateCW() `rotation` times from its
+// spawn shape, at (row, col)
+struct Placement
+{
+    int row, col, rotation;
+};
+
+// Defined with the search (sections 7 and 8)
+const Tetromino &pieceRotation(int type, int rotation);
+void enumerateLocks(const Board &board, int type, vector<Placement> &out);
+double evaluateBoard(const Board &board);
+double searchPlacement(const Board &board, const uint8_t *pieces, int depth,
+                       Placement *best, int *bestLines);
+uint64_t bookKey(const Board &board, int current, int next);
+
+// One key autoplay presses on its way to a placement, in enumerateLocks'
+// move order
+enum AutoplayMove
+{
+    AUTOPLAY_LEFT,
+    AUTOPLAY_RIGHT,
+    AUTOPLAY_DOWN,
+    AUTOPLAY_ROTATE,
+    AUTOPLAY_HARD_DROP
+};
+AutoplayMove nextAutoplayMove(const Board &board, int type, const Placement &here, const Placement &target);
+
+// --autoplay, --autoplay-speculate
+struct AutoplayOptions
+{
+    bool enabled = false;
+    bool speculate = true; // false searches each piece when it appears, for comparison
+};
+
+AutoplayOptions autoplayOptions;
+
+class SpeculativePlanner
+{
+private:
+    struct Job
+    {
+        Board board; // before the current piece locks
+        int current, next;
+        Placement planned;
+    };
+
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    Job job;
+    bool pending = false;
+    bool stopping = false;
+    atomic<uint64_t> generation{0}; // bumped by each post(); older work is dropped
+
+    // bookKey(board after the landing, next, following) -> placement of next;
+    // guarded by `lock`, holds the current generation only
+    unordered_map<uint64_t, Placement> answers;
+    uint64_t speculated = 0;
+
+    LatencyHistogram decisionNs; // game thread only
+    uint64_t ready = 0;
+
+    void post(const Board &board, int current, int next, const Placement &planned)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            generation++;
+            answers.clear();
+            job = {board, current, next, planned};
+            pending = true;
+        }
+        wake.notify_one();
+    }
+
+    void work()
+    {
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            wake.wait(guard, [this]
+                      { return stopping || pending; });
+            if (stopping)
+                return;
+            pending = false;
+            Job taken = job;
+            uint64_t mine = generation;
+            guard.unlock();
+            speculate(taken, mine);
+            guard.lock();
+        }
+    }
+
+    void speculate(const Job &taken, uint64_t mine)
+    {
+        vector<Placement> locks;
+        enumerateLocks(taken.board, taken.current, locks);
+        vector<pair<double, Board>> landings;
+        for (const Placement &p : locks)
+        {
+            Board child = taken.board;
+            child.place(pieceRotation(taken.current, p.rotation), p.row, p.col);
+            child.clearLines();
+            if (child.isGameOver())
+                continue;
+            bool planned = p.row == taken.planned.row && p.col == taken.planned.col &&
+                           p.rotation == taken.planned.rotation;
+            landings.push_back({planned ? HUGE_VAL : evaluateBoard(child), child});
+        }
+        stable_sort(landings.begin(), landings.end(), [](const pair<double, Board> &a, const pair<double, Board> &b)
+                    { return a.first > b.first; });
+
+        for (const pair<double, Board> &landing : landings)
+        {
+            for (int following = 0; following < 7; following++)
+            {
+                if (generation.load(memory_order_relaxed) != mine)
+                    return; // the piece locked: a new job is waiting
+                uint8_t pieces[2] = {(uint8_t)taken.next, (uint8_t)following};
+                Placement best = {0, 0, 0};
+                if (searchPlacement(landing.second, pieces, 2, &best, nullptr) == -HUGE_VAL)
+                    continue; // every line tops out: decide() falls back on its own
+                lock_guard<mutex> guard(lock);
+                if (generation != mine)
+                    return;
+                answers[bookKey(landing.second, taken.next, following)] = best;
+                speculated++;
+            }
+        }
+    }
+
+public:
+    ~SpeculativePlanner() { stop(); }
+
+    void start()
+    {
+        if (!worker.joinable())
+            worker = thread([this]
+                            { work(); });
+    }
+
+    void stop()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_one();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // Game thread, when a piece appears: where it goes. Then sets the thread
+    // on the piece after it, assuming this one goes there.
+    Placement decide(const Board &board, int current, int next)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Placement placement = {0, BOARD_WIDTH / 2 - 2, 0};
+        bool found = false;
+        {
+            lock_guard<mutex> guard(lock);
+            unordered_map<uint64_t, Placement>::const_iterator it = answers.find(bookKey(board, current, next));
+            if (it != answers.end())
+            {
+                placement = it->second;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            // Every line topping out leaves the spawn pose: the piece just drops
+            uint8_t pieces[2] = {(uint8_t)current, (uint8_t)next};
+            if (searchPlacement(board, pieces, 2, &placement, nullptr) == -HUGE_VAL)
+                placement = {0, BOARD_WIDTH / 2 - 2, 0};
+        }
+        decisionNs.record((uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        ready += found;
+        if (worker.joinable()) // started unless --autoplay-speculate 0
+            post(board, current, next, placement);
+        return placement;
+    }
+
+    // One line on stderr after the game, like writeBotReport(). Call after
+    // stop().
+    void writeReport() const
+    {
+        if (decisionNs.count() == 0)
+            return;
+        fprintf(stderr, "autoplay: %llu pieces, %.1f%% answered by speculation, decision p50 %.1f us, p99 %.1f us, "
+                        "max %.1f us, %llu positions speculated\n",
+                (unsigned long long)decisionNs.count(), 100.0 * ready / decisionNs.count(),
+                decisionNs.percentile(0.5) / 1000.0, decisionNs.percentile(0.99) / 1000.0, decisionNs.max() / 1000.0,
+                (unsigned long long)speculated);
+    }
+};
+
+SpeculativePlanner autoplayPlanner;
+
+/**************************************************************
+ * 6) Game Class: Manages game state, logic, user input, etc.
+ *     Includes pause functionality (toggle with 'p')
+ *     Now draws an interface resembling the screenshot
+ **************************************************************/
+class Game
+{
+private:
+    Board board;
+    Tetromino *currentPiece;
+    Tetromino *nextPiece;
+    int currentRow, currentCol;
+    bool gameOver;
+    bool paused; // pause toggle
+    int level;
+    int linesClearedTotal;
+    bool hudVisible;
+    bool quit;    // left with ESC or a signal rather than topping out
+    bool resumed; // loaded from a snapshot: skip the intro
+    PieceRandom rng;
+    int32_t gravityCarry; // fraction of a row gravity still owes (16.16)
+    LockDelay lockDelay;
+
+    // Simulation -> render thread hand-off
+    TripleBuffer<FrameSnapshot> frames;
+    atomic<bool> rendering;
+    atomic<uint64_t> presentedTick; // newest tick the renderer has flushed
+    uint64_t tick;
+    FrameStats::Stamp pendingInput;
+    uint64_t pendingInputTick;
+
+    // Keyboard thread and auto shift state for the movement keys
+    InputReader input;
+    AutoRepeat shiftLeft, shiftRight, softDrop;
+
+    // Intro sequence; stepped on the tick clock instead of sleeping
+    AnimationScheduler animations;
+
+    // Autosave: the checkpoint this game was loaded from, and what has been
+    // journaled since
+    GameJournal journal;
+    uint32_t journalGeneration;
+    int locksSinceCheckpoint;
+    int journaledRow, journaledCol, journaledRotation; // pose of the last record for this piece
+
+#ifndef _WIN32
+    TetrisBotView botView; // handed to the --bot plugin each tick
+#endif
+    Placement autoplayTarget; // where --autoplay is taking the current piece
+    uint64_t autoplayPiece;   // piecesLocked() when that was decided
+
+public:
+    Game()
+        : currentPiece(nullptr), nextPiece(nullptr),
+          currentRow(0), currentCol(0),
+          gameOver(false), paused(false),
+          level(1), linesClearedTotal(0), hudVisible(frameStats.isHudVisible()),
+          quit(false), resumed(false),
+          rng((uint64_t)chrono::steady_clock::now().time_since_epoch().count() ^ (uint64_t)time(nullptr)),
+          gravityCarry(0), rendering(false), presentedTick(0), tick(0), pendingInputTick(0),
+          journalGeneration(0), locksSinceCheckpoint(0), journaledRow(0), journaledCol(BOARD_WIDTH / 2 - 2),
+          journaledRotation(0), autoplayTarget{0, BOARD_WIDTH / 2 - 2, 0}, autoplayPiece(UINT64_MAX)
+    {
+#ifndef _WIN32
+        memset(&botView, 0, sizeof(botView));
+#endif
+        currentPiece = randomTetromino();
+        nextPiece = randomTetromino();
+        // Center the initial piece
+        currentRow = 0;
+        currentCol = BOARD_WIDTH / 2 - 2;
+    }
+
+    ~Game()
+    {
+        delete currentPiece;
+        delete nextPiece;
+    }
+    /**************************************************************
+     *Makeups: WelCome and GameOver screens
+     **************************************************************/
+    // Title art line by line, then a countdown. Played by playIntro() on
+    // the tick clock; a key press skips to the end.
+    Animation introAnimation()
+    {
+        eraseScreen();
+        cout << "\033[44m" << "\033[37m" << "\033[1m";
+
+        vector<string> tetrisArt = {
+            "████████╗███████╗████████╗██████╗ ██╗███████╗",
+            "╚══██╔══╝██╔════╝╚══██╔══╝██╔══██╗██║██╔════╝",
+            "   ██║   █████╗     ██║   ██████╔╝██║███████╗",
+            "   ██║   ██╔══╝     ██║   ██╔══██╗██║╚════██║",
+            "   ██║   ███████╗   ██║   ██║  ██║██║███████║",
+            "   ╚═╝   ╚══════╝   ╚═╝   ╚═╝  ╚═╝╚═╝╚══════╝",
+            "    M A D E   B Y   T E A M   E N I G M A    "};
+
+        for (int i = 0; i < tetrisArt.size(); i++)
+        {
+            cout << tetrisArt[i] << endl;
+            co_yield chrono::milliseconds(300);
+        }
+
+#ifdef _WIN32
+        const int countdownMs[3] = {300, 500, 500};
+#else
+        const int countdownMs[3] = {300, 300, 300};
+#endif
+        cout << "\033[0m" << "\n\nStarting game in 3...";
+        cout.flush();
+        co_yield chrono::milliseconds(countdownMs[0]);
+        cout << "2...";
+        cout.flush();
+        co_yield chrono::milliseconds(countdownMs[1]);
+        cout << "1...";
+        cout.flush();
+        co_yield chrono::milliseconds(countdownMs[2]);
+
+        // Frames only overwrite the layout, so wipe the intro first
+        eraseScreen();
+    }
+
+    // Runs the intro on the game loop's tick with input already live. Keys
+    // pressed meanwhile only skip it; they don't reach the game.
+    void playIntro()
+    {
+        animations.start(introAnimation());
+        chrono::steady_clock::time_point nextTick = chrono::steady_clock::now();
+        while (animations.active())
+        {
+            KeyEvent event;
+            bool skip = quitRequested;
+            while (input.poll(event))
+                skip = true;
+            if (skip)
+                animations.finish();
+            else
+                animations.run(chrono::steady_clock::now());
+            nextTick += chrono::milliseconds(TICK_MS);
+            this_thread::sleep_until(nextTick);
+        }
+    }
+
+    void drawPauseScreen()
+    {
+        // Clear screen and draw pause message
+        cout << "\033[2J\033[H";
+        cout << "\033[44m" << "\033[37m" << "\033[1m" << "\n\n\n\n";
+        cout << "         ██████╗  █████╗ ██╗   ██╗███████╗███████╗       \n";
+        cout << "         ██╔══██╗██╔══██╗██║   ██║██╔════╝██╔════╝       \n";
+        cout << "         ██████╔╝███████║██║   ██║███████╗█████╗         \n";
+        cout << "         ██╔═══╝ ██╔══██║██║   ██║╚════██║██╔══╝         \n";
+        cout << "         ██║     ██║  ██║╚██████╔╝███████║███████╗       \n";
+        cout << "         ╚═╝     ╚═╝  ╚═╝ ╚═════╝ ╚══════╝╚══════╝       \n";
+        cout << "\033[0m" << "\n\n";
+        cout << "\033[43m" << "\033[30m" << "           Press P to continue           " << "\033[0m" << "\n";
+        cout.flush();
+    }
+
+    int drawGameOverScreen()
+    {
+        highscore = max(score, highscore);
+        clearScreen();
+        cout << "\033[41m" << "\033[37m" << "\033[1m" << "\n\n\n\n";
+        cout << "          ██████╗  █████╗ ███╗   ███╗███████╗     \n";
+        cout << "         ██╔════╝ ██╔══██╗████╗ ████║██╔════╝     \n";
+        cout << "         ██║  ███╗███████║██╔████╔██║█████╗       \n";
+        cout << "         ██║   ██║██╔══██║██║╚██╔╝██║██╔══╝       \n";
+        cout << "         ╚██████╔╝██║  ██║██║ ╚═╝ ██║███████╗     \n";
+        cout << "          ╚═════╝ ╚═╝  ╚═╝╚═╝     ╚═╝╚══════╝     \n";
+        cout << "          ██████╗ ██╗   ██╗███████╗██████╗        \n";
+        cout << "         ██╔═══██╗██║   ██║██╔════╝██╔══██╗       \n";
+        cout << "         ██║   ██║██║   ██║█████╗  ██████╔╝       \n";
+        cout << "         ██║   ██║╚██╗ ██╔╝██╔══╝  ██╔══██╗       \n";
+        cout << "         ╚██████╔╝ ╚████╔╝ ███████╗██║  ██║       \n";
+        cout << "          ╚═════╝   ╚═══╝  ╚══════╝╚═╝  ╚═╝       \n";
+        cout << "\033[0m" << "\n\n";
+        cout << "\033[42m" << "\033[30m" << "           Your Score: " << score << "           " << "\033[0m" << "\n";
+        cout << "\033[44m" << "\033[37m" << "        High Score: " << highscore << "        " << "\033[0m" << "\n\n";
+        cout << "\033[43m" << "\033[30m" << "     Press R to restart or X to exit     " << "\033[0m" << "\n";
+        cout.flush();
+
+        cout << "Press 'R' to Restart\n(NOTE:Any other keys terminates the game: )" << endl;
+
+        char rest;
+        cin >> rest;
+
+        if (rest == 'R' || rest == 'r')
+            return 1;
+
+        // Show cursor again
+        cout << "\033[?25h";
+        return 0;
+    }
+
+    // Factory method: returns a random Tetromino
+    Tetromino *randomTetromino()
+    {
+        return createTetromino(rng.nextType());
+    }
+
+    bool wasQuit() const { return quit; }
+
+    // Everything needed to continue this game later
+    SaveGame snapshot() const
+    {
+        SaveGame save;
+        memset(&save, 0, sizeof(save));
+        memcpy(save.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+        save.version = SAVE_VERSION;
+        save.rngState = rng.getState();
+        save.score = score;
+        save.level = level;
+        save.lines = linesClearedTotal;
+        save.currentRow = (int16_t)currentRow;
+        save.currentCol = (int16_t)currentCol;
+        save.currentType = (uint8_t)currentPiece->getType();
+        save.currentRotation = (uint8_t)currentPiece->getRotation();
+        save.nextType = (uint8_t)nextPiece->getType();
+        board.pack(save.cells);
+        memcpy(save.pieceCounts, board.metrics().pieces, sizeof(save.pieceCounts));
+        save.checksum = saveChecksum(save);
+        return save;
+    }
+
+    bool saveSnapshot(const string &path) const
+    {
+        return writeSaveFile(path, snapshot());
+    }
+
+    // Restores a snapshot; leaves the game untouched if the file is invalid
+    bool loadSnapshot(const string &path)
+    {
+        SaveGame save;
+        if (!readSaveFile(path, save))
+            return false;
+        if (save.currentType >= 7 || save.nextType >= 7 || save.currentRotation >= 4 ||
+            save.level < 1 || save.lines < 0 || save.score < 0)
+            return false;
+
+        Board loaded;
+        if (!loaded.unpack(save.cells, 7))
+            return false;
+        Tetromino *current = createTetromino(save.currentType);
+        for (int i = 0; i < save.currentRotation; i++)
+            current->rotateCW();
+        if (!loaded.canPlace(*current, save.currentRow, save.currentCol))
+        {
+            delete current;
+            return false;
+        }
+
+        loaded.setPieceCounts(save.pieceCounts);
+        board = loaded;
+        delete currentPiece;
+        delete nextPiece;
+        currentPiece = current;
+        nextPiece = createTetromino(save.nextType);
+        currentRow = save.currentRow;
+        currentCol = save.currentCol;
+        score = save.score;
+        level = save.level;
+        linesClearedTotal = save.lines;
+        rng.setState(save.rngState);
+        journalGeneration = save.journalGeneration;
+        resumed = true;
+        return true;
+    }
+
+    // Replays the journal that continues the loaded save (a checkpoint left
+    // by a crash), lock by lock through the normal lockPiece(). Stops at the
+    // first record that doesn't fit the game; returns how many were applied.
+    int replayJournal(const string &path)
+    {
+        if (journalGeneration == 0)
+            return 0;
+        int applied = 0;
+        for (const JournalRecord &record : readJournal(path, journalGeneration))
+        {
+            int type = record.piece & 7, rotation = record.piece >> 3;
+            if (board.isGameOver() || type != currentPiece->getType() || rotation >= 4)
+                break;
+            while (currentPiece->getRotation() != rotation)
+                currentPiece->rotateCW();
+            if (!board.canPlace(*currentPiece, record.row, record.col))
+                break;
+            currentRow = record.row;
+            currentCol = record.col;
+            if (record.kind == JOURNAL_LOCK)
+                lockPiece();
+            else if (record.kind != JOURNAL_MOVE)
+                break;
+            applied++;
+        }
+        return applied;
+    }
+
+    bool run()
+    {
+        if (!resumed)
+            score = 0;
+        // Hide cursor (optional) // ANSI Escape sequence
+        cout << "\033[?25l";
+        eraseScreen();
+        input.start();
+        if (!resumed)
+            playIntro();
+
+        // Drawing runs on its own thread so a slow terminal cannot stall gravity
+        publishFrame();
+        rendering = true;
+        frameOutput.attach();
+        thread renderer(&Game::renderLoop, this);
+        if (journalTiming.enabled)
+        {
+            // A fresh game starts its generations somewhere new, so a stale
+            // journal of another game can't match
+            uint32_t generation = journalGeneration;
+            if (generation == 0)
+                generation = (uint32_t)(chrono::steady_clock::now().time_since_epoch().count() ^ time(nullptr));
+            locksSinceCheckpoint = 0;
+            journal.start(SAVE_FILE, JOURNAL_FILE, snapshot(), generation);
+        }
+        chrono::steady_clock::time_point nextTick = chrono::steady_clock::now();
+
+        while (!gameOver)
+        {
+            // 1) Handle input
+            FrameStats::Stamp phaseStart = frameStats.begin();
+            handleInput();
+            frameStats.end(PHASE_INPUT, phaseStart);
+
+            // 2) Update piece position (gravity) if not paused
+            if (!paused)
+            {
+                phaseStart = frameStats.begin();
+                applyGravity();
+                frameStats.end(PHASE_UPDATE, phaseStart);
+            }
+
+            // 3) Check game over
+            if (board.isGameOver())
+            {
+                gameOver = true;
+            }
+            if (quitRequested)
+            {
+                quit = true;
+                gameOver = true;
+            }
+
+            // A dropped journal record is made good by a fresh checkpoint
+            if (journal.needsCheckpoint())
+                journal.checkpoint(snapshot());
+
+            // 4) Hand the new state to the renderer
+            tick++;
+            publishFrame();
+
+            // 5) Sleep to a fixed deadline so time spent above does not
+            //    stretch the tick
+            nextTick += chrono::milliseconds(TICK_MS);
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (nextTick < now - chrono::milliseconds(250))
+                nextTick = now; // fell far behind (suspended?): don't burst to catch up
+            this_thread::sleep_until(nextTick);
+        }
+
+        input.stop();
+        journal.stop();
+        rendering = false;
+        renderer.join();
+        frameOutput.detach();
+
+        // Final screen
+        eraseScreen();
+        return true;
+    }
+
+    // --render-check: plays a script through publishFrame() and
+    // drawInterface() exactly as renderLoop() would, one frame per move,
+    // with cout writing into `terminal`. No threads, clock or HUD, so the
+    // frames only depend on the script.
+    void playRenderScript(const RenderScript &script, VirtualTerminal &terminal, RenderRecorder &recorder)
+    {
+        rng.setState(script.seed);
+        delete currentPiece;
+        delete nextPiece;
+        currentPiece = randomTetromino();
+        nextPiece = randomTetromino();
+        currentRow = 0;
+        currentCol = BOARD_WIDTH / 2 - 2;
+        score = 0;
+        hudVisible = false;
+        frameStats.setHudVisible(false);
+
+        streambuf *previous = cout.rdbuf(&terminal);
+        FrameSnapshot shown;
+        bool haveShown = false;
+        bool kept = false;
+        for (size_t i = 0;; i++)
+        {
+            publishFrame();
+            frames.update();
+            const FrameSnapshot &frame = frames.readSlot();
+            drawInterface(frame, haveShown ? &shown : nullptr);
+            cout.flush();
+            shown = frame;
+            haveShown = true;
+            recorder.frame();
+            kept = false;
+
+            for (; i < script.moves.size() && script.moves[i] == '|'; i++)
+            {
+                if (!kept)
+                    recorder.snapshot();
+                kept = true;
+            }
+            if (i == script.moves.size())
+                break;
+            switch (script.moves[i])
+            {
+            case 'L':
+                tryMove(currentRow, currentCol - 1);
+                break;
+            case 'R':
+                tryMove(currentRow, currentCol + 1);
+                break;
+            case 'U':
+                rotatePiece(FrameStats::Stamp());
+                break;
+            case 'D':
+                moveDown();
+                break;
+            case 'S':
+                hardDrop();
+                break;
+            case 'G':
+                tryMove(currentRow + 1, currentCol);
+                break;
+            default:
+                break;
+            }
+        }
+        if (!kept)
+            recorder.snapshot();
+        cout.rdbuf(previous);
+    }
+
+private:
+    // Copies the state the renderer needs into the triple buffer
+    void publishFrame()
+    {
+        FrameSnapshot &frame = frames.writeSlot();
+        for (int r = 0; r < BOARD_HEIGHT; r++)
+            for (int c = 0; c < BOARD_WIDTH; c++)
+                frame.cells[r][c] = (uint8_t)board.getCell(r, c);
+
+        // Overlay current piece
+        const auto &shape = currentPiece->getShape();
+        for (int r = 0; r < 4; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                int br = currentRow + r;
+                int bc = currentCol + c;
+                if (shape[r][c] != 0 && br >= 0 && br < BOARD_HEIGHT && bc >= 0 && bc < BOARD_WIDTH)
+                    frame.cells[br][bc] = (uint8_t)currentPiece->getColorIndex();
+            }
+        }
+
+        const auto &next = nextPiece->getShape();
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                frame.next[r][c] = next[r][c] ? (uint8_t)nextPiece->getColorIndex() : 0;
+
+        frame.level = level;
+        frame.lines = linesClearedTotal;
+        frame.score = score;
+        frame.paused = paused;
+        frame.hudVisible = hudVisible;
+        frame.metrics = board.metrics();
+        frame.tick = tick;
+
+        // Keep reporting the oldest unseen key until a frame showing it is flushed
+        if (pendingInput != FrameStats::Stamp() && presentedTick.load(memory_order_acquire) >= pendingInputTick)
+            pendingInput = FrameStats::Stamp();
+        frame.inputStamp = pendingInput;
+        frame.inputTick = pendingInputTick;
+
+        frames.publish();
+#ifndef _WIN32
+        if (shmExport.isOpen())
+            exportState();
+#endif
+    }
+
+#ifndef _WIN32
+    // Same tick, for readers of the shared-memory segment: locked cells and
+    // the falling piece kept apart
+    void exportState()
+    {
+        TetrisShmSnapshot state;
+        memset(&state, 0, sizeof(state));
+        state.tick = tick;
+        state.score = score;
+        state.level = level;
+        state.lines = linesClearedTotal;
+        state.rows = BOARD_HEIGHT;
+        state.cols = BOARD_WIDTH;
+        state.piece = (uint8_t)currentPiece->getType();
+        state.next = (uint8_t)nextPiece->getType();
+        state.rotation = (uint8_t)currentPiece->getRotation();
+        state.flags = (paused ? TETRIS_SHM_PAUSED : 0) | (gameOver ? TETRIS_SHM_GAME_OVER : 0);
+        for (int r = 0; r < BOARD_HEIGHT; r++)
+            for (int c = 0; c < BOARD_WIDTH; c++)
+                state.cells[r][c] = (uint8_t)board.getCell(r, c);
+        pieceMinos(state.minos);
+        shmExport.publish(state);
+    }
+
+    // Lets the --bot plugin play this tick: it sees the board in place and
+    // its buttons act like keys
+    void runBot()
+    {
+        botView.tick = tick;
+        botView.pieces = piecesLocked();
+        botView.rows = BOARD_HEIGHT;
+        botView.cols = BOARD_WIDTH;
+        botView.rowStride = BOARD_WIDTH;
+        botView.cells = board.cellData();
+        botView.score = score;
+        botView.level = level;
+        botView.lines = linesClearedTotal;
+        botView.piece = (uint8_t)currentPiece->getType();
+        botView.next = (uint8_t)nextPiece->getType();
+        botView.rotation = (uint8_t)currentPiece->getRotation();
+        pieceMinos(botView.minos);
+
+        uint32_t buttons = botHost.call(botView);
+        botCallNs.record(botHost.lastCallNs());
+
+        FrameStats::Stamp now = chrono::steady_clock::now();
+        if (buttons & TETRIS_BOT_ROTATE)
+            rotatePiece(now);
+        if ((buttons & TETRIS_BOT_LEFT) && tryMove(currentRow, currentCol - 1))
+            lockDelay.moved(now);
+        if ((buttons & TETRIS_BOT_RIGHT) && tryMove(currentRow, currentCol + 1))
+            lockDelay.moved(now);
+        if (buttons & TETRIS_BOT_HARD_DROP)
+            hardDrop();
+        else if (buttons & TETRIS_BOT_SOFT_DROP)
+            moveDown();
+    }
+#endif
+
+    uint64_t piecesLocked() const
+    {
+        uint64_t pieces = 0;
+        for (int t = 0; t < 7; t++)
+            pieces += board.metrics().pieces[t];
+        return pieces;
+    }
+
+    // --autoplay: asks the planner where a new piece goes, then takes it
+    // there a key a tick along the shortest legal walk (turns, shifts, soft
+    // drops under an overhang, a hard drop once that lands on the spot). If
+    // gravity or a key pressed meanwhile leaves the spot out of reach, the
+    // piece is hard dropped where it is.
+    void runAutoplay()
+    {
+        uint64_t pieces = piecesLocked();
+        if (pieces != autoplayPiece)
+        {
+            autoplayTarget = autoplayPlanner.decide(board, currentPiece->getType(), nextPiece->getType());
+            autoplayPiece = pieces;
+        }
+
+        // One legal key a tick, the way a player would press it; if the
+        // target can't be reached from here any more, the piece drops as it is
+        FrameStats::Stamp now = chrono::steady_clock::now();
+        Placement here = {currentRow, currentCol, currentPiece->getRotation()};
+        switch (nextAutoplayMove(board, currentPiece->getType(), here, autoplayTarget))
+        {
+        case AUTOPLAY_LEFT:
+            if (tryMove(currentRow, currentCol - 1))
+                lockDelay.moved(now);
+            break;
+        case AUTOPLAY_RIGHT:
+            if (tryMove(currentRow, currentCol + 1))
+                lockDelay.moved(now);
+            break;
+        case AUTOPLAY_DOWN:
+            moveDown();
+            break;
+        case AUTOPLAY_ROTATE:
+            rotatePiece(now);
+            break;
+        case AUTOPLAY_HARD_DROP:
+            hardDrop();
+            break;
+        }
+    }
+
+    // (row, col) of each cell of the falling piece
+    void pieceMinos(int8_t minos[4][2]) const
+    {
+        const auto &shape = currentPiece->getShape();
+        int mino = 0;
+        for (int r = 0; r < 4; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                if (shape[r][c] != 0 && mino < 4)
+                {
+                    minos[mino][0] = (int8_t)(currentRow + r);
+                    minos[mino][1] = (int8_t)(currentCol + c);
+                    mino++;
+                }
+            }
+        }
+    }
+
+    // Render thread: draws the newest published frame as a diff against the
+    // one on screen. While the terminal is still taking an earlier frame,
+    // newer frames are only picked up, and the next diff covers them all.
+    void renderLoop()
+    {
+        bool pauseShown = false;
+        uint64_t measuredInputTick = 0;
+        FrameSnapshot shown; // what the terminal has (or will have, once the queue drains)
+        bool haveShown = false;
+        bool waiting = false; // a picked-up frame hasn't been drawn yet
+        uint64_t lastTick = 0;
+
+        // Stats for the last frame drawn, reported once it has left the queue
+        bool unreported = false;
+        FrameStats::Stamp reportInput;
+        uint64_t reportTick = 0;
+
+        while (rendering)
+        {
+            if (frames.update())
+            {
+                const FrameSnapshot &next = frames.readSlot();
+                if (waiting)
+                    frameOutput.noteCoalesced();
+                if (lastTick != 0 && next.tick > lastTick + 1)
+                    frameOutput.noteDropped(next.tick - lastTick - 1);
+                lastTick = next.tick;
+                waiting = true;
+            }
+
+            if (!frameOutput.pump())
+            {
+                frameOutput.waitWritable(1);
+                continue;
+            }
+            if (unreported)
+            {
+                frameStats.endFrame(reportInput, reportTick);
+                presentedTick.store(reportTick, memory_order_release);
+                unreported = false;
+            }
+            if (!waiting)
+            {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+            waiting = false;
+
+            const FrameSnapshot &frame = frames.readSlot();
+            frameStats.setHudVisible(frame.hudVisible);
+
+            if (frame.paused)
+            {
+                // The pause screen is static: draw it once per pause
+                if (!pauseShown)
+                    drawPauseScreen();
+                pauseShown = true;
+            }
+            else
+            {
+                if (pauseShown)
+                {
+#ifdef _WIN32
+                    system("cls");
+#else
+                    cout << "\033[2J"; // through the frame queue, in order
+#endif
+                    pauseShown = false;
+                    haveShown = false;
+                }
+
+                // Only what changed since the frame on screen is drawn
+                FrameStats::Stamp phaseStart = frameStats.begin();
+                drawInterface(frame, haveShown ? &shown : nullptr);
+                frameStats.end(PHASE_COMPOSE, phaseStart);
+
+                phaseStart = frameStats.begin();
+                cout.flush();
+                frameStats.end(PHASE_FLUSH, phaseStart);
+                shown = frame;
+                haveShown = true;
+            }
+
+            bool newInput = frame.inputStamp != FrameStats::Stamp() && frame.inputTick != measuredInputTick;
+            if (newInput)
+                measuredInputTick = frame.inputTick;
+            reportInput = newInput ? frame.inputStamp : FrameStats::Stamp();
+            reportTick = frame.tick;
+            unreported = true;
+        }
+        if (unreported)
+        {
+            frameStats.endFrame(reportInput, reportTick);
+            presentedTick.store(reportTick, memory_order_release);
+        }
+    }
+
+    // Draw the interface (left panel, board in center, right panel). With
+    // `shown`, the frame already on screen, only the parts that differ are
+    // drawn; without it, everything is.
+    void drawInterface(const FrameSnapshot &frame, const FrameSnapshot *shown) const
+    {
+        // -------------------------------------
+        // LEFT PANEL (Level, lines, score, controls)
+        // -------------------------------------
+        int leftPanelRow = 1;
+        int leftPanelCol = 1;
+        if (!shown || shown->level != frame.level)
+        {
+            setCursorPos(leftPanelRow, leftPanelCol);
+            cout << "Your Level: " << frame.level;
+        }
+        leftPanelRow++;
+
+        if (!shown || shown->lines != frame.lines)
+        {
+            setCursorPos(leftPanelRow, leftPanelCol);
+            cout << "Full Lines: " << frame.lines;
+        }
+        leftPanelRow++;
+
+        if (!shown || shown->score != frame.score)
+        {
+            setCursorPos(leftPanelRow, leftPanelCol);
+            cout << "Score: " << frame.score;
+        }
+        leftPanelRow++;
+
+        if (!shown)
+        {
+            // Paused frames are drawn by renderLoop as the pause screen
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "Game Status : [ RUNNING ]\n";
+
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "CONTROLS:";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  p/P   : Pause";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  Left  : Move Left";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  Right : Move Right";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  Up    : Rotate";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  Down  : Soft Drop";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  Space : Hard Drop";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  h     : Perf HUD";
+            setCursorPos(leftPanelRow++, leftPanelCol);
+            cout << "  ESC   : Quit";
+        }
+
+        // -------------------------------------
+        // BOARD in the CENTER with a border
+        // -------------------------------------
+
+        int boardTop = 2;   // row offset
+        int boardLeft = 30; // column offset (space to left panel)
+        int cellWidth = 2;  // each cell is "  "
+        int borderWidth = BOARD_WIDTH * cellWidth;
+        int borderHeight = BOARD_HEIGHT;
+
+        {
+            // Cursor moves don't touch SGR state, so one emitter covers the whole board
+            CellEmitter cells(cout);
+
+            if (!shown)
+            {
+                // Draw top border
+                setCursorPos(boardTop, boardLeft);
+                cells.put(STYLE_EDGE_TOP, GLYPH_EDGE);
+                for (int i = 0; i < borderWidth; i++)
+                    cells.put(STYLE_DEFAULT, GLYPH_RULE);
+                cells.put(STYLE_EDGE_TOP, GLYPH_EDGE);
+            }
+
+            // Print each row of the board between the side borders
+            // (the snapshot already has the current piece overlaid)
+            for (int r = 0; r < borderHeight; r++)
+            {
+                if (!shown)
+                {
+                    setCursorPos(boardTop + 1 + r, boardLeft);
+                    cells.put(STYLE_EDGE_SIDE, GLYPH_EDGE); // Left Border
+                }
+                else if (memcmp(shown->cells[r], frame.cells[r], BOARD_WIDTH) != 0)
+                {
+                    setCursorPos(boardTop + 1 + r, boardLeft + 1);
+                }
+                else
+                {
+                    continue;
+                }
+                for (int c = 0; c < BOARD_WIDTH; c++)
+                    cells.put(frame.cells[r][c] % 8, GLYPH_EMPTY);
+                if (!shown)
+                    cells.put(STYLE_EDGE_SIDE, GLYPH_EDGE); // Right Border
+            }
+
+            if (!shown)
+            {
+                // Draw bottom border
+                setCursorPos(boardTop + borderHeight + 1, boardLeft);
+                cells.put(STYLE_EDGE_TOP, GLYPH_EDGE);
+                for (int i = 0; i < borderWidth; i++)
+                    cells.put(STYLE_DEFAULT, GLYPH_RULE);
+                cells.put(STYLE_EDGE_TOP, GLYPH_EDGE);
+            }
+        }
+
+        // -------------------------------------
+        // RIGHT PANEL (Statistics / Next Piece)
+        // -------------------------------------
+        int rightPanelRow = 2;
+        int rightPanelCol = boardLeft + borderWidth + 5;
+        if (!shown)
+        {
+            setCursorPos(rightPanelRow, rightPanelCol);
+            cout << "STATISTICS";
+            setCursorPos(rightPanelRow + 2, rightPanelCol);
+            cout << "Next Piece:";
+        }
+        rightPanelRow += 3;
+
+        // Draw next piece in a small 4x4 area
+        if (!shown || memcmp(shown->next, frame.next, sizeof(frame.next)) != 0)
+        {
+            CellEmitter cells(cout);
+            for (int row = 0; row < 4; row++)
+            {
+                setCursorPos(rightPanelRow + row, rightPanelCol);
+                for (int col = 0; col < 4; col++)
+                    cells.put(frame.next[row][col] % 8, GLYPH_EMPTY);
+            }
+        }
+
+        if (!shown || memcmp(&shown->metrics, &frame.metrics, sizeof(frame.metrics)) != 0)
+            drawBoardMetrics(frame.metrics, rightPanelRow + 5, rightPanelCol);
+
+        drawPerformanceHud(frame, shown, rightPanelRow + 13, rightPanelCol);
+    }
+
+    // Piece usage and stack shape; only changes when a piece locks
+    void drawBoardMetrics(const BoardMetrics &m, int row, int col) const
+    {
+        // One character per column: 0-9, then A for 10 and so on
+        char profile[BOARD_WIDTH + 1];
+        for (int c = 0; c < BOARD_WIDTH; c++)
+            profile[c] = m.heights[c] < 10 ? (char)('0' + m.heights[c]) : (char)('A' + m.heights[c] - 10);
+        profile[BOARD_WIDTH] = 0;
+
+        char line[7][32];
+        snprintf(line[0], sizeof(line[0]), "I%4u O%4u T%4u S%4u ", m.pieces[0], m.pieces[1], m.pieces[2], m.pieces[3]);
+        snprintf(line[1], sizeof(line[1]), "Z%4u J%4u L%4u       ", m.pieces[4], m.pieces[5], m.pieces[6]);
+        snprintf(line[2], sizeof(line[2]), "Holes     : %4d        ", m.holes);
+        snprintf(line[3], sizeof(line[3]), "Covered   : %4d        ", m.covered);
+        snprintf(line[4], sizeof(line[4]), "Bumpiness : %4d        ", m.bumpiness);
+        snprintf(line[5], sizeof(line[5]), "Max well  : %4d        ", m.maxWell);
+        snprintf(line[6], sizeof(line[6]), "Heights   : %-10s  ", profile);
+        for (int i = 0; i < 7; i++)
+        {
+            setCursorPos(row + i, col);
+            cout << line[i];
+        }
+    }
+
+    // Live counters from frameStats; blanks the area once after being hidden
+    // (a full redraw follows a cleared screen, so there is nothing to blank)
+    void drawPerformanceHud(const FrameSnapshot &frame, const FrameSnapshot *shown, int row, int col) const
+    {
+        if (!frame.hudVisible)
+        {
+            if (shown && shown->hudVisible)
+            {
+                for (int i = 0; i < 7; i++)
+                {
+                    setCursorPos(row + i, col);
+                    cout << string(24, ' ');
+                }
+            }
+            return;
+        }
+
+        const HudValues &hud = frameStats.hud();
+        char line[7][32];
+        snprintf(line[0], sizeof(line[0]), "%-24s", "PERFORMANCE");
+        snprintf(line[1], sizeof(line[1]), "Tick rate : %7.1f /s  ", hud.tickRate);
+        snprintf(line[2], sizeof(line[2]), "Compose   : %7.0f us  ", hud.composeUs);
+        snprintf(line[3], sizeof(line[3]), "Output    : %7.0f B   ", hud.bytesPerFrame);
+        snprintf(line[4], sizeof(line[4]), "Input lag : %7.1f ms  ", hud.inputLatencyMs);
+        snprintf(line[5], sizeof(line[5]), "Allocs    : %7.0f /s  ", hud.allocsPerSec);
+        snprintf(line[6], sizeof(line[6]), "Skipped   : %7.1f /s  ", hud.skippedPerSec);
+        for (int i = 0; i < 7; i++)
+        {
+            setCursorPos(row + i, col);
+            cout << line[i];
+        }
+    }
+
+    // Applies every queued key in the order it was pressed, then auto shift
+    void handleInput()
+    {
+        const Tetromino *startPiece = currentPiece; // replaced if a key locks it
+        int startRow = currentRow, startCol = currentCol, startRotation = currentPiece->getRotation();
+        KeyEvent event;
+        while (input.poll(event))
+        {
+            if (frameStats.isActive() && pendingInput == FrameStats::Stamp())
+            {
+                pendingInput = event.time;
+                pendingInputTick = tick + 1; // shown by the frame published after this tick
+            }
+            switch (event.key)
+            {
+            case 75: // Left arrow
+                if (!paused && shiftLeft.onEvent(event.time) && tryMove(currentRow, currentCol - 1))
+                    lockDelay.moved(event.time);
+                break;
+            case 77: // Right arrow
+                if (!paused && shiftRight.onEvent(event.time) && tryMove(currentRow, currentCol + 1))
+                    lockDelay.moved(event.time);
+                break;
+            case 80: // Down arrow
+                if (!paused && softDrop.onEvent(event.time))
+                    moveDown(); // soft drop
+                break;
+            case 72: // Up arrow
+                if (!paused)
+                    rotatePiece(event.time);
+                break;
+            case ' ': // Hard drop
+                if (!paused)
+                    hardDrop();
+                break;
+            case 'p':
+                paused = !paused;
+                lockDelay.reset(false); // time spent paused doesn't count
+                break;
+            case 'h': // 'H' is the Up arrow code (72)
+                hudVisible = !hudVisible;
+                break;
+            case 27: // ESC
+                quit = true;
+                gameOver = true;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (!paused)
+        {
+            // Held keys: auto shifts never lock the piece, gravity does that
+            FrameStats::Stamp now = chrono::steady_clock::now();
+            int shifted = 0;
+            for (int n = shiftLeft.due(now); n > 0 && tryMove(currentRow, currentCol - 1); n--)
+                shifted++;
+            for (int n = shiftRight.due(now); n > 0 && tryMove(currentRow, currentCol + 1); n--)
+                shifted++;
+            if (shifted > 0)
+                lockDelay.moved(now);
+            for (int n = softDrop.due(now); n > 0 && board.canPlace(*currentPiece, currentRow + 1, currentCol); n--)
+                currentRow++;
+#ifndef _WIN32
+            if (botHost.isActive())
+                runBot();
+#endif
+            if (autoplayOptions.enabled)
+                runAutoplay();
+        }
+
+        // Journal where input left the piece (gravity alone isn't journaled)
+        int rotation = currentPiece->getRotation();
+        if ((currentPiece != startPiece || currentRow != startRow || currentCol != startCol || rotation != startRotation) &&
+            (currentRow != journaledRow || currentCol != journaledCol || rotation != journaledRotation))
+        {
+            journal.record(JOURNAL_MOVE, currentPiece->getType(), rotation, currentRow, currentCol);
+            journaledRow = currentRow;
+            journaledCol = currentCol;
+            journaledRotation = rotation;
+        }
+    }
+
+    // One tick of gravity: fall by whole rows as the carry allows, straight
+    // to the landing row if it's closer, then lock once the delay runs out
+    void applyGravity()
+    {
+        int distance = board.dropDistance(*currentPiece, currentRow, currentCol);
+        if (distance > 0)
+        {
+            int32_t step = gravityTiming.g > 0 ? gravityStep(gravityTiming.g * G_ROWS_PER_MS) : levelGravity();
+            gravityCarry += step;
+            int rows = gravityCarry / GRAVITY_ONE;
+            gravityCarry %= GRAVITY_ONE;
+            if (rows >= distance)
+            {
+                rows = distance;
+                gravityCarry = 0;
+            }
+            currentRow += rows;
+            distance -= rows;
+        }
+        if (lockDelay.expired(distance == 0, chrono::steady_clock::now()))
+            lockPiece();
+    }
+
+    // The original speeds up to level 10 (one row per 100 - (level-1)*10 ms,
+    // half as long again off Windows), then 30% faster per level up to 20G
+    int32_t levelGravity() const
+    {
+        double msPerRow = 100 - (min(level, 10) - 1) * 10;
+#ifndef _WIN32
+        msPerRow *= 1.5;
+#endif
+        return gravityStep(pow(1.3, max(0, level - 10)) / msPerRow);
+    }
+
+    void rotatePiece(FrameStats::Stamp time)
+    {
+        currentPiece->rotateCW();
+        if (!board.canPlace(*currentPiece, currentRow, currentCol))
+        {
+            // Rotate back if invalid
+            for (int i = 0; i < 3; i++)
+            {
+                currentPiece->rotateCW();
+            }
+        }
+        else
+        {
+            lockDelay.moved(time);
+        }
+    }
+
+    void hardDrop()
+    {
+        currentRow += board.dropDistance(*currentPiece, currentRow, currentCol);
+        lockPiece();
+    }
+
+    // Soft drop: one row, or lock at once if the piece is already down
+    void moveDown()
+    {
+        if (board.canPlace(*currentPiece, currentRow + 1, currentCol))
+        {
+            currentRow++;
+        }
+        else
+        {
+            lockPiece();
+        }
+    }
+
+    void lockPiece()
+    {
+        journal.record(JOURNAL_LOCK, currentPiece->getType(), currentPiece->getRotation(), currentRow, currentCol);
+        board.place(*currentPiece, currentRow, currentCol);
+        FrameStats::Stamp clearStart = frameStats.begin();
+        int cleared = board.clearLines();
+        frameStats.end(PHASE_LINE_CLEAR, clearStart);
+        if (cleared > 0)
+        {
+            score += (cleared * 100);
+            linesClearedTotal += cleared;
+            // Increase level for every 10 lines, for example
+            if (linesClearedTotal / 10 >= level)
+            {
+                level++;
+            }
+        }
+        delete currentPiece;
+        currentPiece = nextPiece;
+        nextPiece = randomTetromino();
+        currentRow = 0;
+        currentCol = BOARD_WIDTH / 2 - 2;
+        gravityCarry = 0;
+        lockDelay.reset(true);
+        journaledRow = currentRow;
+        journaledCol = currentCol;
+        journaledRotation = 0;
+
+        if (journalTiming.checkpointLocks > 0 && ++locksSinceCheckpoint >= journalTiming.checkpointLocks)
+        {
+            journal.checkpoint(snapshot());
+            locksSinceCheckpoint = 0;
+        }
+    }
+
+    bool tryMove(int newRow, int newCol)
+    {
+        if (!board.canPlace(*currentPiece, newRow, newCol))
+            return false;
+        currentRow = newRow;
+        currentCol = newCol;
+        return true;
+    }
+};
+
+/**************************************************************
+ * 6b) Transposition table for position search
+ *     Fixed-size and lock-free: each slot stores (key ^ data,
+ *     data) in two relaxed atomics. A probe accepts the slot
+ *     only if the two words agree with the key, so an entry
+ *     torn by a concurrent store just reads as a miss.
+ **************************************************************/
+class TranspositionTable
+{
+private:
+    struct Slot
+    {
+        atomic<uint64_t> check; // key ^ data
+        atomic<uint64_t> data;
+    };
+
+    // Per-thread-ish counters on separate cache lines, summed on demand
+    struct alignas(64) Counters
+    {
+        atomic<uint64_t> probes{0}, hits{0}, collisions{0}, stores{0}, replaced{0};
+    };
+    static const int COUNTER_SHARDS = 16;
+
+    unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    Counters counters[COUNTER_SHARDS];
+
+    Counters &local()
+    {
+        static atomic<int> nextShard(0);
+        static thread_local int shard = nextShard++ % COUNTER_SHARDS;
+        return counters[shard];
+    }
+
+public:
+    struct Stats
+    {
+        uint64_t probes, hits, collisions, stores, replaced;
+    };
+
+    // Rounds down to a power of two slots; 0 MB disables the table
+    void resize(size_t megabytes)
+    {
+        size_t count = 0;
+        if (megabytes > 0)
+        {
+            count = 1;
+            while (count * 2 * sizeof(Slot) <= megabytes * 1024 * 1024)
+                count *= 2;
+        }
+        slots.reset(count ? new Slot[count] : nullptr);
+        mask = count ? count - 1 : 0;
+        clear();
+    }
+
+    // Forgets every entry (keys that depend on context, e.g. perft's
+    // piece sequence, must not leak into the next run)
+    void clear()
+    {
+        for (size_t i = 0; i < capacity(); i++)
+        {
+            slots[i].check.store(0, memory_order_relaxed);
+            slots[i].data.store(0, memory_order_relaxed);
+        }
+    }
+    bool enabled() const { return slots != nullptr; }
+    size_t capacity() const { return slots ? mask + 1 : 0; }
+
+    // Data 0 is reserved for "empty", so callers must never store 0
+    bool probe(uint64_t key, uint64_t &data)
+    {
+        if (!slots)
+            return false;
+        Counters &c = local();
+        c.probes.fetch_add(1, memory_order_relaxed);
+        Slot &slot = slots[key & mask];
+        uint64_t d = slot.data.load(memory_order_relaxed);
+        uint64_t check = slot.check.load(memory_order_relaxed);
+        if (d != 0 && (check ^ d) == key)
+        {
+            c.hits.fetch_add(1, memory_order_relaxed);
+            data = d;
+            return true;
+        }
+        if (d != 0)
+            c.collisions.fetch_add(1, memory_order_relaxed); // slot holds another position (or a torn one)
+        return false;
+    }
+
+    // Always replaces: the newest position is the most likely to recur
+    void store(uint64_t key, uint64_t data)
+    {
+        if (!slots)
+            return;
+        Counters &c = local();
+        c.stores.fetch_add(1, memory_order_relaxed);
+        Slot &slot = slots[key & mask];
+        uint64_t old = slot.data.load(memory_order_relaxed);
+        if (old != 0 && (slot.check.load(memory_order_relaxed) ^ old) != key)
+            c.replaced.fetch_add(1, memory_order_relaxed);
+        slot.data.store(data, memory_order_relaxed);
+        slot.check.store(key ^ data, memory_order_relaxed);
+    }
+
+    Stats stats() const
+    {
+        Stats s = {0, 0, 0, 0, 0};
+        for (const Counters &c : counters)
+        {
+            s.probes += c.probes.load(memory_order_relaxed);
+            s.hits += c.hits.load(memory_order_relaxed);
+            s.collisions += c.collisions.load(memory_order_relaxed);
+            s.stores += c.stores.load(memory_order_relaxed);
+            s.replaced += c.replaced.load(memory_order_relaxed);
+        }
+        return s;
+    }
+
+    // One line: probes, hit rate, collisions and replacements
+    string summary(const string &name) const
+    {
+        Stats s = stats();
+        ostringstream out;
+        out << name << " table: " << capacity() << " slots, " << s.probes << " probes, "
+            << (s.probes ? 100.0 * s.hits / s.probes : 0.0) << "% hits, " << s.collisions << " collisions, "
+            << s.stores << " stores (" << s.replaced << " replaced another position)";
+        return out.str();
+    }
+};
+
+// One table for perft node counts, one for placement search results and
+// one for positions the perfect-clear search has already ruled out
+TranspositionTable perftTable;
+TranspositionTable searchTable;
+TranspositionTable pcTable;
+
+/**************************************************************
+ * 7) Perft: placement enumeration for move-generator checks
+ *    Counts every distinct reachable lock position for a piece
+ *    sequence to depth N, like a chess engine's perft. Moves
+ *    follow Game::handleInput exactly: left/right/down must pass
+ *    Board::canPlace, and a rotation that does not fit is
+ *    reverted, so the piece keeps its old orientation.
+ **************************************************************/
+const string PIECE_LETTERS = "IOTSZJL"; // same order as TETROMINO_SHAPES
+
+int pieceTypeFromLetter(char ch)
+{
+    size_t pos = PIECE_LETTERS.find((char)toupper((unsigned char)ch));
+    return pos == string::npos ? -1 : (int)pos;
+}
+
+// Spawn shape of each piece type rotated 0..3 times with rotateCW()
+const Tetromino &pieceRotation(int type, int rotation)
+{
+    static const vector<vector<Tetromino>> rotations = []
+    {
+        vector<vector<Tetromino>> all;
+        for (int t = 0; t < 7; t++)
+        {
+            Tetromino *piece = createTetromino(t);
+            vector<Tetromino> turns;
+            for (int k = 0; k < 4; k++)
+            {
+                turns.push_back(*piece);
+                piece->rotateCW();
+            }
+            delete piece;
+            all.push_back(turns);
+        }
+        return all;
+    }();
+    return rotations[type][rotation & 3];
+}
+
+// Every pose a piece can take: rotation, row, and a column up to 3 left of
+// the board (shapes may sit up to 3 columns right of col). No search
+// visits or locks more than this.
+const int MAX_PIECE_POSES = 4 * BOARD_HEIGHT * (BOARD_WIDTH + 3);
+
+// Appends every distinct lock position of `type` reachable from the spawn.
+// Two placements are the same if they cover the same four cells.
+void enumerateLocks(const Board &board, int type, vector<Placement> &out)
+{
+    const int COL_OFFSET = 3;
+    const int COLS = BOARD_WIDTH + COL_OFFSET;
+    static thread_local vector<char> visited;
+    visited.assign(MAX_PIECE_POSES, 0);
+    auto index = [&](int r, int c, int rot)
+    { return (rot * BOARD_HEIGHT + r) * COLS + c + COL_OFFSET; };
+
+    int spawnRow = 0;
+    int spawnCol = BOARD_WIDTH / 2 - 2;
+    if (!board.canPlace(pieceRotation(type, 0), spawnRow, spawnCol))
+        return;
+
+    // Scratch space reused between calls and sized for the worst case on
+    // first use, so enumeration never allocates after that (rollouts call
+    // this in their inner loop)
+    static thread_local vector<Placement> queue;
+    static thread_local vector<pair<uint32_t, Placement>> locks;
+    queue.reserve(MAX_PIECE_POSES);
+    locks.reserve(MAX_PIECE_POSES);
+    queue.clear();
+    locks.clear();
+    queue.push_back({spawnRow, spawnCol, 0});
+    visited[index(spawnRow, spawnCol, 0)] = 1;
+
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        Placement p = queue[head];
+        const Tetromino &piece = pieceRotation(type, p.rotation);
+
+        // Left, right, soft drop and a rotation that is kept only if it fits
+        Placement next[4] = {{p.row, p.col - 1, p.rotation},
+                             {p.row, p.col + 1, p.rotation},
+                             {p.row + 1, p.col, p.rotation},
+                             {p.row, p.col, (p.rotation + 1) & 3}};
+        for (const Placement &n : next)
+        {
+            if (n.col < -COL_OFFSET || n.col >= BOARD_WIDTH || n.row >= BOARD_HEIGHT)
+                continue;
+            if (visited[index(n.row, n.col, n.rotation)])
+                continue;
+            if (!board.canPlace(pieceRotation(type, n.rotation), n.row, n.col))
+                continue;
+            visited[index(n.row, n.col, n.rotation)] = 1;
+            queue.push_back(n);
+        }
+
+        // Game::moveDown locks the piece once it cannot fall any further
+        if (!board.canPlace(piece, p.row + 1, p.col))
+        {
+            // Cells are scanned in board order, so the key is already sorted
+            uint32_t key = 0;
+            const auto &shape = piece.getShape();
+            for (int r = 0; r < 4; r++)
+                for (int c = 0; c < 4; c++)
+                    if (shape[r][c] != 0)
+                        key = (key << 8) | (uint32_t)((p.row + r) * BOARD_WIDTH + (p.col + c));
+            locks.push_back({key, p});
+        }
+    }
+
+    sort(locks.begin(), locks.end(), [](const pair<uint32_t, Placement> &a, const pair<uint32_t, Placement> &b)
+         { return a.first < b.first; });
+    for (size_t i = 0; i < locks.size(); i++)
+    {
+        if (i == 0 || locks[i].first != locks[i - 1].first)
+            out.push_back(locks[i].second);
+    }
+}
+
+// Autoplay's next key from `here` toward the lock at `target`: the first
+// move of a shortest walk by enumerateLocks' moves to a pose a hard drop
+// takes to the target, then the hard drop. Also a hard drop if no walk gets there any more
+// (gravity pulled the piece past the way in, or the stack shuts it), so the
+// piece locks where it falls and never where it couldn't go.
+AutoplayMove nextAutoplayMove(const Board &board, int type, const Placement &here, const Placement &target)
+{
+    // Walks end anywhere a hard drop lands on the target, so soft drops are
+    // only taken to tuck under an overhang
+    auto overTarget = [&](const Placement &p)
+    {
+        return p.rotation == target.rotation && p.col == target.col &&
+               p.row + board.dropDistance(pieceRotation(type, p.rotation), p.row, p.col) == target.row;
+    };
+    if (overTarget(here))
+        return AUTOPLAY_HARD_DROP;
+
+    const int COL_OFFSET = 3;
+    const int COLS = BOARD_WIDTH + COL_OFFSET;
+    auto index = [&](const Placement &p)
+    { return (p.rotation * BOARD_HEIGHT + p.row) * COLS + p.col + COL_OFFSET; };
+
+    // The first move of the walk that reached each pose, -1 if none has yet
+    static thread_local vector<int8_t> firstMove;
+    static thread_local vector<Placement> queue;
+    firstMove.assign(MAX_PIECE_POSES, -1);
+    queue.reserve(MAX_PIECE_POSES);
+    queue.clear();
+    queue.push_back(here);
+    firstMove[index(here)] = AUTOPLAY_HARD_DROP;
+
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        Placement p = queue[head];
+        Placement next[4] = {{p.row, p.col - 1, p.rotation},
+                             {p.row, p.col + 1, p.rotation},
+                             {p.row + 1, p.col, p.rotation},
+                             {p.row, p.col, (p.rotation + 1) & 3}};
+        for (int move = 0; move < 4; move++)
+        {
+            const Placement &n = next[move];
+            if (n.col < -COL_OFFSET || n.col >= BOARD_WIDTH || n.row >= BOARD_HEIGHT)
+                continue;
+            if (firstMove[index(n)] >= 0)
+                continue;
+            if (!board.canPlace(pieceRotation(type, n.rotation), n.row, n.col))
+                continue;
+            firstMove[index(n)] = head == 0 ? (int8_t)move : firstMove[index(p)];
+            if (overTarget(n))
+                return (AutoplayMove)firstMove[index(n)];
+            queue.push_back(n);
+        }
+    }
+    return AUTOPLAY_HARD_DROP;
+}
+
+// Board after locking a placement, with lines cleared as Game::lockPiece does
+Board applyPlacement(const Board &board, int type, const Placement &p)
+{
+    Board child = board;
+    child.place(pieceRotation(type, p.rotation), p.row, p.col);
+    child.clearLines();
+    return child;
+}
+
+uint64_t perft(const Board &board, const vector<int> &sequence, size_t index, int depth)
+{
+    if (depth == 0)
+        return 1;
+
+    vector<Placement> locks;
+    enumerateLocks(board, sequence[index], locks);
+    if (depth == 1)
+        return locks.size();
+
+    // The same board often comes up again through another order of
+    // placements; within one run the rest of the count only depends on
+    // (board, remaining depth). Counts are stored +1 so zero means empty.
+    uint64_t key = board.getHash() ^ ZOBRIST.depth[depth];
+    uint64_t cached;
+    if (perftTable.probe(key, cached))
+        return cached - 1;
+
+    uint64_t nodes = 0;
+    for (const Placement &p : locks)
+    {
+        Board child = applyPlacement(board, sequence[index], p);
+        if (child.isGameOver())
+            continue; // Game::run stops here, nothing deeper is reachable
+        nodes += perft(child, sequence, index + 1, depth - 1);
+    }
+    perftTable.store(key, nodes + 1);
+    return nodes;
+}
+
+// Splits the root moves across `threads` workers
+uint64_t perftParallel(const Board &board, const vector<int> &sequence, int depth, int threads)
+{
+    if (threads <= 1 || depth <= 1)
+        return perft(board, sequence, 0, depth);
+
+    vector<Placement> roots;
+    enumerateLocks(board, sequence[0], roots);
+
+    atomic<size_t> nextRoot(0);
+    atomic<uint64_t> nodes(0);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&]
+                             {
+            uint64_t local = 0;
+            for (size_t i = nextRoot++; i < roots.size(); i = nextRoot++)
+            {
+                Board child = applyPlacement(board, sequence[0], roots[i]);
+                if (!child.isGameOver())
+                    local += perft(child, sequence, 1, depth - 1);
+            }
+            nodes += local; });
+    }
+    for (thread &w : workers)
+        w.join();
+    return nodes;
+}
+
+// Fixture format: BOARD_HEIGHT rows of BOARD_WIDTH characters ('.' empty, 'X'
+// or any other character filled), optionally followed by known answers:
+//     expect <sequence> <depth> <nodes>
+// Lines starting with '#' are comments.
+struct PerftExpectation
+{
+    string sequence;
+    int depth;
+    uint64_t nodes;
+};
+
+bool loadPerftFixture(const string &path, Board &board, vector<PerftExpectation> &expected)
+{
+    ifstream file(path);
+    if (!file.is_open())
+    {
+        cerr << "perft: cannot open " << path << "\n";
+        return false;
+    }
+    int row = 0;
+    string line;
+    while (getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line.compare(0, 7, "expect ") == 0)
+        {
+            PerftExpectation e;
+            istringstream in(line.substr(7));
+            if (!(in >> e.sequence >> e.depth >> e.nodes))
+            {
+                cerr << "perft: bad expectation '" << line << "'\n";
+                return false;
+            }
+            expected.push_back(e);
+            continue;
+        }
+        if (row >= BOARD_HEIGHT || (int)line.size() != BOARD_WIDTH)
+        {
+            cerr << "perft: " << path << " must have " << BOARD_HEIGHT << " rows of " << BOARD_WIDTH << " cells\n";
+            return false;
+        }
+        for (int c = 0; c < BOARD_WIDTH; c++)
+            board.setCell(row, c, line[c] == '.' ? 0 : 8);
+        row++;
+    }
+    if (row != BOARD_HEIGHT)
+    {
+        cerr << "perft: " << path << " has " << row << " board rows, expected " << BOARD_HEIGHT << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool parsePieceSequence(const string &letters, vector<int> &sequence)
+{
+    for (char ch : letters)
+    {
+        int type = pieceTypeFromLetter(ch);
+        if (type < 0)
+        {
+            cerr << "perft: unknown piece '" << ch << "' (use " << PIECE_LETTERS << ")\n";
+            return false;
+        }
+        sequence.push_back(type);
+    }
+    return true;
+}
+
+// Runs one count and prints nodes and nodes/sec; returns the node count
+uint64_t reportPerft(const Board &board, const string &letters, int depth, int threads)
+{
+    vector<int> sequence;
+    parsePieceSequence(letters, sequence);
+    perftTable.clear();
+    auto start = chrono::steady_clock::now();
+    uint64_t nodes = perftParallel(board, sequence, depth, threads);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "perft " << letters << " depth " << depth << ": " << nodes << " nodes in "
+         << (uint64_t)(seconds * 1000.0) << " ms (" << (uint64_t)(nodes / max(seconds, 1e-9))
+         << " nodes/sec, " << threads << " thread" << (threads == 1 ? "" : "s") << ")\n";
+    if (perftTable.enabled())
+        cout << "  " << perftTable.summary("perft") << "\n";
+    return nodes;
+}
+
+// Usage: --perft <fixture> [<sequence> <depth>] [--threads N] [--tt-mb N]
+// Without a sequence, checks every "expect" line of the fixture.
+// --tt-mb caches subtree counts in a transposition table (off by default,
+// so the plain count stays the reference).
+int runPerft(int argc, char *argv[])
+{
+    vector<string> args;
+    int threads = max(1u, thread::hardware_concurrency());
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else if (arg == "--tt-mb" && i + 1 < argc)
+            perftTable.resize((size_t)max(0, atoi(argv[++i])));
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 1 && args.size() != 3)
+    {
+        cerr << "usage: " << argv[0] << " --perft <fixture> [<sequence> <depth>] [--threads N] [--tt-mb N]\n";
+        return 2;
+    }
+
+    Board board;
+    vector<PerftExpectation> expected;
+    if (!loadPerftFixture(args[0], board, expected))
+        return 2;
+
+    if (args.size() == 3)
+    {
+        vector<int> sequence;
+        int depth = atoi(args[2].c_str());
+        if (!parsePieceSequence(args[1], sequence))
+            return 2;
+        if (depth < 1 || depth > (int)sequence.size() || depth > MAX_SEARCH_DEPTH)
+        {
+            cerr << "perft: depth must be between 1 and the sequence length (at most " << MAX_SEARCH_DEPTH << ")\n";
+            return 2;
+        }
+        reportPerft(board, args[1], depth, threads);
+        return 0;
+    }
+
+    int failures = 0;
+    for (const PerftExpectation &e : expected)
+    {
+        vector<int> sequence;
+        if (!parsePieceSequence(e.sequence, sequence) || e.depth < 1 || e.depth > (int)sequence.size() ||
+            e.depth > MAX_SEARCH_DEPTH)
+            return 2;
+        uint64_t nodes = reportPerft(board, e.sequence, e.depth, threads);
+        if (nodes != e.nodes)
+        {
+            cout << "  MISMATCH: expected " << e.nodes << "\n";
+            failures++;
+        }
+    }
+    cout << (failures ? "FAILED: " : "OK: ") << expected.size() - failures << "/" << expected.size()
+         << " known answers match\n";
+    return failures ? 1 : 0;
+}
+
+// Plays nextAutoplayMove from `from` by Game's rules (a shift or turn that
+// doesn't fit is ignored, a soft drop on the ground locks) until the piece
+// locks. False if that takes more keys than there are poses.
+bool walkAutoplay(const Board &board, int type, Placement from, const Placement &target, Placement &locked)
+{
+    for (int keys = 0; keys < MAX_PIECE_POSES; keys++)
+    {
+        Placement n = from;
+        switch (nextAutoplayMove(board, type, from, target))
+        {
+        case AUTOPLAY_LEFT:
+            n.col--;
+            break;
+        case AUTOPLAY_RIGHT:
+            n.col++;
+            break;
+        case AUTOPLAY_DOWN:
+            n.row++;
+            break;
+        case AUTOPLAY_ROTATE:
+            n.rotation = (n.rotation + 1) & 3;
+            break;
+        case AUTOPLAY_HARD_DROP:
+            from.row += board.dropDistance(pieceRotation(type, from.rotation), from.row, from.col);
+            locked = from;
+            return true;
+        }
+        if (board.canPlace(pieceRotation(type, n.rotation), n.row, n.col))
+            from = n;
+        else if (n.row != from.row)
+        {
+            locked = from;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Usage: --autoplay-check <fixture>...
+// Walks autoplay's keys on perft fixtures. From the spawn, every lock of
+// every piece must be reached and the piece locked there. Then from every
+// lock, as if gravity had already pulled the piece down there, toward every
+// other lock: most are above it or behind the stack, so the way is blocked,
+// and the piece must lock where it is. It may only end up on the target
+// after a walk of legal keys.
+int runAutoplayCheck(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " --autoplay-check <fixture>...\n";
+        return 2;
+    }
+    auto same = [](const Placement &a, const Placement &b)
+    { return a.row == b.row && a.col == b.col && a.rotation == b.rotation; };
+
+    int failures = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        Board board;
+        vector<PerftExpectation> expected;
+        if (!loadPerftFixture(argv[i], board, expected))
+            return 2;
+        uint64_t walks = 0, reached = 0, blocked = 0;
+        for (int type = 0; type < 7; type++)
+        {
+            vector<Placement> locks;
+            enumerateLocks(board, type, locks);
+            Placement spawn = {0, BOARD_WIDTH / 2 - 2, 0}, locked;
+            for (const Placement &target : locks)
+            {
+                walks++;
+                if (!walkAutoplay(board, type, spawn, target, locked) || !same(locked, target))
+                {
+                    cout << "  " << PIECE_LETTERS[type] << " from the spawn to (" << target.row << ", "
+                         << target.col << ", " << target.rotation << ") missed\n";
+                    failures++;
+                }
+            }
+            for (const Placement &from : locks)
+            {
+                for (const Placement &target : locks)
+                {
+                    if (same(from, target))
+                        continue;
+                    walks++;
+                    bool ended = walkAutoplay(board, type, from, target, locked);
+                    if (ended && same(locked, target))
+                        reached++;
+                    else if (ended && same(locked, from))
+                        blocked++;
+                    else
+                    {
+                        cout << "  " << PIECE_LETTERS[type] << " from (" << from.row << ", " << from.col << ", "
+                             << from.rotation << ") to (" << target.row << ", " << target.col << ", "
+                             << target.rotation << ") locked elsewhere\n";
+                        failures++;
+                    }
+                }
+            }
+        }
+        cout << argv[i] << ": " << walks << " walks, " << reached << " reached from below, " << blocked
+             << " blocked and dropped in place\n";
+        if (blocked == 0)
+        {
+            cout << "  no walk was blocked, so the fixture tests nothing\n";
+            failures++;
+        }
+    }
+    cout << (failures ? "FAILED: " : "OK: ") << failures << " bad walks\n";
+    return failures ? 1 : 0;
+}
+
+/**************************************************************
+ * 8) Placement oracle: a local daemon answering "best placement
+ *    here?" over a Unix-domain socket. Requests from all
+ *    clients are gathered into batches and evaluated on a
+ *    worker pool with the same enumerateLocks/place/clearLines
+ *    rules the game and perft use.
+ **************************************************************/
+
+// Fixed pool of threads that run one index range at a time; the calling
+// thread takes part, so a pool of N uses N-1 extra threads.
+class WorkerPool
+{
+private:
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake, finished;
+    const function<void(size_t)> *task = nullptr;
+    size_t count = 0;
+    atomic<size_t> nextIndex{0};
+    int busy = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void drain()
+    {
+        for (size_t i = nextIndex++; i < count; i = nextIndex++)
+            (*task)(i);
+    }
+
+    void workerLoop()
+    {
+        uint64_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            wake.wait(guard, [&]
+                      { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            guard.unlock();
+            drain();
+            guard.lock();
+            if (--busy == 0)
+                finished.notify_one();
+        }
+    }
+
+public:
+    explicit WorkerPool(int threads)
+    {
+        for (int i = 1; i < threads; i++)
+            workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread &w : workers)
+            w.join();
+    }
+
+    int size() const { return (int)workers.size() + 1; }
+
+    // Calls fn(i) for every i in [0, n) and returns when all calls are done
+    void parallelFor(size_t n, const function<void(size_t)> &fn)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            task = &fn;
+            count = n;
+            nextIndex = 0;
+            busy = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        drain();
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [&]
+                      { return busy == 0; });
+    }
+};
+
+// Wire format, host byte order (the oracle only listens locally).
+// A client may pipeline any number of requests; responses come back
+// in the order the client sent them.
+const int ORACLE_MAX_QUEUE = 6;
+
+struct OracleRequest
+{
+    uint32_t id;                     // echoed in the response
+    uint8_t pieceCount;              // 1..ORACLE_MAX_QUEUE
+    uint8_t pieces[ORACLE_MAX_QUEUE]; // piece types in PIECE_LETTERS order; [0] is the current piece
+    uint8_t reserved;
+    uint8_t cells[PACKED_BOARD_BYTES]; // any non-zero cell is filled
+};
+static_assert(sizeof(OracleRequest) == 112, "OracleRequest is part of the wire format");
+
+enum OracleStatus
+{
+    ORACLE_OK = 0,
+    ORACLE_NO_PLACEMENT = 1, // every placement tops out (or the spawn is blocked)
+    ORACLE_BAD_REQUEST = 2
+};
+
+struct OracleResponse
+{
+    uint32_t id;
+    uint8_t status; // OracleStatus
+    uint8_t rotation; // rotateCW() turns from the spawn orientation
+    int8_t row, col;  // Board::place() origin of the piece's 4x4 box
+    float score;      // searchPlacement() value of the best line found
+    uint8_t lines;    // lines cleared by this placement itself
+    uint8_t reserved[3];
+};
+static_assert(sizeof(OracleResponse) == 16, "OracleResponse is part of the wire format");
+
+// Linear board evaluation over four classic features; weights from a
+// published genetic-algorithm tuning for 10x20 Tetris. The lines term is
+// added per placement by searchPlacement, so it is not part of this.
+const double LINE_WEIGHT = 0.760666;
+
+double evaluateBoard(const Board &board)
+{
+    const BoardMetrics &m = board.metrics();
+    return -0.510066 * m.aggregateHeight - 0.35663 * m.holes - 0.184483 * m.bumpiness;
+}
+
+// searchTable key: board plus every piece the search will place
+uint64_t searchKey(const Board &board, const uint8_t *pieces, int depth)
+{
+    uint64_t key = board.getHash() ^ ZOBRIST.piece[pieces[0]] ^ ZOBRIST.depth[depth];
+    for (int i = 1; i < depth; i++)
+    {
+        uint64_t k = ZOBRIST.next[pieces[i]];
+        key ^= (k << (8 * i)) | (k >> (64 - 8 * i));
+    }
+    return key;
+}
+
+// searchTable data: float score, placement and its line count; bit 63
+// keeps it non-zero
+uint64_t packSearchResult(float score, const Placement &p, int lines)
+{
+    uint32_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    return bits | (uint64_t)p.rotation << 32 | (uint64_t)p.row << 34 | (uint64_t)(p.col + 3) << 39 |
+           (uint64_t)lines << 43 | 1ull << 63;
+}
+
+float unpackSearchResult(uint64_t data, Placement &p, int &lines)
+{
+    uint32_t bits = (uint32_t)data;
+    float score;
+    memcpy(&score, &bits, sizeof(score));
+    p.rotation = (int)(data >> 32) & 3;
+    p.row = (int)(data >> 34) & 31;
+    p.col = (int)((data >> 39) & 15) - 3;
+    lines = (int)(data >> 43) & 7;
+    return score;
+}
+
+// Best value reachable by placing pieces[0..depth) in order: evaluateBoard
+// of the final board plus LINE_WEIGHT per cleared line. Fills the first
+// placement and its line count. Returns -infinity if all top out, leaving
+// *best and *bestLines as they were, since no placement survives. Results
+// are rounded to float so a searchTable hit returns exactly what a fresh
+// search would.
+double searchPlacement(const Board &board, const uint8_t *pieces, int depth,
+                       Placement *best, int *bestLines)
+{
+    uint64_t key = searchKey(board, pieces, depth);
+    uint64_t cached;
+    Placement bestPlacement = {0, 0, 0};
+    int linesOfBest = 0;
+    if (searchTable.probe(key, cached))
+    {
+        float score = unpackSearchResult(cached, bestPlacement, linesOfBest);
+        if (best && score != -HUGE_VAL)
+            *best = bestPlacement;
+        if (bestLines && score != -HUGE_VAL)
+            *bestLines = linesOfBest;
+        return score;
+    }
+
+    double bestScore = -HUGE_VAL;
+    vector<Placement> locks;
+    enumerateLocks(board, pieces[0], locks);
+    for (const Placement &p : locks)
+    {
+        Board child = board;
+        child.place(pieceRotation(pieces[0], p.rotation), p.row, p.col);
+        int lines = child.clearLines();
+        if (child.isGameOver())
+            continue; // Game::run ends the game here
+        double score = LINE_WEIGHT * lines + (depth == 1 ? evaluateBoard(child)
+                                                         : searchPlacement(child, pieces + 1, depth - 1, nullptr, nullptr));
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestPlacement = p;
+            linesOfBest = lines;
+        }
+    }
+    bestScore = (float)bestScore;
+    searchTable.store(key, packSearchResult((float)bestScore, bestPlacement, linesOfBest));
+    if (best && bestScore != -HUGE_VAL)
+        *best = bestPlacement;
+    if (bestLines && bestScore != -HUGE_VAL)
+        *bestLines = linesOfBest;
+    return bestScore;
+}
+
+// Opening book file (built by --book, section 8b): a header, then an
+// open-addressed hash table of BookEntry slots, host byte order. It is
+// mapped read-only and used in place, so loading costs one mmap and every
+// process using the same book shares its pages through the page cache.
+const char BOOK_MAGIC[8] = {'T', 'B', 'O', 'O', 'K', 0, 0, 0};
+const uint32_t BOOK_VERSION = 1;
+
+struct BookHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t depth; // searchPlacement() depth the answers come from
+    uint64_t slots; // a power of two
+    uint64_t entries;
+};
+static_assert(sizeof(BookHeader) == 32, "BookHeader is part of the book format");
+
+struct BookEntry
+{
+    uint64_t key; // bookKey(); 0 marks an empty slot
+    float score;  // searchPlacement() value of the placement
+    uint8_t rotation;
+    int8_t row, col;
+    uint8_t lines; // cleared by the placement itself
+};
+static_assert(sizeof(BookEntry) == 16, "BookEntry is part of the book format");
+
+// Board, current piece and next piece (never 0)
+uint64_t bookKey(const Board &board, int current, int next)
+{
+    uint8_t pieces[2] = {(uint8_t)current, (uint8_t)next};
+    uint64_t key = searchKey(board, pieces, 2);
+    return key ? key : 1;
+}
+
+class OpeningBook
+{
+private:
+    const uint8_t *map = nullptr;
+    size_t length = 0;
+    const BookHeader *header = nullptr;
+    const BookEntry *slots = nullptr;
+    mutable atomic<uint64_t> lookups{0}, hits{0};
+
+public:
+    OpeningBook() = default;
+    OpeningBook(const OpeningBook &) = delete;
+    OpeningBook &operator=(const OpeningBook &) = delete;
+    ~OpeningBook() { close(); }
+
+    // Maps the book and checks its header and size; nothing else is read
+    bool open(const string &path, string &error)
+    {
+        close();
+#ifdef _WIN32
+        error = "opening books need mmap, which this build doesn't use";
+        return false;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            error = path + ": " + strerror(errno);
+            return false;
+        }
+        struct stat st;
+        void *mapped = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(BookHeader))
+            mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            error = path + ": not a book";
+            return false;
+        }
+        map = static_cast<const uint8_t *>(mapped);
+        length = (size_t)st.st_size;
+        header = reinterpret_cast<const BookHeader *>(map);
+        if (memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) != 0 || header->version != BOOK_VERSION ||
+            header->slots == 0 || (header->slots & (header->slots - 1)) != 0 ||
+            length != sizeof(BookHeader) + header->slots * sizeof(BookEntry))
+        {
+            error = path + ": not a book, or a different version";
+            close();
+            return false;
+        }
+        slots = reinterpret_cast<const BookEntry *>(map + sizeof(BookHeader));
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (map)
+            munmap(const_cast<uint8_t *>(map), length);
+#endif
+        map = nullptr;
+        header = nullptr;
+        slots = nullptr;
+    }
+
+    bool isOpen() const { return map != nullptr; }
+    int depth() const { return header ? (int)header->depth : 0; }
+    uint64_t size() const { return header ? header->entries : 0; }
+
+    // The book's answer for placing pieces[0] with pieces[1] next, as long
+    // as it is exactly what a `searchDepth` search would answer: the book
+    // must have been built at that depth.
+    bool lookup(const Board &board, const uint8_t *pieces, int count, int searchDepth, BookEntry &entry) const
+    {
+        if (!map || count < 2 || searchDepth != (int)header->depth)
+            return false;
+        lookups.fetch_add(1, memory_order_relaxed);
+        uint64_t key = bookKey(board, pieces[0], pieces[1]);
+        uint64_t mask = header->slots - 1;
+        for (uint64_t i = key & mask;; i = (i + 1) & mask)
+        {
+            if (slots[i].key == 0)
+                return false;
+            if (slots[i].key == key)
+            {
+                entry = slots[i];
+                hits.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    string summary() const
+    {
+        uint64_t n = lookups.load(memory_order_relaxed), h = hits.load(memory_order_relaxed);
+        ostringstream out;
+        out << "opening book: " << size() << " positions, " << n << " lookups, "
+            << (n ? 100.0 * h / n : 0.0) << "% hits";
+        return out.str();
+    }
+};
+
+// Loaded with --book by the oracle and self-play
+OpeningBook openingBook;
+
+OracleResponse answerOracle(const OracleRequest &request, int maxDepth)
+{
+    OracleResponse response;
+    memset(&response, 0, sizeof(response));
+    response.id = request.id;
+    response.status = ORACLE_BAD_REQUEST;
+    if (request.pieceCount < 1 || request.pieceCount > ORACLE_MAX_QUEUE)
+        return response;
+    for (int i = 0; i < request.pieceCount; i++)
+        if (request.pieces[i] >= 7)
+            return response;
+    Board board;
+    board.unpack(request.cells, 15);
+
+    // An opening position is answered from the book without searching
+    int depth = min<int>(request.pieceCount, maxDepth);
+    BookEntry known;
+    if (openingBook.lookup(board, request.pieces, request.pieceCount, depth, known))
+    {
+        response.status = ORACLE_OK;
+        response.rotation = known.rotation;
+        response.row = known.row;
+        response.col = known.col;
+        response.score = known.score;
+        response.lines = known.lines;
+        return response;
+    }
+
+    Placement best = {0, 0, 0};
+    int lines = 0;
+    double score = searchPlacement(board, request.pieces, depth, &best, &lines);
+    if (score == -HUGE_VAL)
+    {
+        response.status = ORACLE_NO_PLACEMENT;
+        return response;
+    }
+    response.status = ORACLE_OK;
+    response.rotation = (uint8_t)best.rotation;
+    response.row = (int8_t)best.row;
+    response.col = (int8_t)best.col;
+    response.score = (float)score;
+    response.lines = (uint8_t)lines;
+    return response;
+}
+
+#ifndef _WIN32
+struct OracleClient
+{
+    int fd;
+    string input; // bytes of a request not yet complete
+
+    explicit OracleClient(int f) : fd(f) {}
+    ~OracleClient() { close(fd); } // last reference gone: no batch still writes to it
+};
+
+struct OracleJob
+{
+    shared_ptr<OracleClient> client;
+    OracleRequest request;
+    OracleResponse response;
+    chrono::steady_clock::time_point received;
+};
+
+struct OracleOptions
+{
+    string socketPath;
+    size_t batchSize = 64;   // evaluate once this many requests are waiting...
+    int maxWaitUs = 2000;    // ...or once the oldest has waited this long
+    int threads = max(1u, thread::hardware_concurrency());
+    int depth = 2;           // pieces of the queue searched ahead
+    int tableMb = 64;        // searchTable size; repeated positions are answered from it
+    string bookPath;         // opening book consulted before searching
+};
+
+class PlacementOracle
+{
+private:
+    OracleOptions options;
+    mutex lock;
+    condition_variable arrived;
+    vector<OracleJob> pending;
+    bool listenerDone = false;
+
+    // Totals for the exit summary (batcher thread only)
+    LatencyHistogram latencyUs;
+    uint64_t batches = 0;
+
+    // Blocks until a batch is due; false once the listener has stopped
+    bool takeBatch(vector<OracleJob> &batch)
+    {
+        unique_lock<mutex> guard(lock);
+        arrived.wait(guard, [&]
+                     { return listenerDone || !pending.empty(); });
+        if (pending.empty())
+            return false;
+        chrono::steady_clock::time_point deadline = pending.front().received + chrono::microseconds(options.maxWaitUs);
+        arrived.wait_until(guard, deadline, [&]
+                           { return listenerDone || pending.size() >= options.batchSize; });
+        size_t n = min(pending.size(), options.batchSize);
+        batch.assign(make_move_iterator(pending.begin()), make_move_iterator(pending.begin() + n));
+        pending.erase(pending.begin(), pending.begin() + n);
+        return true;
+    }
+
+    void batchLoop()
+    {
+        WorkerPool pool(options.threads);
+        vector<OracleJob> batch;
+        string out;
+        function<void(size_t)> evaluate = [&](size_t i)
+        { batch[i].response = answerOracle(batch[i].request, options.depth); };
+
+        while (takeBatch(batch))
+        {
+            pool.parallelFor(batch.size(), evaluate);
+            batches++;
+
+            // One write per client per batch, responses in arrival order
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                if (!batch[i].client)
+                    continue;
+                shared_ptr<OracleClient> client = batch[i].client;
+                out.clear();
+                for (size_t j = i; j < batch.size(); j++)
+                {
+                    if (batch[j].client != client)
+                        continue;
+                    out.append(reinterpret_cast<const char *>(&batch[j].response), sizeof(OracleResponse));
+                    latencyUs.record((uint64_t)chrono::duration_cast<chrono::microseconds>(
+                                         chrono::steady_clock::now() - batch[j].received)
+                                         .count());
+                    batch[j].client.reset();
+                }
+                for (size_t sent = 0; sent < out.size();)
+                {
+                    ssize_t n = send(client->fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0)
+                        break; // client went away; the listener drops it
+                    sent += (size_t)n;
+                }
+            }
+        }
+    }
+
+    // Moves every complete request of a client into the pending queue
+    void queueRequests(const shared_ptr<OracleClient> &client, chrono::steady_clock::time_point now)
+    {
+        size_t complete = client->input.size() / sizeof(OracleRequest);
+        if (complete == 0)
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            for (size_t i = 0; i < complete; i++)
+            {
+                OracleJob job;
+                job.client = client;
+                memcpy(&job.request, client->input.data() + i * sizeof(OracleRequest), sizeof(OracleRequest));
+                job.received = now;
+                pending.push_back(job);
+            }
+        }
+        client->input.erase(0, complete * sizeof(OracleRequest));
+        arrived.notify_one();
+    }
+
+public:
+    explicit PlacementOracle(const OracleOptions &o) : options(o) {}
+
+    int serve()
+    {
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (options.socketPath.size() >= sizeof(address.sun_path))
+        {
+            cerr << "oracle: socket path too long\n";
+            return 2;
+        }
+        strcpy(address.sun_path, options.socketPath.c_str());
+        unlink(options.socketPath.c_str());
+        if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0)
+        {
+            perror("oracle");
+            return 1;
+        }
+        cout << "oracle: listening on " << options.socketPath << " (batch " << options.batchSize << ", max wait "
+             << options.maxWaitUs << " us, " << options.threads << " threads, depth " << options.depth << ")\n";
+
+        thread batcher(&PlacementOracle::batchLoop, this);
+        vector<shared_ptr<OracleClient>> clients;
+        vector<pollfd> fds;
+        char buffer[64 * 1024];
+        uint64_t requests = 0;
+        while (!quitRequested)
+        {
+            fds.assign(1, {listener, POLLIN, 0});
+            for (const shared_ptr<OracleClient> &c : clients)
+                fds.push_back({c->fd, POLLIN, 0});
+            if (::poll(fds.data(), fds.size(), 100) <= 0)
+                continue;
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+            vector<shared_ptr<OracleClient>> alive;
+            for (size_t i = 0; i < clients.size(); i++)
+            {
+                if (fds[i + 1].revents == 0)
+                {
+                    alive.push_back(clients[i]);
+                    continue;
+                }
+                ssize_t n = recv(clients[i]->fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    continue; // closed: queued jobs keep it alive until answered
+                clients[i]->input.append(buffer, (size_t)n);
+                requests += clients[i]->input.size() / sizeof(OracleRequest);
+                queueRequests(clients[i], now);
+                alive.push_back(clients[i]);
+            }
+            clients.swap(alive);
+
+            if (fds[0].revents & POLLIN)
+            {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0)
+                    clients.push_back(make_shared<OracleClient>(fd));
+            }
+        }
+
+        {
+            lock_guard<mutex> guard(lock);
+            listenerDone = true;
+        }
+        arrived.notify_one();
+        batcher.join();
+        clients.clear();
+        close(listener);
+        unlink(options.socketPath.c_str());
+
+        cout << "oracle: " << requests << " requests in " << batches << " batches ("
+             << (batches ? (double)requests / batches : 0.0) << " per batch), latency us p50 "
+             << latencyUs.percentile(0.50) << " p99 " << latencyUs.percentile(0.99) << " max " << latencyUs.max() << "\n";
+        if (searchTable.enabled())
+            cout << "oracle: " << searchTable.summary("search") << "\n";
+        if (openingBook.isOpen())
+            cout << "oracle: " << openingBook.summary() << "\n";
+        return 0;
+    }
+};
+#endif
+
+// Usage: --oracle <socket> [--batch N] [--max-wait-us N] [--threads N] [--depth N] [--tt-mb N] [--book FILE]
+int runOracle(int argc, char *argv[])
+{
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    cerr << "oracle: Unix-domain sockets are not supported on this platform\n";
+    return 2;
+#else
+    OracleOptions options;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc)
+            options.batchSize = (size_t)max(1, atoi(argv[++i]));
+        else if (arg == "--max-wait-us" && i + 1 < argc)
+            options.maxWaitUs = max(0, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--depth" && i + 1 < argc)
+            options.depth = min(ORACLE_MAX_QUEUE, max(1, atoi(argv[++i])));
+        else if (arg == "--tt-mb" && i + 1 < argc)
+            options.tableMb = max(0, atoi(argv[++i]));
+        else if (arg == "--book" && i + 1 < argc)
+            options.bookPath = argv[++i];
+        else if (options.socketPath.empty())
+            options.socketPath = arg;
+        else
+        {
+            options.socketPath.clear();
+            break;
+        }
+    }
+    if (options.socketPath.empty())
+    {
+        cerr << "usage: " << argv[0]
+             << " --oracle <socket> [--batch N] [--max-wait-us N] [--threads N] [--depth N] [--tt-mb N] [--book FILE]\n";
+        return 2;
+    }
+    string error;
+    if (!options.bookPath.empty() && !openingBook.open(options.bookPath, error))
+    {
+        cerr << "oracle: " << error << "\n";
+        return 2;
+    }
+    if (openingBook.isOpen() && openingBook.depth() != options.depth)
+        cerr << "oracle: the book was built at depth " << openingBook.depth() << ", not " << options.depth
+             << "; only requests searched that deep will use it\n";
+    searchTable.resize((size_t)options.tableMb);
+    signal(SIGTERM, requestQuit);
+    signal(SIGINT, requestQuit);
+    PlacementOracle oracle(options);
+    return oracle.serve();
+#endif
+}
+
+/**************************************************************
+ * 8b) Opening book: the first pieces of a game, searched
+ *     offline. --book plays many openings with the oracle's
+ *     policy (plus a few random placements, so positions just
+ *     off the policy are covered too) and stores the best
+ *     placement for every (board, current piece, next piece)
+ *     met on the way. The oracle and self-play map the file
+ *     (OpeningBook, above) and look a position up in O(1)
+ *     before searching; a book answer is exactly what the live
+ *     search would return, only without the search.
+ **************************************************************/
+struct BookOptions
+{
+    string path;
+    uint32_t games = 20000;
+    int pieces = 12;       // placements per opening
+    int depth = 2;         // searchPlacement() depth of the answers
+    double epsilon = 0.05; // chance of a random placement instead of the best
+    uint64_t seed = 1;
+    int threads = max(1u, thread::hardware_concurrency());
+    int tableMb = 64; // searchTable size
+};
+
+// One opening: appends the book entry of every position it reaches. Pieces
+// and exploration come from the game number, as in playSelfPlayGame().
+void playBookOpening(uint32_t game, const BookOptions &options, vector<BookEntry> &out)
+{
+    PieceRandom pieces(options.seed * 0x9E3779B97F4A7C15ull + game);
+    PieceRandom policy(~(options.seed * 0xD1B54A32D192ED03ull + game));
+    Board board;
+    int current = pieces.nextType();
+    int next = pieces.nextType();
+    vector<Placement> locks;
+
+    for (int n = 0; n < options.pieces; n++)
+    {
+        uint8_t queue[2] = {(uint8_t)current, (uint8_t)next};
+        Placement best = {0, 0, 0};
+        int lines = 0;
+        double score = searchPlacement(board, queue, options.depth, &best, &lines);
+        if (score == -HUGE_VAL)
+            break; // every placement tops out
+        BookEntry entry = {bookKey(board, current, next), (float)score, (uint8_t)best.rotation,
+                           (int8_t)best.row, (int8_t)best.col, (uint8_t)lines};
+        out.push_back(entry);
+
+        Placement chosen = best;
+        if ((policy.next() >> 11) * (1.0 / 9007199254740992.0) < options.epsilon)
+        {
+            locks.clear();
+            enumerateLocks(board, current, locks);
+            chosen = locks[policy.next() % locks.size()];
+        }
+        board.place(pieceRotation(current, chosen.rotation), chosen.row, chosen.col);
+        board.clearLines();
+        if (board.isGameOver())
+            break;
+        current = next;
+        next = pieces.nextType();
+    }
+}
+
+// Writes the entries as a hash table at most half full (so a probe always
+// ends at an empty slot), to a temporary file renamed over `path`: a
+// process that has the old book mapped keeps reading the old one.
+bool writeBook(const string &path, vector<BookEntry> &entries, int depth, uint64_t &bytes)
+{
+    sort(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b)
+         { return a.key < b.key; });
+    entries.erase(unique(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b)
+                         { return a.key == b.key; }),
+                  entries.end());
+
+    BookHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+    header.version = BOOK_VERSION;
+    header.depth = (uint32_t)depth;
+    header.slots = 16;
+    while (header.slots < entries.size() * 2)
+        header.slots *= 2;
+    header.entries = entries.size();
+
+    vector<BookEntry> table(header.slots);
+    memset(table.data(), 0, table.size() * sizeof(BookEntry));
+    for (const BookEntry &e : entries)
+    {
+        uint64_t i = e.key & (header.slots - 1);
+        while (table[i].key != 0)
+            i = (i + 1) & (header.slots - 1);
+        table[i] = e;
+    }
+
+    string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(BookEntry));
+    file.close();
+    if (!file || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    bytes = sizeof(header) + table.size() * sizeof(BookEntry);
+    return true;
+}
+
+// Usage: --book <file> [--games N] [--pieces N] [--depth 1|2] [--epsilon E] [--seed N] [--threads N]
+//        [--tt-mb N]
+int runBook(int argc, char *argv[])
+{
+    BookOptions options;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--games" && i + 1 < argc)
+            options.games = (uint32_t)max(1, atoi(argv[++i]));
+        else if (arg == "--pieces" && i + 1 < argc)
+            options.pieces = max(1, atoi(argv[++i]));
+        else if (arg == "--depth" && i + 1 < argc)
+            options.depth = min(2, max(1, atoi(argv[++i])));
+        else if (arg == "--epsilon" && i + 1 < argc)
+            options.epsilon = atof(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--tt-mb" && i + 1 < argc)
+            options.tableMb = max(0, atoi(argv[++i]));
+        else if (options.path.empty())
+            options.path = arg;
+        else
+        {
+            options.path.clear();
+            break;
+        }
+    }
+    if (options.path.empty())
+    {
+        cerr << "usage: " << argv[0]
+             << " --book <file> [--games N] [--pieces N] [--depth 1|2] [--epsilon E] [--seed N] [--threads N]"
+                " [--tt-mb N]\n";
+        return 2;
+    }
+    searchTable.resize((size_t)options.tableMb);
+
+    auto start = chrono::steady_clock::now();
+    vector<vector<BookEntry>> found(options.games);
+    WorkerPool pool(options.threads);
+    pool.parallelFor(options.games, [&](size_t g)
+                     { playBookOpening((uint32_t)g, options, found[g]); });
+    vector<BookEntry> entries;
+    for (vector<BookEntry> &f : found)
+        entries.insert(entries.end(), f.begin(), f.end());
+    size_t positions = entries.size();
+    uint64_t bytes = 0;
+    if (!writeBook(options.path, entries, options.depth, bytes))
+    {
+        cerr << "book: cannot write " << options.path << "\n";
+        return 1;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "book: " << entries.size() << " distinct positions (of " << positions << " met) from " << options.games
+         << " openings of " << options.pieces << " pieces in " << (uint64_t)(seconds * 1000.0) << " ms, depth "
+         << options.depth << "; " << bytes / 1024 << " KB\n";
+    if (searchTable.enabled())
+        cout << "book: " << searchTable.summary("search") << "\n";
+    return 0;
+}
+
+// Usage: --book-check <file> [--games N] [--seed N]
+// Plays openings the book wasn't built from, following the book where it
+// has the position and searching where it doesn't. Every hit is searched
+// as well and must give the same answer; prints the hit rate per piece
+// and what a lookup costs next to a search.
+int runBookCheck(int argc, char *argv[])
+{
+    string path;
+    uint32_t games = 1000;
+    uint64_t seed = 2;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--games" && i + 1 < argc)
+            games = (uint32_t)max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else
+            path = arg;
+    }
+    if (path.empty())
+    {
+        cerr << "usage: " << argv[0] << " --book-check <file> [--games N] [--seed N]\n";
+        return 2;
+    }
+
+    string error;
+    auto openStart = chrono::steady_clock::now();
+    if (!openingBook.open(path, error))
+    {
+        cerr << "book: " << error << "\n";
+        return 2;
+    }
+    double openUs = chrono::duration<double, micro>(chrono::steady_clock::now() - openStart).count();
+    int depth = openingBook.depth();
+
+    const int PLIES = 20;
+    uint64_t reached[PLIES] = {}, found[PLIES] = {};
+    uint64_t mismatches = 0;
+    double lookupNs = 0, searchNs = 0;
+    for (uint32_t g = 0; g < games; g++)
+    {
+        PieceRandom pieces(seed * 0x9E3779B97F4A7C15ull + g);
+        Board board;
+        int current = pieces.nextType();
+        int next = pieces.nextType();
+        for (int n = 0; n < PLIES; n++)
+        {
+            uint8_t queue[2] = {(uint8_t)current, (uint8_t)next};
+            BookEntry known = {};
+            auto t0 = chrono::steady_clock::now();
+            bool hit = openingBook.lookup(board, queue, 2, depth, known);
+            auto t1 = chrono::steady_clock::now();
+            Placement best = {0, 0, 0};
+            int lines = 0;
+            double score = searchPlacement(board, queue, depth, &best, &lines);
+            auto t2 = chrono::steady_clock::now();
+            lookupNs += chrono::duration<double, nano>(t1 - t0).count();
+            searchNs += chrono::duration<double, nano>(t2 - t1).count();
+            if (score == -HUGE_VAL)
+                break;
+            reached[n]++;
+            if (hit)
+            {
+                found[n]++;
+                if (known.rotation != best.rotation || known.row != best.row || known.col != best.col ||
+                    known.score != (float)score || known.lines != lines)
+                    mismatches++;
+            }
+            board.place(pieceRotation(current, best.rotation), best.row, best.col);
+            board.clearLines();
+            if (board.isGameOver())
+                break;
+            current = next;
+            next = pieces.nextType();
+        }
+    }
+
+    uint64_t total = 0;
+    for (int n = 0; n < PLIES; n++)
+        total += reached[n];
+    cout << "book: " << openingBook.size() << " positions at depth " << depth << ", mapped in " << (uint64_t)openUs
+         << " us\n";
+    cout << "  hits by piece:";
+    for (int n = 0; n < PLIES && reached[n]; n++)
+        cout << " " << (int)(100.0 * found[n] / reached[n]) << "%";
+    cout << "\n  lookup " << (uint64_t)(lookupNs / max<uint64_t>(total, 1)) << " ns, search "
+         << (uint64_t)(searchNs / max<uint64_t>(total, 1) / 1000) << " us per position\n";
+    cout << (mismatches ? "FAILED: " : "OK: ") << mismatches << " book answers differ from the search\n";
+    return mismatches ? 1 : 0;
+}
+
+/**************************************************************
+ * 9) Self-play export: headless games on every core, streamed
+ *    as training samples into per-thread shard files.
+ *
+ *    A shard is a sequence of fixed-size blocks, each holding
+ *    SELFPLAY_BLOCK samples stored column by column, so a reader
+ *    can mmap the file and take any column of any block at a
+ *    computed offset. Blocks are appended with one large write
+ *    each; every thread owns its shard, so writers never share
+ *    a lock or a file.
+ **************************************************************/
+const char SELFPLAY_MAGIC[8] = {'T', 'T', 'R', 'A', 'I', 'N', 0, 0};
+const uint32_t SELFPLAY_VERSION = 1;
+const uint32_t SELFPLAY_BLOCK = 16384; // samples per block (a multiple of 8 keeps columns aligned)
+
+// Points per lock and per line clear, as in Tetris.cpp's TetrisGame::updateGame
+const int PLACE_REWARD = 250;
+const int LINE_REWARD[5] = {0, 1000, 2000, 3000, 5000}; // x level
+
+struct SelfPlayBlockHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity; // samples the block has room for (SELFPLAY_BLOCK)
+    uint32_t count;    // samples actually stored; the rest is zero
+    uint32_t shard;
+    uint8_t reserved[40];
+};
+static_assert(sizeof(SelfPlayBlockHeader) == 64, "SelfPlayBlockHeader is part of the file format");
+
+// Column layout after the header, for capacity C:
+//   int32  reward[C]   points for this placement
+//   uint32 game[C]     game number, shared by all samples of one game
+//   uint8  board[C][PACKED_BOARD_BYTES]   board before the placement
+//   uint8  piece[C], next[C]              current/next type (PIECE_LETTERS order)
+//   uint8  rotation[C]; int8 row[C], col[C]   chosen placement
+//   uint8  lines[C]    lines it cleared
+//   uint8  done[C]     1 on the last sample of a game
+const size_t SELFPLAY_SAMPLE_BYTES = 4 + 4 + PACKED_BOARD_BYTES + 7;
+
+class ShardWriter
+{
+private:
+    ofstream file;
+    vector<uint8_t> block;
+    uint32_t count = 0;
+    uint32_t shard;
+    uint64_t written = 0;
+
+    uint8_t *column(size_t offset) { return block.data() + sizeof(SelfPlayBlockHeader) + offset * SELFPLAY_BLOCK; }
+
+public:
+    ShardWriter(const string &path, uint32_t shardIndex)
+        : file(path, ios::binary | ios::trunc),
+          block(sizeof(SelfPlayBlockHeader) + SELFPLAY_SAMPLE_BYTES * SELFPLAY_BLOCK, 0), shard(shardIndex) {}
+
+    bool isOpen() const { return file.is_open(); }
+    bool good() const { return file.good(); } // false once a write has failed (disk full, I/O error)
+    uint64_t samples() const { return written + count; }
+
+    void add(const Board &board, int piece, int next, const Placement &p, int lines, bool done,
+             int reward, uint32_t game)
+    {
+        size_t i = count;
+        memcpy(column(0) + 4 * i, &reward, 4);
+        memcpy(column(4) + 4 * i, &game, 4);
+        board.pack(column(8) + PACKED_BOARD_BYTES * i);
+        size_t bytes = 8 + PACKED_BOARD_BYTES;
+        column(bytes)[i] = (uint8_t)piece;
+        column(bytes + 1)[i] = (uint8_t)next;
+        column(bytes + 2)[i] = (uint8_t)p.rotation;
+        column(bytes + 3)[i] = (uint8_t)(int8_t)p.row;
+        column(bytes + 4)[i] = (uint8_t)(int8_t)p.col;
+        column(bytes + 5)[i] = (uint8_t)lines;
+        column(bytes + 6)[i] = done ? 1 : 0;
+        if (++count == SELFPLAY_BLOCK)
+            flush();
+    }
+
+    // Appends the current block (zero-padded to full size) with one write;
+    // false if the file has failed
+    bool flush()
+    {
+        if (count == 0)
+            return file.good();
+        SelfPlayBlockHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SELFPLAY_MAGIC, sizeof(SELFPLAY_MAGIC));
+        header.version = SELFPLAY_VERSION;
+        header.capacity = SELFPLAY_BLOCK;
+        header.count = count;
+        header.shard = shard;
+        memcpy(block.data(), &header, sizeof(header));
+        file.write(reinterpret_cast<const char *>(block.data()), block.size());
+        written += count;
+        count = 0;
+        fill(block.begin(), block.end(), 0);
+        return file.good();
+    }
+
+    // Writes the last block and closes the shard; false if any write failed,
+    // so the samples counted aren't all on disk
+    bool close()
+    {
+        flush();
+        file.close();
+        return !file.fail();
+    }
+};
+
+struct SelfPlayOptions
+{
+    string directory;
+    uint32_t games = 1000;
+    int threads = max(1u, thread::hardware_concurrency());
+    uint64_t seed = 1;
+    double epsilon = 0.05; // chance of a random placement, for state diversity
+    int depth = 1;         // 2 also looks at the next piece
+    int maxPieces = 2000;  // a capped game ends with done = 1
+    int tableMb = 16;      // searchTable size
+    string bookPath;       // opening book consulted before searching
+};
+
+// Plays one game with the oracle's policy and records every placement.
+// Pieces and exploration come from the game number, so a game replays
+// identically whichever thread runs it.
+void playSelfPlayGame(uint32_t game, const SelfPlayOptions &options, ShardWriter &out)
+{
+    PieceRandom pieces(options.seed * 0x9E3779B97F4A7C15ull + game);
+    PieceRandom policy(~(options.seed * 0xD1B54A32D192ED03ull + game));
+    Board board;
+    int current = pieces.nextType();
+    int next = pieces.nextType();
+    int totalLines = 0;
+    vector<Placement> locks;
+
+    for (int n = 0; n < options.maxPieces; n++)
+    {
+        locks.clear();
+        enumerateLocks(board, current, locks);
+        if (locks.empty())
+            break;
+
+        Placement chosen = locks[0];
+        int ignoredLines = 0;
+        uint8_t queue[2] = {(uint8_t)current, (uint8_t)next};
+        BookEntry known;
+        if ((policy.next() >> 11) * (1.0 / 9007199254740992.0) < options.epsilon)
+            chosen = locks[policy.next() % locks.size()];
+        else if (openingBook.lookup(board, queue, 2, options.depth, known))
+            chosen = {known.row, known.col, known.rotation};
+        else if (searchPlacement(board, queue, options.depth, &chosen, &ignoredLines) == -HUGE_VAL)
+            chosen = locks[0]; // every line tops out: any real lock position will do
+
+        Board child = board;
+        child.place(pieceRotation(current, chosen.rotation), chosen.row, chosen.col);
+        int lines = child.clearLines();
+        totalLines += lines;
+        int level = totalLines / 2 + 1;
+        int reward = PLACE_REWARD + LINE_REWARD[lines] * level;
+
+        // The game ends when the stack reaches the top or the next spawn is blocked
+        bool done = child.isGameOver() || !child.canPlace(pieceRotation(next, 0), 0, BOARD_WIDTH / 2 - 2) ||
+                    n + 1 == options.maxPieces;
+        out.add(board, current, next, chosen, lines, done, reward, game);
+        if (done)
+            break;
+        board = child;
+        current = next;
+        next = pieces.nextType();
+    }
+}
+
+// Usage: --selfplay <dir> [--games N] [--threads N] [--seed N] [--epsilon E] [--depth 1|2] [--max-pieces N]
+//        [--tt-mb N] [--book FILE]
+int runSelfPlay(int argc, char *argv[])
+{
+    SelfPlayOptions options;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--games" && i + 1 < argc)
+            options.games = (uint32_t)max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--epsilon" && i + 1 < argc)
+            options.epsilon = atof(argv[++i]);
+        else if (arg == "--depth" && i + 1 < argc)
+            options.depth = min(2, max(1, atoi(argv[++i])));
+        else if (arg == "--max-pieces" && i + 1 < argc)
+            options.maxPieces = max(1, atoi(argv[++i]));
+        else if (arg == "--tt-mb" && i + 1 < argc)
+            options.tableMb = max(0, atoi(argv[++i]));
+        else if (arg == "--book" && i + 1 < argc)
+            options.bookPath = argv[++i];
+        else if (options.directory.empty())
+            options.directory = arg;
+        else
+        {
+            options.directory.clear();
+            break;
+        }
+    }
+    if (options.directory.empty())
+    {
+        cerr << "usage: " << argv[0]
+             << " --selfplay <dir> [--games N] [--threads N] [--seed N] [--epsilon E] [--depth 1|2] [--max-pieces N]"
+                " [--tt-mb N] [--book FILE]\n";
+        return 2;
+    }
+    string error;
+    if (!options.bookPath.empty() && !openingBook.open(options.bookPath, error))
+    {
+        cerr << "selfplay: " << error << "\n";
+        return 2;
+    }
+    searchTable.resize((size_t)options.tableMb);
+
+    auto start = chrono::steady_clock::now();
+    atomic<uint32_t> nextGame(0);
+    atomic<uint64_t> samples(0);
+    atomic<bool> failed(false);
+    vector<char> writeFailed(options.threads, 0); // one flag per shard, set by its own thread
+    auto shardPath = [&](int t)
+    { return options.directory + "/shard-" + to_string(t) + ".bin"; };
+    vector<thread> workers;
+    for (int t = 0; t < options.threads; t++)
+    {
+        workers.emplace_back([&, t]
+                             {
+            ShardWriter out(shardPath(t), (uint32_t)t);
+            if (!out.isOpen())
+            {
+                failed = true;
+                return;
+            }
+            for (uint32_t g = nextGame++; g < options.games && !quitRequested && out.good(); g = nextGame++)
+                playSelfPlayGame(g, options, out);
+            writeFailed[t] = !out.close();
+            samples += out.samples(); });
+    }
+    for (thread &w : workers)
+        w.join();
+    if (failed)
+    {
+        cerr << "selfplay: cannot write shards in " << options.directory << "\n";
+        return 1;
+    }
+    bool writeError = false;
+    for (int t = 0; t < options.threads; t++)
+    {
+        if (writeFailed[t])
+        {
+            cerr << "selfplay: writing " << shardPath(t) << " failed (disk full?); its samples are incomplete\n";
+            writeError = true;
+        }
+    }
+    if (writeError)
+        return 1;
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "selfplay: " << samples.load() << " samples from " << min(nextGame.load(), options.games) << " games in "
+         << (uint64_t)(seconds * 1000.0) << " ms (" << (uint64_t)(samples.load() * 60.0 / max(seconds, 1e-9))
+         << " samples/min, " << options.threads << " shard" << (options.threads == 1 ? "" : "s") << ")\n";
+    if (searchTable.enabled())
+        cout << "selfplay: " << searchTable.summary("search") << "\n";
+    if (openingBook.isOpen())
+        cout << "selfplay: " << openingBook.summary() << "\n";
+    return 0;
+}
+
+/**************************************************************
+ * 10) Monte Carlo rollouts: scores a position by playing it
+ *     out many times with random or greedy moves and averaging
+ *     the points scored. Boards are fixed-size values and the
+ *     move generator's scratch space is reserved for the worst
+ *     case up front, so a timed rollout never touches the heap
+ *     (the run fails if one does).
+ **************************************************************/
+enum RolloutPolicy
+{
+    ROLLOUT_RANDOM, // random rotation and column, dropped straight down
+    ROLLOUT_GREEDY  // best one-ply evaluateBoard() placement
+};
+
+struct RolloutOptions
+{
+    string fixture;
+    vector<int> pieces; // known queue; later pieces are random
+    int budgetMs = 1000;
+    int threads = max(1u, thread::hardware_concurrency());
+    int horizon = 20; // pieces per rollout
+    RolloutPolicy policy = ROLLOUT_GREEDY;
+    uint64_t seed = 1;
+};
+
+// Welford's running mean and variance; per-thread copies merge at the end
+struct RunningStats
+{
+    uint64_t n = 0;
+    double mean = 0, m2 = 0;
+
+    void add(double x)
+    {
+        n++;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    void merge(const RunningStats &o)
+    {
+        if (o.n == 0)
+            return;
+        double delta = o.mean - mean;
+        uint64_t total = n + o.n;
+        mean += delta * o.n / total;
+        m2 += o.m2 + delta * delta * ((double)n * o.n / total);
+        n = total;
+    }
+
+    double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+};
+
+// Plays `horizon` pieces from `start` and returns the points scored with
+// the Tetris.cpp table (PLACE_REWARD, LINE_REWARD); topping out ends early
+int playRollout(const Board &start, const vector<int> &known, int horizon, RolloutPolicy policy, PieceRandom &rng)
+{
+    static thread_local vector<Placement> locks;
+    locks.reserve(MAX_PIECE_POSES); // once per thread: enumeration never outgrows it
+    Board board = start;
+    int points = 0, totalLines = 0;
+    for (int n = 0; n < horizon; n++)
+    {
+        int type = n < (int)known.size() ? known[n] : rng.nextType();
+        Placement chosen = {0, 0, 0};
+        if (policy == ROLLOUT_RANDOM)
+        {
+            // Every (rotation, column) that fits at the spawn row, then drop it
+            Placement options[4 * (BOARD_WIDTH + 3)];
+            int count = 0;
+            for (int rotation = 0; rotation < 4; rotation++)
+                for (int col = -3; col < BOARD_WIDTH; col++)
+                    if (board.canPlace(pieceRotation(type, rotation), 0, col))
+                        options[count++] = {0, col, rotation};
+            if (count == 0)
+                break;
+            chosen = options[rng.next() % count];
+            while (board.canPlace(pieceRotation(type, chosen.rotation), chosen.row + 1, chosen.col))
+                chosen.row++;
+        }
+        else
+        {
+            locks.clear();
+            enumerateLocks(board, type, locks);
+            if (locks.empty())
+                break;
+            double bestScore = -HUGE_VAL;
+            for (const Placement &p : locks)
+            {
+                Board child = board;
+                child.place(pieceRotation(type, p.rotation), p.row, p.col);
+                double score = LINE_WEIGHT * child.clearLines() + evaluateBoard(child);
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    chosen = p;
+                }
+            }
+        }
+
+        board.place(pieceRotation(type, chosen.rotation), chosen.row, chosen.col);
+        int lines = board.clearLines();
+        totalLines += lines;
+        points += PLACE_REWARD + LINE_REWARD[lines] * max(1, totalLines / 2 + 1);
+        if (board.isGameOver())
+            break;
+    }
+    return points;
+}
+
+// Usage: --rollout <fixture> <pieces> [--budget-ms N] [--threads N] [--horizon N]
+//        [--policy random|greedy] [--seed N]
+int runRollout(int argc, char *argv[])
+{
+    RolloutOptions options;
+    vector<string> args;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--budget-ms" && i + 1 < argc)
+            options.budgetMs = max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--horizon" && i + 1 < argc)
+            options.horizon = max(1, atoi(argv[++i]));
+        else if (arg == "--policy" && i + 1 < argc)
+            options.policy = string(argv[++i]) == "random" ? ROLLOUT_RANDOM : ROLLOUT_GREEDY;
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        else
+            args.push_back(arg);
+    }
+    Board board;
+    vector<PerftExpectation> ignored;
+    if (args.size() != 2)
+    {
+        cerr << "usage: " << argv[0] << " --rollout <fixture> <pieces> [--budget-ms N] [--threads N] [--horizon N]"
+                                        " [--policy random|greedy] [--seed N]\n";
+        return 2;
+    }
+    if (!loadPerftFixture(args[0], board, ignored) || !parsePieceSequence(args[1], options.pieces))
+        return 2;
+
+    // Each thread warms up (first enumeration reserves the scratch vectors),
+    // then all start together so the allocation count covers only the
+    // timed rollouts
+    countAllocations = true;
+    atomic<int> ready(0), finished(0);
+    atomic<bool> go(false);
+    chrono::steady_clock::time_point deadline;
+    vector<RunningStats> results(options.threads);
+    vector<thread> workers;
+    for (int t = 0; t < options.threads; t++)
+    {
+        workers.emplace_back([&, t]
+                             {
+            // Independent stream per thread: seeds spread by the golden ratio
+            PieceRandom rng((options.seed + (uint64_t)t) * 0x9E3779B97F4A7C15ull);
+            playRollout(board, options.pieces, options.horizon, options.policy, rng);
+            ready++;
+            while (!go)
+                this_thread::yield();
+            RunningStats &stats = results[t];
+            do
+                stats.add(playRollout(board, options.pieces, options.horizon, options.policy, rng));
+            while (chrono::steady_clock::now() < deadline);
+            finished++; });
+    }
+    while (ready < options.threads)
+        this_thread::yield();
+    uint64_t allocationsBefore = allocationCount.load();
+    auto start = chrono::steady_clock::now();
+    deadline = start + chrono::milliseconds(options.budgetMs);
+    go = true;
+    while (finished < options.threads)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    uint64_t allocations = allocationCount.load() - allocationsBefore;
+    for (thread &w : workers)
+        w.join();
+    countAllocations = false;
+
+    RunningStats total;
+    for (const RunningStats &r : results)
+        total.merge(r);
+    double stddev = sqrt(total.variance());
+    double halfWidth = 1.96 * stddev / sqrt((double)max<uint64_t>(total.n, 1));
+    cout << "rollout " << args[1] << " (" << (options.policy == ROLLOUT_RANDOM ? "random" : "greedy") << ", horizon "
+         << options.horizon << "): " << total.n << " rollouts in " << (uint64_t)(seconds * 1000.0) << " ms\n"
+         << "  mean " << total.mean << "  variance " << total.variance() << "  stddev " << stddev << "\n"
+         << "  95% CI [" << total.mean - halfWidth << ", " << total.mean + halfWidth << "]\n"
+         << "  " << (uint64_t)(total.n / max(seconds, 1e-9)) << " rollouts/sec, "
+         << (uint64_t)(total.n / max(seconds, 1e-9) / options.threads) << " rollouts/sec/core (" << options.threads
+         << " thread" << (options.threads == 1 ? "" : "s") << "), " << allocations << " heap allocations\n";
+    if (allocations > 0)
+    {
+        cout << "FAILED: timed rollouts allocated\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * 11) Perfect-clear solver: can a known piece queue empty the
+ *     board within K pieces? A depth-first search over the same
+ *     move generator as perft, split across threads after the
+ *     first two pieces. Positions already ruled out are kept in
+ *     pcTable, and boards whose cell count can no longer add up
+ *     to whole rows in time are cut off before they are expanded.
+ **************************************************************/
+const int PC_MAX_PIECES = 32; // ZOBRIST.ply keys
+
+struct PcStep
+{
+    int type;
+    Placement placement;
+    int lines; // cleared by this piece
+};
+
+// True if the bottom `height` rows split into pieces: a column filled up
+// to that height is a wall no piece can cross without sticking out above
+// it, so the empty cells between two walls must come in fours
+bool pcRegionsFit(const Board &board, int height)
+{
+    int empty = 0;
+    for (int c = 0; c < BOARD_WIDTH; c++)
+    {
+        int column = 0;
+        for (int r = BOARD_HEIGHT - height; r < BOARD_HEIGHT; r++)
+            column += board.getCell(r, c) == 0;
+        if (column == 0 && empty % 4 != 0)
+            return false;
+        empty = column == 0 ? 0 : empty + column;
+    }
+    return empty % 4 == 0;
+}
+
+// True if `remaining` pieces cannot empty the board. A piece adds 4 cells
+// and a clear removes 10, so the cell count never changes parity, and the
+// board can only empty at a height h where 10h - cells = 4 * pieces used.
+// 10h = 2h (mod 4), so every other height is a candidate, starting at the
+// stack height or the row above it. Nothing can be left above h, since
+// every row under a cell has to be cleared too.
+bool pcHopeless(const Board &board, int remaining)
+{
+    const BoardMetrics &m = board.metrics();
+    int cells = m.aggregateHeight - m.holes;
+    int height = *max_element(m.heights, m.heights + BOARD_WIDTH);
+    if (cells == 0)
+        return false;
+    if (cells % 2 != 0)
+        return true;
+    for (int h = (2 * height - cells) % 4 == 0 ? height : height + 1;
+         h <= BOARD_HEIGHT && 10 * h - cells <= 4 * remaining; h += 2)
+    {
+        if (pcRegionsFit(board, h))
+            return false;
+    }
+    return true;
+}
+
+struct PcContext
+{
+    const vector<int> &queue;
+    int maxPieces;
+    size_t task;                  // root split this search belongs to
+    const atomic<size_t> &solved; // lowest task that has found a clear
+    uint64_t nodes;
+
+    // A task only has to finish if no earlier one succeeded, so the answer
+    // is the one a single-threaded search finds first
+    bool superseded() const { return solved.load(memory_order_relaxed) < task; }
+};
+
+// Searches from `board` with queue[index] to place next. Returns the total
+// number of pieces used by the first perfect clear found (path[index..]
+// holds the rest of it), or 0.
+int pcSearch(PcContext &ctx, const Board &board, int index, vector<PcStep> &path)
+{
+    if (index >= ctx.maxPieces || pcHopeless(board, ctx.maxPieces - index))
+        return 0;
+    uint64_t key = board.getHash() ^ ZOBRIST.ply[index];
+    uint64_t ruledOut;
+    if (pcTable.probe(key, ruledOut))
+        return 0;
+    ctx.nodes++;
+
+    int type = ctx.queue[index];
+    vector<Placement> locks;
+    enumerateLocks(board, type, locks);
+    for (const Placement &p : locks)
+    {
+        if (ctx.superseded())
+            return 0;
+        Board child = board;
+        child.place(pieceRotation(type, p.rotation), p.row, p.col);
+        int lines = child.clearLines();
+        if (child.isGameOver())
+            continue;
+        path[index] = {type, p, lines};
+        if (lines > 0 && child.metrics().aggregateHeight == 0) // no column has a cell left
+            return index + 1;
+        int used = pcSearch(ctx, child, index + 1, path);
+        if (used)
+            return used;
+    }
+    // An interrupted search proved nothing, so only a full one is remembered
+    if (!ctx.superseded())
+        pcTable.store(key, 1);
+    return 0;
+}
+
+// A search root: the board after the first one or two pieces
+struct PcTask
+{
+    Board board;
+    PcStep steps[2];
+    int placed;
+    bool cleared; // already empty
+};
+
+// Expands the first `plies` pieces into tasks in search order
+void splitPcTasks(const Board &board, const vector<int> &queue, int plies, int maxPieces, PcTask &task,
+                  vector<PcTask> &out)
+{
+    if (plies == 0)
+    {
+        task.board = board;
+        out.push_back(task);
+        return;
+    }
+    int type = queue[task.placed];
+    vector<Placement> locks;
+    enumerateLocks(board, type, locks);
+    for (const Placement &p : locks)
+    {
+        Board child = board;
+        child.place(pieceRotation(type, p.rotation), p.row, p.col);
+        int lines = child.clearLines();
+        if (child.isGameOver())
+            continue;
+        task.steps[task.placed++] = {type, p, lines};
+        if (lines > 0 && child.metrics().aggregateHeight == 0)
+        {
+            task.board = child;
+            task.cleared = true;
+            out.push_back(task);
+            task.cleared = false;
+        }
+        else if (!pcHopeless(child, maxPieces - task.placed))
+        {
+            splitPcTasks(child, queue, plies - 1, maxPieces, task, out);
+        }
+        task.placed--;
+    }
+}
+
+// Usage: --pc <fixture> <pieces> [--max-pieces K] [--threads N] [--tt-mb N]
+// Exits 0 with the placements if a perfect clear exists, 1 if not.
+int runPerfectClear(int argc, char *argv[])
+{
+    vector<string> args;
+    int maxPieces = 0; // default: the whole queue
+    int threads = max(1u, thread::hardware_concurrency());
+    int tableMb = 64;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--max-pieces" && i + 1 < argc)
+            maxPieces = max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else if (arg == "--tt-mb" && i + 1 < argc)
+            tableMb = max(0, atoi(argv[++i]));
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2)
+    {
+        cerr << "usage: " << argv[0] << " --pc <fixture> <pieces> [--max-pieces K] [--threads N] [--tt-mb N]\n";
+        return 2;
+    }
+    Board board;
+    vector<PerftExpectation> ignored;
+    vector<int> queue;
+    if (!loadPerftFixture(args[0], board, ignored) || !parsePieceSequence(args[1], queue))
+        return 2;
+    if (maxPieces == 0)
+        maxPieces = (int)queue.size();
+    if (maxPieces > (int)queue.size() || maxPieces > PC_MAX_PIECES)
+    {
+        cerr << "pc: --max-pieces must be at most the queue length (and " << PC_MAX_PIECES << ")\n";
+        return 2;
+    }
+    pcTable.resize((size_t)tableMb);
+
+    auto start = chrono::steady_clock::now();
+    vector<PcTask> tasks;
+    PcTask root = {board, {}, 0, false};
+    if (!pcHopeless(board, maxPieces))
+        splitPcTasks(board, queue, min(2, maxPieces - 1), maxPieces, root, tasks);
+
+    atomic<size_t> solved(SIZE_MAX);
+    atomic<uint64_t> nodes(tasks.size());
+    mutex resultLock;
+    vector<PcStep> solution;
+    WorkerPool pool(threads);
+    pool.parallelFor(tasks.size(), [&](size_t i)
+                     {
+        const PcTask &task = tasks[i];
+        PcContext ctx = {queue, maxPieces, i, solved, 0};
+        if (ctx.superseded())
+            return;
+        vector<PcStep> path(maxPieces);
+        copy(task.steps, task.steps + task.placed, path.begin());
+        int used = task.cleared ? task.placed : pcSearch(ctx, task.board, task.placed, path);
+        nodes += ctx.nodes;
+        if (used == 0)
+            return;
+        lock_guard<mutex> guard(resultLock);
+        if (i < solved)
+        {
+            solved = i;
+            solution.assign(path.begin(), path.begin() + used);
+        } });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "pc " << args[1] << " within " << maxPieces << " pieces: ";
+    if (solution.empty())
+        cout << "no perfect clear";
+    else
+        cout << "perfect clear in " << solution.size() << " pieces";
+    cout << " (" << (uint64_t)(seconds * 1000.0) << " ms, " << nodes.load() << " nodes, " << tasks.size()
+         << " tasks, " << threads << " thread" << (threads == 1 ? "" : "s") << ")\n";
+    for (size_t i = 0; i < solution.size(); i++)
+    {
+        const PcStep &s = solution[i];
+        cout << "  " << i + 1 << ". " << PIECE_LETTERS[s.type] << "  rotation " << s.placement.rotation << "  row "
+             << s.placement.row << "  col " << s.placement.col;
+        if (s.lines > 0)
+            cout << "  clears " << s.lines;
+        cout << "\n";
+    }
+    if (pcTable.enabled())
+        cout << "  " << pcTable.summary("pc") << "\n";
+    return solution.empty() ? 1 : 0;
+}
+
+/**************************************************************
+ * 12) Batch simulator: many games stepped in lockstep, one
+ *     action per game per step, for reinforcement learning.
+ *     Games live in blocks of 16 in structure-of-arrays form:
+ *     a board row is one 16-bit mask, and row r of all 16 games
+ *     sits in 16 consecutive words. Collision and full-row checks
+ *     are fixed-length loops over those lanes, which the compiler
+ *     turns into SIMD. The rules are Game's, and --verify replays
+ *     every step on Board to prove it.
+ **************************************************************/
+const int BATCH_LANES = 16;
+const int BATCH_WALL = 3;                         // wall bits on each side of a row
+const int BATCH_ROWS = BOARD_HEIGHT + 3;          // three full rows below act as the floor
+const uint16_t BATCH_EMPTY_ROW = 0xE007;          // walls only: column c is bit BATCH_WALL + c
+const uint16_t BATCH_FULL_ROW = 0xFFFF;
+static_assert(BOARD_WIDTH + 2 * BATCH_WALL == 16, "a batch row is one 16-bit mask");
+
+// One step of one game: the action's move (kept only if it fits, as in
+// Game::handleInput), then one row of gravity. A piece that can't fall
+// locks at once; soft drop on the ground and hard drop lock immediately,
+// and the piece that spawns then takes the gravity row.
+enum BatchAction : uint8_t
+{
+    BATCH_NONE,
+    BATCH_LEFT,
+    BATCH_RIGHT,
+    BATCH_ROTATE,
+    BATCH_SOFT_DROP,
+    BATCH_HARD_DROP,
+    BATCH_ACTIONS
+};
+
+// Row masks of every piece and rotation, unshifted (bit c = column c of the 4x4 box)
+struct BatchShapes
+{
+    uint16_t rows[7][4][4];
+
+    BatchShapes()
+    {
+        for (int t = 0; t < 7; t++)
+            for (int rotation = 0; rotation < 4; rotation++)
+            {
+                const auto &shape = pieceRotation(t, rotation).getShape();
+                for (int r = 0; r < 4; r++)
+                {
+                    rows[t][rotation][r] = 0;
+                    for (int c = 0; c < 4; c++)
+                        if (shape[r][c] != 0)
+                            rows[t][rotation][r] |= (uint16_t)(1 << c);
+                }
+            }
+    }
+};
+const BatchShapes BATCH_SHAPES;
+
+struct BatchBlock
+{
+    uint16_t rows[BATCH_ROWS][BATCH_LANES];
+    int16_t row[BATCH_LANES], col[BATCH_LANES]; // Board::place() origin of the falling piece
+    uint8_t type[BATCH_LANES], next[BATCH_LANES], rotation[BATCH_LANES];
+    int32_t score[BATCH_LANES], lines[BATCH_LANES], level[BATCH_LANES];
+    uint64_t rng[BATCH_LANES]; // PieceRandom state of each game
+};
+
+class BatchSim
+{
+private:
+    vector<BatchBlock> blocks;
+    int games;
+
+    static int nextPiece(uint64_t &state)
+    {
+        PieceRandom rng(state);
+        int type = rng.nextType();
+        state = rng.getState();
+        return type;
+    }
+
+    static void resetLane(BatchBlock &b, int l)
+    {
+        for (int r = 0; r < BATCH_ROWS; r++)
+            b.rows[r][l] = r < BOARD_HEIGHT ? BATCH_EMPTY_ROW : BATCH_FULL_ROW;
+        b.type[l] = (uint8_t)nextPiece(b.rng[l]);
+        b.next[l] = (uint8_t)nextPiece(b.rng[l]);
+        b.row[l] = 0;
+        b.col[l] = BOARD_WIDTH / 2 - 2;
+        b.rotation[l] = 0;
+        b.score[l] = b.lines[l] = 0;
+        b.level[l] = 1;
+    }
+
+    // One lane, for the few that need a loop of their own (hard drop, spawn)
+    static bool laneFits(const BatchBlock &b, int l, int type, int rotation, int row, int col)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            uint16_t mask = (uint16_t)(BATCH_SHAPES.rows[type][rotation][k] << (col + BATCH_WALL));
+            if (mask != 0 && (row + k >= BATCH_ROWS || (b.rows[row + k][l] & mask) != 0))
+                return false;
+        }
+        return true;
+    }
+
+    // hit[l] != 0 where the piece of lane l would overlap a wall, the floor
+    // or a cell at (row, col, rotation). Every board row is tested against
+    // the piece row that lands on it (if any), so the lanes never diverge.
+    static void collide(const BatchBlock &b, const int16_t *row, const int16_t *col, const uint8_t *rotation,
+                        uint16_t *hit)
+    {
+        uint16_t mask[4][BATCH_LANES];
+        for (int l = 0; l < BATCH_LANES; l++)
+            for (int k = 0; k < 4; k++)
+                mask[k][l] = (uint16_t)(BATCH_SHAPES.rows[b.type[l]][rotation[l]][k] << (col[l] + BATCH_WALL));
+        for (int l = 0; l < BATCH_LANES; l++)
+            hit[l] = 0;
+        for (int r = 0; r < BATCH_ROWS; r++)
+        {
+            // Branch-free select of the piece row, so this loop vectorizes
+            for (int l = 0; l < BATCH_LANES; l++)
+            {
+                int16_t k = (int16_t)(r - row[l]);
+                uint16_t m = (uint16_t)((mask[0][l] & -(uint16_t)(k == 0)) | (mask[1][l] & -(uint16_t)(k == 1)) |
+                                        (mask[2][l] & -(uint16_t)(k == 2)) | (mask[3][l] & -(uint16_t)(k == 3)));
+                hit[l] |= b.rows[r][l] & m;
+            }
+        }
+    }
+
+    // Places the pieces of the lanes in `lock`, clears their full rows, adds
+    // the points to `reward` and spawns the next piece; a game that tops out
+    // starts over and is marked `done`
+    static void lockLanes(BatchBlock &b, const uint8_t *lock, int32_t *reward, uint8_t *done)
+    {
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            if (!lock[l])
+                continue;
+            for (int k = 0; k < 4; k++)
+                b.rows[b.row[l] + k][l] |= (uint16_t)(BATCH_SHAPES.rows[b.type[l]][b.rotation[l]][k]
+                                                      << (b.col[l] + BATCH_WALL));
+        }
+
+        // Only lanes that just locked can have full rows
+        uint8_t full[BATCH_LANES] = {0};
+        for (int r = 0; r < BOARD_HEIGHT; r++)
+            for (int l = 0; l < BATCH_LANES; l++)
+                full[l] += b.rows[r][l] == BATCH_FULL_ROW;
+
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            if (!lock[l])
+                continue;
+            if (full[l])
+            {
+                // Board::clearLines: the rows that stay keep their order
+                int to = BOARD_HEIGHT - 1;
+                for (int from = BOARD_HEIGHT - 1; from >= 0; from--)
+                    if (b.rows[from][l] != BATCH_FULL_ROW)
+                        b.rows[to--][l] = b.rows[from][l];
+                while (to >= 0)
+                    b.rows[to--][l] = BATCH_EMPTY_ROW;
+                b.score[l] += full[l] * 100;
+                b.lines[l] += full[l];
+                if (b.lines[l] / 10 >= b.level[l])
+                    b.level[l]++;
+            }
+            reward[l] += full[l] * 100;
+
+            b.type[l] = b.next[l];
+            b.next[l] = (uint8_t)nextPiece(b.rng[l]);
+            b.row[l] = 0;
+            b.col[l] = BOARD_WIDTH / 2 - 2;
+            b.rotation[l] = 0;
+            done[l] = b.rows[0][l] != BATCH_EMPTY_ROW || !laneFits(b, l, b.type[l], 0, 0, b.col[l]);
+            if (done[l])
+                resetLane(b, l);
+        }
+    }
+
+    static void stepBlock(BatchBlock &b, const uint8_t *action, int32_t *reward, uint8_t *done)
+    {
+        int16_t row[BATCH_LANES], col[BATCH_LANES];
+        uint8_t rotation[BATCH_LANES], lock[BATCH_LANES];
+        uint16_t hit[BATCH_LANES];
+
+        // 1) The action's move, kept where it fits
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            row[l] = (int16_t)(b.row[l] + (action[l] == BATCH_SOFT_DROP));
+            col[l] = (int16_t)(b.col[l] + (action[l] == BATCH_RIGHT) - (action[l] == BATCH_LEFT));
+            rotation[l] = (uint8_t)((b.rotation[l] + (action[l] == BATCH_ROTATE)) & 3);
+        }
+        collide(b, row, col, rotation, hit);
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            lock[l] = hit[l] != 0 && action[l] == BATCH_SOFT_DROP;
+            if (hit[l] == 0)
+            {
+                b.row[l] = row[l];
+                b.col[l] = col[l];
+                b.rotation[l] = rotation[l];
+            }
+        }
+        uint8_t anyLock = 0;
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            if (action[l] == BATCH_HARD_DROP)
+            {
+                while (laneFits(b, l, b.type[l], b.rotation[l], b.row[l] + 1, b.col[l]))
+                    b.row[l]++;
+                lock[l] = 1;
+            }
+            reward[l] = 0;
+            done[l] = 0;
+            anyLock |= lock[l];
+        }
+
+        // 2) A drop that locked spawns the next piece, which falls with the
+        //    rest below, as Game::run applies gravity after handleInput
+        if (anyLock)
+            lockLanes(b, lock, reward, done);
+
+        // 3) One row of gravity; a piece that can't fall locks. A game that
+        //    just started over doesn't fall until its next step.
+        for (int l = 0; l < BATCH_LANES; l++)
+            row[l] = (int16_t)(b.row[l] + 1);
+        collide(b, row, b.col, b.rotation, hit);
+        anyLock = 0;
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            lock[l] = hit[l] != 0 && !done[l];
+            b.row[l] = (int16_t)(b.row[l] + (hit[l] == 0 && !done[l]));
+            anyLock |= lock[l];
+        }
+        if (anyLock)
+            lockLanes(b, lock, reward, done);
     }
 
-    // Factory method: returns a random Tetromino
-    Tetromino *randomTetromino()
+public:
+    // Game g draws its pieces from its own stream, seeded from (seed, g)
+    BatchSim(int gameCount, uint64_t seed)
+        : blocks((gameCount + BATCH_LANES - 1) / BATCH_LANES), games(gameCount)
     {
-        int r = rand() % 7;
-        switch (r)
-        {
-        case 0:
-            return new TetrominoI();
-        case 1:
-            return new TetrominoO();
-        case 2:
-            return new TetrominoT();
-        case 3:
-            return new TetrominoS();
-        case 4:
-            return new TetrominoZ();
-        case 5:
-            return new TetrominoJ();
-        case 6:
-            return new TetrominoL();
-        }
-        // fallback
-        return new TetrominoI();
+        reset(seed);
     }
 
-    bool run()
+    // Starts every game over, as a new BatchSim(size(), seed) would
+    void reset(uint64_t seed)
     {
-        score = 0;
-        // Hide cursor (optional) // ANSI Escape sequence
-        cout << "\033[?25l";
-#ifdef _WIN32
-        system("cls");
-#else
-        system("clear");
-#endif
-        showStartingAnimation();
-
-        while (!gameOver)
+        for (size_t i = 0; i < blocks.size(); i++)
         {
-            // 1) Clear and draw interface each frame
-            clearScreen();
-            drawInterface();
-
-            // 2) Handle input
-            handleInput();
-
-            // 3) Update piece position (gravity) if not paused
-            if (!paused)
-            {
-                moveDown();
-            }
-
-            // 4) Check game over
-            if (board.isGameOver())
+            for (int l = 0; l < BATCH_LANES; l++)
             {
-                gameOver = true;
+                blocks[i].rng[l] = PieceRandom((seed + i * BATCH_LANES + l) * 0x9E3779B97F4A7C15ull).getState();
+                resetLane(blocks[i], l);
             }
-
-            // 5) Control speed
-            int delay = 100 - (level - 1) * 10;
-            if (delay < 0)
-                delay = 10;
-#ifdef _WIN32
-            Sleep(delay);
-#else
-            usleep(delay * 1500);
-#endif
         }
+    }
 
-        // Final screen
+    int size() const { return games; }
+    size_t blockCount() const { return blocks.size(); }
 
-#ifdef _WIN32
-        system("cls");
-#else
-        system("clear");
-#endif
+    // Steps every game of blocks [first, last). Arrays are indexed by game
+    // and padded to whole blocks: action[g] in, reward[g] (points scored by
+    // this step) and done[g] (game over, already reset) out.
+    void step(size_t first, size_t last, const uint8_t *action, int32_t *reward, uint8_t *done)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            size_t g = i * BATCH_LANES;
+            stepBlock(blocks[i], action + g, reward + g, done + g);
+        }
     }
 
-private:
-    // Draw the entire interface (left panel, board in center, right panel)
-    void drawInterface()
+    // State of game g, for checking against Board
+    bool filled(int g, int r, int c) const
     {
-        // -------------------------------------
-        // LEFT PANEL (Level, lines, score, controls)
-        // -------------------------------------
-        int leftPanelRow = 1;
-        int leftPanelCol = 1;
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "Your Level: " << level;
+        return (blocks[g / BATCH_LANES].rows[r][g % BATCH_LANES] >> (c + BATCH_WALL)) & 1;
+    }
+    const BatchBlock &block(int g) const { return blocks[g / BATCH_LANES]; }
+};
+
+// The same game played with Board, Game's rules written out one move at a time
+struct BatchReference
+{
+    Board board;
+    PieceRandom rng;
+    int type, next, rotation, row, col;
+    int score, lines, level;
 
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "Full Lines: " << linesClearedTotal;
+    explicit BatchReference(uint64_t seed) : rng(seed) { reset(); }
 
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "Score: " << score;
+    void reset()
+    {
+        board = Board();
+        type = rng.nextType();
+        next = rng.nextType();
+        rotation = 0;
+        row = 0;
+        col = BOARD_WIDTH / 2 - 2;
+        score = lines = 0;
+        level = 1;
+    }
 
-        // Show paused status
-        if (paused)
+    int step(int action, bool &done)
+    {
+        const Tetromino &piece = pieceRotation(type, rotation);
+        bool lock = false;
+        switch (action)
         {
-            drawPauseScreen();
+        case BATCH_LEFT:
+            if (board.canPlace(piece, row, col - 1))
+                col--;
+            break;
+        case BATCH_RIGHT:
+            if (board.canPlace(piece, row, col + 1))
+                col++;
+            break;
+        case BATCH_ROTATE:
+            if (board.canPlace(pieceRotation(type, rotation + 1), row, col))
+                rotation = (rotation + 1) & 3;
+            break;
+        case BATCH_SOFT_DROP: // Game::moveDown
+            if (board.canPlace(piece, row + 1, col))
+                row++;
+            else
+                lock = true;
+            break;
+        case BATCH_HARD_DROP:
+            row += board.dropDistance(piece, row, col);
+            lock = true;
+            break;
         }
+        done = false;
+        int points = lock ? lockPiece(done) : 0;
+        if (done)
+            return points;
+
+        // Gravity, also for a piece that just spawned
+        if (board.canPlace(pieceRotation(type, rotation), row + 1, col))
+            row++;
         else
+            points += lockPiece(done);
+        return points;
+    }
+
+    // Game::lockPiece; returns the points scored
+    int lockPiece(bool &done)
+    {
+        board.place(pieceRotation(type, rotation), row, col);
+        int cleared = board.clearLines();
+        if (cleared > 0)
         {
-            setCursorPos(leftPanelRow++, leftPanelCol);
-            cout << "Game Status : [ RUNNING ]\n";
+            score += cleared * 100;
+            lines += cleared;
+            if (lines / 10 >= level)
+                level++;
         }
+        type = next;
+        next = rng.nextType();
+        rotation = 0;
+        row = 0;
+        col = BOARD_WIDTH / 2 - 2;
+        done = board.isGameOver() || !board.canPlace(pieceRotation(type, 0), row, col);
+        if (done)
+            reset();
+        return cleared * 100;
+    }
+};
 
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "CONTROLS:";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  p/P   : Pause";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  Left  : Move Left";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  Right : Move Right";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  Up    : Rotate";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  Down  : Soft Drop";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  Space : Hard Drop";
-        setCursorPos(leftPanelRow++, leftPanelCol);
-        cout << "  ESC   : Quit";
-
-        // -------------------------------------
-        // BOARD in the CENTER with a border
-        // -------------------------------------
-
-        int boardTop = 2;   // row offset
-        int boardLeft = 30; // column offset (space to left panel)
-        int cellWidth = 2;  // each cell is "  "
-        int borderWidth = BOARD_WIDTH * cellWidth;
-        int borderHeight = BOARD_HEIGHT;
-
-        // Draw top border
-        setCursorPos(boardTop, boardLeft);
-        cout << "\033[0;101m \033[0m";
-        for (int i = 0; i < borderWidth; i++)
-            cout << "-";
-        cout << "\033[0;101m \033[0m";
+// Empty string if game g of the batch matches the reference
+string compareBatchGame(const BatchSim &sim, int g, const BatchReference &ref)
+{
+    const BatchBlock &b = sim.block(g);
+    int l = g % BATCH_LANES;
+    ostringstream diff;
+    if (b.type[l] != ref.type || b.next[l] != ref.next || b.rotation[l] != ref.rotation || b.row[l] != ref.row ||
+        b.col[l] != ref.col)
+        diff << "piece " << PIECE_LETTERS[b.type[l]] << "/" << (int)b.rotation[l] << " at (" << b.row[l] << ","
+             << b.col[l] << ") next " << PIECE_LETTERS[b.next[l]] << ", Board has " << PIECE_LETTERS[ref.type]
+             << "/" << ref.rotation << " at (" << ref.row << "," << ref.col << ") next "
+             << PIECE_LETTERS[ref.next] << "; ";
+    if (b.score[l] != ref.score || b.lines[l] != ref.lines || b.level[l] != ref.level)
+        diff << "score/lines/level " << b.score[l] << "/" << b.lines[l] << "/" << b.level[l] << ", Board has "
+             << ref.score << "/" << ref.lines << "/" << ref.level << "; ";
+    for (int r = 0; r < BOARD_HEIGHT; r++)
+        for (int c = 0; c < BOARD_WIDTH; c++)
+            if (sim.filled(g, r, c) != (ref.board.getCell(r, c) != 0))
+            {
+                diff << "cell (" << r << "," << c << ") differs; ";
+                r = BOARD_HEIGHT;
+                break;
+            }
+    return diff.str();
+}
 
-        // Draw side borders
-        for (int r = 0; r < borderHeight; r++)
+// Usage: --batch [--games N] [--steps N] [--threads N] [--seed N] [--policy random|place] [--verify]
+// `random` picks any action each step; `place` turns and walks each piece
+// to a random column and hard-drops it, which fills rows and clears lines.
+// With --verify every game is also played on Board and compared after
+// every step.
+int runBatch(int argc, char *argv[])
+{
+    int games = 4096, steps = 2000;
+    int threads = max(1u, thread::hardware_concurrency());
+    uint64_t seed = 1;
+    bool verify = false, place = false;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--games" && i + 1 < argc)
+            games = max(1, atoi(argv[++i]));
+        else if (arg == "--steps" && i + 1 < argc)
+            steps = max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--policy" && i + 1 < argc)
+            place = string(argv[++i]) == "place";
+        else if (arg == "--verify")
+            verify = true;
+        else
         {
-            setCursorPos(boardTop + 1 + r, boardLeft);
-            cout << "\033[0;106m \033[0m"; // Right Boarder
-            setCursorPos(boardTop + 1 + r, boardLeft + borderWidth + 1);
-            cout << "\033[0;106m \033[0m"; // Left Border
+            cerr << "usage: " << argv[0]
+                 << " --batch [--games N] [--steps N] [--threads N] [--seed N] [--policy random|place] [--verify]\n";
+            return 2;
         }
+    }
 
-        // Draw bottom border
-        setCursorPos(boardTop + borderHeight + 1, boardLeft);
-        cout << "\033[0;101m \033[0m";
-        for (int i = 0; i < borderWidth; i++)
-            cout << "-";
-        cout << "\033[0;101m \033[0m";
-
-        // Overlay current piece on a temp board
-        Board tempBoard = board;
-        tempBoard.place(*currentPiece, currentRow, currentCol);
+    BatchSim sim(games, seed);
+    size_t padded = sim.blockCount() * BATCH_LANES;
+    vector<uint8_t> action(padded, BATCH_NONE), done(padded);
+    vector<int32_t> reward(padded);
+    vector<BatchReference> reference;
+    vector<uint8_t> diverged(games, 0);
+    vector<uint8_t> targetRotation(games), targetCol(games); // --policy place
+    if (verify)
+        for (int g = 0; g < games; g++)
+            reference.emplace_back((seed + g) * 0x9E3779B97F4A7C15ull);
 
-        // Print each row of the board inside the border
-        for (int r = 0; r < BOARD_HEIGHT; r++)
+    WorkerPool pool(threads);
+    size_t chunk = max<size_t>(1, sim.blockCount() / (size_t)(threads * 4)); // blocks per task
+    size_t tasks = (sim.blockCount() + chunk - 1) / chunk;
+    PieceRandom actions(seed ^ 0xAC710A5ull);
+    uint64_t finished = 0, points = 0, mismatches = 0;
+    double seconds = 0;
+    for (int s = 0; s < steps; s++)
+    {
+        for (int g = 0; g < games; g++)
         {
-            setCursorPos(boardTop + 1 + r, boardLeft + 1);
-            for (int c = 0; c < BOARD_WIDTH; c++)
+            if (!place)
             {
-                int val = tempBoard.getCell(r, c);
-                if (val == 0)
-                {
-                    cout << "  "; // empty
-                }
-                else
-                {
-                    setBackgroundColor(val % 8);
-                    cout << "  ";
-                    resetColor();
-                }
+                action[g] = (uint8_t)((actions.next() >> 33) % BATCH_ACTIONS);
+                continue;
             }
+            const BatchBlock &b = sim.block(g);
+            int l = g % BATCH_LANES;
+            if (b.row[l] == 0 && b.rotation[l] == 0 && b.col[l] == BOARD_WIDTH / 2 - 2)
+            {
+                // A fresh piece: pick where it goes (columns that don't fit just stop at the wall)
+                targetRotation[g] = (uint8_t)(actions.next() % 4);
+                targetCol[g] = (uint8_t)(actions.next() % (BOARD_WIDTH + 2));
+            }
+            int col = targetCol[g] - 2;
+            if (b.rotation[l] != targetRotation[g])
+                action[g] = BATCH_ROTATE;
+            else if (b.col[l] != col)
+                action[g] = b.col[l] < col ? BATCH_RIGHT : BATCH_LEFT;
+            else
+                action[g] = BATCH_HARD_DROP;
         }
 
-        // -------------------------------------
-        // RIGHT PANEL (Statistics / Next Piece)
-        // -------------------------------------
-        int rightPanelRow = 2;
-        int rightPanelCol = boardLeft + borderWidth + 5;
-        setCursorPos(rightPanelRow++, rightPanelCol);
-        cout << "STATISTICS";
-        rightPanelRow++;
+        auto start = chrono::steady_clock::now();
+        pool.parallelFor(tasks, [&](size_t t)
+                         { sim.step(t * chunk, min(sim.blockCount(), (t + 1) * chunk), action.data(), reward.data(),
+                                    done.data()); });
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        for (int g = 0; g < games; g++)
+        {
+            finished += done[g];
+            points += (uint64_t)reward[g];
+        }
+        if (!verify)
+            continue;
+        for (int g = 0; g < games; g++)
+        {
+            if (diverged[g])
+                continue;
+            bool refDone;
+            int refReward = reference[g].step(action[g], refDone);
+            string diff = compareBatchGame(sim, g, reference[g]);
+            if (refReward != reward[g] || refDone != (done[g] != 0))
+                diff += "reward/done " + to_string(reward[g]) + "/" + to_string(done[g]) + ", Board has " +
+                        to_string(refReward) + "/" + to_string(refDone) + "; ";
+            if (diff.empty())
+                continue;
+            // Reported once: after the first difference the two games go their own ways
+            diverged[g] = 1;
+            if (mismatches++ < 10)
+                cout << "  MISMATCH game " << g << " step " << s + 1 << " (action " << (int)action[g] << "): " << diff
+                     << "\n";
+        }
+    }
 
-        // For example, show next piece preview or placeholder
-        setCursorPos(rightPanelRow++, rightPanelCol);
-        cout << "Next Piece:";
+    uint64_t gameSteps = (uint64_t)games * steps;
+    cout << "batch: " << games << " games x " << steps << " steps in " << (uint64_t)(seconds * 1000.0) << " ms, "
+         << finished << " games finished, " << points << " points\n"
+         << "  " << (uint64_t)(gameSteps / max(seconds, 1e-9)) << " game-steps/sec, "
+         << (uint64_t)(gameSteps / max(seconds, 1e-9) / threads) << " game-steps/sec/core (" << threads << " thread"
+         << (threads == 1 ? "" : "s") << ")\n";
+    if (verify)
+        cout << (mismatches ? "FAILED: " : "OK: ") << mismatches << " of " << games
+             << " games differ from Board after " << steps << " steps\n";
+    return mismatches ? 1 : 0;
+}
 
-        // Draw next piece in a small 4x4 area
-        const auto &shp = nextPiece->getShape();
-        int nc = nextPiece->getColorIndex() % 8;
+/**************************************************************
+ * 12b) Embedded engine: the batch simulator behind the C ABI
+ *     of tetris_engine.h (built as a library with
+ *     -DTETRIS_LIBRARY, which leaves out main)
+ *     Each pool task copies its blocks' actions in, steps them
+ *     and writes their observations out while they are still
+ *     in cache. The task is built once and captures only the
+ *     engine, so std::function never allocates, and neither
+ *     does a step.
+ **************************************************************/
+static_assert(TETRIS_ENGINE_ROWS == BOARD_HEIGHT && TETRIS_ENGINE_COLS == BOARD_WIDTH,
+              "tetris_engine.h has the board size");
+static_assert(TETRIS_ENGINE_NONE == BATCH_NONE && TETRIS_ENGINE_LEFT == BATCH_LEFT &&
+                  TETRIS_ENGINE_RIGHT == BATCH_RIGHT && TETRIS_ENGINE_ROTATE == BATCH_ROTATE &&
+                  TETRIS_ENGINE_SOFT_DROP == BATCH_SOFT_DROP && TETRIS_ENGINE_HARD_DROP == BATCH_HARD_DROP,
+              "tetris_engine.h actions are BatchActions");
+
+struct TetrisEngine
+{
+    BatchSim sim;
+    WorkerPool pool;
+    size_t chunk, tasks;          // blocks per pool task, and tasks per call
+    vector<uint8_t> action, done; // padded to whole blocks
+    vector<int32_t> reward;
+    const uint8_t *actions = nullptr; // the current call's arguments; no actions: observe only
+    const TetrisEngineObs *obs = nullptr;
+    function<void(size_t)> task;
+
+    TetrisEngine(int games, uint64_t seed, int threads) : sim(games, seed), pool(threads)
+    {
+        chunk = max<size_t>(1, sim.blockCount() / (size_t)(pool.size() * 4));
+        tasks = (sim.blockCount() + chunk - 1) / chunk;
+        size_t padded = sim.blockCount() * BATCH_LANES;
+        action.assign(padded, BATCH_NONE); // padding lanes play on, untouched
+        done.assign(padded, 0);
+        reward.assign(padded, 0);
+        task = [this](size_t t)
+        { runTask(t); };
+    }
+
+    void run(const uint8_t *stepActions, const TetrisEngineObs *observations)
+    {
+        actions = stepActions;
+        obs = observations;
+        pool.parallelFor(tasks, task);
+    }
 
-        for (int row = 0; row < 4; row++)
+    void runTask(size_t t)
+    {
+        size_t first = t * chunk, last = min(sim.blockCount(), first + chunk);
+        size_t firstGame = first * BATCH_LANES, lastGame = min((size_t)sim.size(), last * BATCH_LANES);
+        if (actions)
         {
-            setCursorPos(rightPanelRow + row, rightPanelCol);
-            for (int col = 0; col < 4; col++)
-            {
-                if (shp[row][col] != 0)
-                {
-                    setBackgroundColor(nc);
-                    cout << "  ";
-                    resetColor();
-                }
-                else
-                {
-                    cout << "  ";
-                }
-            }
+            memcpy(&action[firstGame], actions + firstGame, lastGame - firstGame);
+            sim.step(first, last, action.data(), reward.data(), done.data());
         }
-
-        // You could also show usage counts, etc., if you track them
+        if (obs)
+            observe(firstGame, lastGame);
     }
 
-    void handleInput()
+    void observe(size_t first, size_t last) const
     {
-        while (kbhit_non_blocking())
+        for (size_t g = first; g < last; g++)
         {
-            int ch = getch();
-            switch (ch)
+            const BatchBlock &b = sim.block((int)g);
+            int l = (int)(g % BATCH_LANES);
+            if (obs->cells || obs->rowMasks)
             {
-            case 75: // Left arrow
-                if (!paused)
-                    tryMove(currentRow, currentCol - 1);
-                break;
-            case 77: // Right arrow
-                if (!paused)
-                    tryMove(currentRow, currentCol + 1);
-                break;
-            case 80: // Down arrow
-                if (!paused)
-                    moveDown(); // soft drop
-                break;
-            case 72: // Up arrow
-                if (!paused)
-                {
-                    currentPiece->rotateCW();
-                    if (!board.canPlace(*currentPiece, currentRow, currentCol))
-                    {
-                        // Rotate back if invalid
-                        for (int i = 0; i < 3; i++)
-                        {
-                            currentPiece->rotateCW();
-                        }
-                    }
-                }
-                break;
-            case ' ': // Hard drop
-                if (!paused)
+                for (int r = 0; r < BOARD_HEIGHT; r++)
                 {
-                    while (board.canPlace(*currentPiece, currentRow + 1, currentCol))
+                    uint16_t mask = (uint16_t)((b.rows[r][l] >> BATCH_WALL) & ((1 << BOARD_WIDTH) - 1));
+                    if (obs->rowMasks)
+                        obs->rowMasks[g * BOARD_HEIGHT + r] = mask;
+                    if (obs->cells)
                     {
-                        currentRow++;
+                        uint8_t *cells = obs->cells + (g * BOARD_HEIGHT + r) * BOARD_WIDTH;
+                        for (int c = 0; c < BOARD_WIDTH; c++)
+                            cells[c] = (uint8_t)((mask >> c) & 1);
                     }
-                    lockPiece();
                 }
-                break;
-            case 'p':
-                paused = !paused;
-                break;
-            case 27: // ESC
-                gameOver = true;
-                break;
-            default:
-                break;
             }
+            if (obs->piece)
+                obs->piece[g] = b.type[l];
+            if (obs->next)
+                obs->next[g] = b.next[l];
+            if (obs->rotation)
+                obs->rotation[g] = b.rotation[l];
+            if (obs->row)
+                obs->row[g] = (int8_t)b.row[l];
+            if (obs->col)
+                obs->col[g] = (int8_t)b.col[l];
+            if (obs->score)
+                obs->score[g] = b.score[l];
+            if (obs->lines)
+                obs->lines[g] = b.lines[l];
+            if (obs->level)
+                obs->level[g] = b.level[l];
+            if (obs->reward)
+                obs->reward[g] = reward[g];
+            if (obs->done)
+                obs->done[g] = done[g];
         }
     }
+};
 
-    void moveDown()
+TETRIS_ENGINE_EXPORT uint32_t tetris_engine_abi_version(void)
+{
+    return TETRIS_ENGINE_ABI_VERSION;
+}
+
+TETRIS_ENGINE_EXPORT TetrisEngine *tetris_engine_create(int32_t games, uint64_t seed, int32_t threads)
+{
+    if (games < 1)
+        return nullptr;
+    try
     {
-        if (board.canPlace(*currentPiece, currentRow + 1, currentCol))
-        {
-            currentRow++;
-        }
+        return new TetrisEngine(games, seed, threads > 0 ? threads : (int)max(1u, thread::hardware_concurrency()));
+    }
+    catch (const exception &) // out of memory or threads: nothing may cross the C boundary
+    {
+        return nullptr;
+    }
+}
+
+TETRIS_ENGINE_EXPORT void tetris_engine_destroy(TetrisEngine *engine)
+{
+    delete engine;
+}
+
+TETRIS_ENGINE_EXPORT int32_t tetris_engine_games(const TetrisEngine *engine)
+{
+    return engine ? engine->sim.size() : 0;
+}
+
+TETRIS_ENGINE_EXPORT void tetris_engine_reset(TetrisEngine *engine, uint64_t seed, const TetrisEngineObs *obs)
+{
+    if (!engine)
+        return;
+    engine->sim.reset(seed);
+    fill(engine->reward.begin(), engine->reward.end(), 0);
+    fill(engine->done.begin(), engine->done.end(), 0);
+    if (obs)
+        engine->run(nullptr, obs);
+}
+
+TETRIS_ENGINE_EXPORT void tetris_engine_step(TetrisEngine *engine, const uint8_t *actions, const TetrisEngineObs *obs)
+{
+    if (engine && actions)
+        engine->run(actions, obs);
+}
+
+// Usage: --engine-check [--games N] [--steps N] [--threads N] [--seed N]
+// Conformance check of tetris_engine.h: drives the C ABI the way a caller
+// of the library does, plays the same actions in every game on Board with
+// BatchReference (Game::lockPiece's rules), and compares every observation
+// after every step. Even games walk each piece to a random column and hard
+// drop it, which clears lines; odd games press random keys, which tops
+// them out and starts them over. Steps must not allocate.
+int runEngineCheck(int argc, char *argv[])
+{
+    int games = 256, steps = 3000, threads = 1;
+    uint64_t seed = 1;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--games" && i + 1 < argc)
+            games = max(1, atoi(argv[++i]));
+        else if (arg == "--steps" && i + 1 < argc)
+            steps = max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
         else
         {
-            lockPiece();
+            cerr << "usage: " << argv[0] << " --engine-check [--games N] [--steps N] [--threads N] [--seed N]\n";
+            return 2;
         }
     }
+    if (tetris_engine_abi_version() != TETRIS_ENGINE_ABI_VERSION)
+    {
+        cerr << "engine ABI " << tetris_engine_abi_version() << ", header " << TETRIS_ENGINE_ABI_VERSION << "\n";
+        return 1;
+    }
+    TetrisEngine *engine = tetris_engine_create(games, seed, threads);
+    if (!engine || tetris_engine_games(engine) != games)
+    {
+        cerr << "Cannot create an engine of " << games << " games\n";
+        return 1;
+    }
 
-    void lockPiece()
+    vector<uint8_t> cells((size_t)games * BOARD_HEIGHT * BOARD_WIDTH), piece(games), next(games), rotation(games);
+    vector<uint16_t> rowMasks((size_t)games * BOARD_HEIGHT);
+    vector<int8_t> row(games), col(games);
+    vector<int32_t> score(games), lines(games), level(games), reward(games);
+    vector<uint8_t> done(games), action(games);
+    TetrisEngineObs obs = {cells.data(), rowMasks.data(), piece.data(), next.data(), rotation.data(),
+                           row.data(), col.data(), score.data(), lines.data(), level.data(),
+                           reward.data(), done.data()};
+
+    vector<BatchReference> reference;
+    for (int g = 0; g < games; g++)
+        reference.emplace_back((seed + g) * 0x9E3779B97F4A7C15ull);
+    vector<uint8_t> diverged(games, 0);
+    uint64_t mismatches = 0;
+    auto compare = [&](int g, int step, int refReward, bool refDone)
     {
-        board.place(*currentPiece, currentRow, currentCol);
-        int cleared = board.clearLines();
-        if (cleared > 0)
+        const BatchReference &ref = reference[g];
+        ostringstream diff;
+        if (piece[g] != ref.type || next[g] != ref.next || rotation[g] != ref.rotation || row[g] != ref.row ||
+            col[g] != ref.col)
+            diff << "piece " << PIECE_LETTERS[piece[g] % 7] << "/" << (int)rotation[g] << " at (" << (int)row[g]
+                 << "," << (int)col[g] << ") next " << PIECE_LETTERS[next[g] % 7] << ", Board has "
+                 << PIECE_LETTERS[ref.type] << "/" << ref.rotation << " at (" << ref.row << "," << ref.col
+                 << ") next " << PIECE_LETTERS[ref.next] << "; ";
+        if (score[g] != ref.score || lines[g] != ref.lines || level[g] != ref.level)
+            diff << "score/lines/level " << score[g] << "/" << lines[g] << "/" << level[g] << ", Board has "
+                 << ref.score << "/" << ref.lines << "/" << ref.level << "; ";
+        if (reward[g] != refReward || (done[g] != 0) != refDone)
+            diff << "reward/done " << reward[g] << "/" << (int)done[g] << ", Board has " << refReward << "/"
+                 << refDone << "; ";
+        for (int r = 0; r < BOARD_HEIGHT; r++)
         {
-            score += (cleared * 100);
-            linesClearedTotal += cleared;
-            // Increase level for every 10 lines, for example
-            if (linesClearedTotal / 10 >= level)
+            for (int c = 0; c < BOARD_WIDTH; c++)
             {
-                level++;
+                bool filled = ref.board.getCell(r, c) != 0;
+                if (cells[((size_t)g * BOARD_HEIGHT + r) * BOARD_WIDTH + c] != filled ||
+                    ((rowMasks[(size_t)g * BOARD_HEIGHT + r] >> c) & 1) != filled)
+                {
+                    diff << "cell (" << r << "," << c << ") differs; ";
+                    r = BOARD_HEIGHT;
+                    break;
+                }
             }
         }
-        delete currentPiece;
-        currentPiece = nextPiece;
-        nextPiece = randomTetromino();
-        currentRow = 0;
-        currentCol = BOARD_WIDTH / 2 - 2;
-    }
+        if (diff.str().empty())
+            return;
+        // Reported once: after the first difference the two games go their own ways
+        diverged[g] = 1;
+        if (mismatches++ < 10)
+            cout << "  MISMATCH game " << g << " step " << step << " (action " << (int)action[g]
+                 << "): " << diff.str() << "\n";
+    };
 
-    void tryMove(int newRow, int newCol)
+    tetris_engine_reset(engine, seed, &obs);
+    for (int g = 0; g < games; g++)
+        compare(g, 0, 0, false);
+
+    PieceRandom actions(seed ^ 0xE6617Eull);
+    vector<uint8_t> targetRotation(games), targetCol(games);
+    countAllocations = true;
+    uint64_t allocations = 0, finished = 0;
+    double seconds = 0;
+    for (int s = 1; s <= steps; s++)
     {
-        if (board.canPlace(*currentPiece, newRow, newCol))
+        // The policy sees only what the engine wrote, as a caller would
+        for (int g = 0; g < games; g++)
+        {
+            if (g % 2)
+            {
+                action[g] = (uint8_t)((actions.next() >> 33) % BATCH_ACTIONS);
+                continue;
+            }
+            if (row[g] == 0 && rotation[g] == 0 && col[g] == BOARD_WIDTH / 2 - 2)
+            {
+                targetRotation[g] = (uint8_t)(actions.next() % 4);
+                targetCol[g] = (uint8_t)(actions.next() % (BOARD_WIDTH + 2));
+            }
+            int target = targetCol[g] - 2;
+            if (rotation[g] != targetRotation[g])
+                action[g] = TETRIS_ENGINE_ROTATE;
+            else if (col[g] != target)
+                action[g] = col[g] < target ? TETRIS_ENGINE_RIGHT : TETRIS_ENGINE_LEFT;
+            else
+                action[g] = TETRIS_ENGINE_HARD_DROP;
+        }
+
+        uint64_t allocated = allocationCount.load();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        tetris_engine_step(engine, action.data(), &obs);
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        allocations += allocationCount.load() - allocated;
+
+        for (int g = 0; g < games; g++)
         {
-            currentRow = newRow;
-            currentCol = newCol;
+            finished += done[g];
+            if (diverged[g])
+                continue;
+            bool refDone;
+            int refReward = reference[g].step(action[g], refDone);
+            compare(g, s, refReward, refDone);
         }
     }
-};
+    countAllocations = false;
+    tetris_engine_destroy(engine);
+
+    uint64_t gameSteps = (uint64_t)games * steps;
+    cout << "engine: " << games << " games x " << steps << " steps through the C ABI in "
+         << (uint64_t)(seconds * 1000.0) << " ms (" << threads << " thread" << (threads == 1 ? "" : "s") << "), "
+         << (uint64_t)(gameSteps / max(seconds, 1e-9)) << " game-steps/sec with every observation, " << finished
+         << " games finished\n"
+         << "  " << allocations << " allocations while stepping\n";
+    bool ok = mismatches == 0 && allocations == 0;
+    cout << (ok ? "OK: " : "FAILED: ") << mismatches << " of " << games << " games differ from Board after " << steps
+         << " steps" << (allocations ? ", and steps allocate" : "") << "\n";
+    return ok ? 0 : 1;
+}
+
+/**************************************************************
+ * 13) Render regression check: scripted games drawn by the
+ *     real drawInterface() into an in-memory terminal, then
+ *     compared with golden screens and per-frame output costs
+ *     (see tetris_render_check.h)
+ **************************************************************/
+
+// Usage: --render-check <script>... [--update] [--max-growth PCT]
+int runRenderCheck(int argc, char *argv[])
+{
+    return runRenderScripts(argc, argv, [](const RenderScript &script, VirtualTerminal &terminal, RenderRecorder &recorder)
+                            {
+                                Game game;
+                                game.playRenderScript(script, terminal, recorder);
+                            });
+}
 
 /**************************************************************
  * main(): Entry Point
  **************************************************************/
-int main()
+#ifndef TETRIS_LIBRARY
+int main(int argc, char *argv[])
 {
+    if (argc > 1 && string(argv[1]) == "--perft")
+        return runPerft(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--autoplay-check")
+        return runAutoplayCheck(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--oracle")
+        return runOracle(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--book")
+        return runBook(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--book-check")
+        return runBookCheck(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--selfplay")
+        return runSelfPlay(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--rollout")
+        return runRollout(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--pc")
+        return runPerfectClear(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--batch")
+        return runBatch(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--engine-check")
+        return runEngineCheck(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--render-check")
+        return runRenderCheck(argc, argv);
+
+    bool resume = true;
+    string shmName;
+    string botPath, botArgs;
+    int botBudgetUs = 1000, botStrikes = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--new")
+            resume = false;
+        else if (arg == "--stats")
+            frameStats.enable("tetris_stats.txt");
+        else if (arg.compare(0, 8, "--stats=") == 0)
+            frameStats.enable(arg.substr(8));
+        else if (arg == "--das" && i + 1 < argc)
+            inputTiming.das = max(0, atoi(argv[++i]));
+        else if (arg == "--arr" && i + 1 < argc)
+            inputTiming.arr = max(0, atoi(argv[++i]));
+        else if (arg == "--hold-gap" && i + 1 < argc)
+            inputTiming.holdGap = max(1, atoi(argv[++i]));
+        else if (arg == "--gravity" && i + 1 < argc)
+            gravityTiming.g = max(0.0, atof(argv[++i]));
+        else if (arg == "--lock-delay" && i + 1 < argc)
+            gravityTiming.lockDelay = max(0, atoi(argv[++i]));
+        else if (arg == "--lock-resets" && i + 1 < argc)
+            gravityTiming.lockResets = max(0, atoi(argv[++i]));
+        else if (arg == "--no-journal")
+            journalTiming.enabled = false;
+        else if (arg == "--journal-sync-ms" && i + 1 < argc)
+            journalTiming.syncMs = max(0, atoi(argv[++i]));
+        else if (arg == "--journal-sync-records" && i + 1 < argc)
+            journalTiming.syncRecords = max(1, atoi(argv[++i]));
+        else if (arg == "--checkpoint-locks" && i + 1 < argc)
+            journalTiming.checkpointLocks = max(0, atoi(argv[++i]));
+        else if (arg == "--autoplay")
+            autoplayOptions.enabled = true;
+        else if (arg == "--autoplay-speculate" && i + 1 < argc)
+            autoplayOptions.speculate = atoi(argv[++i]) != 0;
+#ifndef _WIN32
+        else if (arg == "--bot" && i + 1 < argc)
+            botPath = argv[++i];
+        else if (arg == "--bot-args" && i + 1 < argc)
+            botArgs = argv[++i];
+        else if (arg == "--bot-budget-us" && i + 1 < argc)
+            botBudgetUs = max(1, atoi(argv[++i]));
+        else if (arg == "--bot-strikes" && i + 1 < argc)
+            botStrikes = max(1, atoi(argv[++i]));
+        else if (arg == "--shm")
+            shmName = TETRIS_SHM_FINAL;
+        else if (arg.compare(0, 6, "--shm=") == 0)
+            shmName = arg.substr(6);
+#endif
+    }
+
+#ifndef _WIN32
+    if (!shmName.empty() && !shmExport.create(shmName.c_str()))
+        cerr << "Cannot create shared memory " << shmName << ": " << strerror(errno) << "\n";
+    if (!botPath.empty())
+    {
+        string error;
+        if (!botHost.load(botPath, botArgs, error))
+        {
+            cerr << "Cannot load bot: " << error << "\n";
+            return 1;
+        }
+        botHost.setBudget(botBudgetUs, botStrikes);
+    }
+#endif
+
+    if (autoplayOptions.enabled && autoplayOptions.speculate)
+        autoplayPlanner.start();
+
 #ifdef _WIN32
     // Optionally, enable UTF-8 in Windows console if needed:
     SetConsoleOutputCP(CP_UTF8);
 #endif
 
+    signal(SIGTERM, requestQuit);
+    signal(SIGINT, requestQuit);
+#ifdef SIGHUP
+    signal(SIGHUP, requestQuit);
+#endif
+
 Start:
     Game game;
+    // A missing or invalid save starts a new game; a save left by a crash
+    // is brought up to date from the journal
+    if (resume && game.loadSnapshot(SAVE_FILE))
+        game.replayJournal(JOURNAL_FILE);
+    resume = false;
     game.run();
+
+    // Quitting keeps the game for next time (as a plain save, the journal
+    // is only for crashes); topping out ends it. The save must be on disk
+    // before the journal that covers the same moves goes.
+    if (game.wasQuit() && game.saveSnapshot(SAVE_FILE))
+        syncSaveFile(SAVE_FILE);
+    else
+        remove(SAVE_FILE);
+    remove(JOURNAL_FILE);
+    if (quitRequested)
+    {
+        cout << "\033[?25h";
+        frameStats.writeReport();
+#ifndef _WIN32
+        writeBotReport();
+#endif
+        autoplayPlanner.stop();
+        autoplayPlanner.writeReport();
+        return 0;
+    }
     int g = game.drawGameOverScreen();
 
     if (g == 1)
         goto Start;
 
+    frameStats.writeReport();
+#ifndef _WIN32
+    writeBotReport();
+#endif
+    autoplayPlanner.stop();
+    autoplayPlanner.writeReport();
     return 0;
 }
+#endif // TETRIS_LIBRARY
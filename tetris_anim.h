@@ -0,0 +1,143 @@
+/**************************************************************
+ * Timed animations as C++20 coroutines (both games)
+ *
+ * An animation is a coroutine that draws one step, then
+ * `co_yield`s how long to wait before the next:
+ *
+ *     Animation blink()
+ *     {
+ *         paint();
+ *         co_yield std::chrono::milliseconds(200);
+ *         unpaint();
+ *     }
+ *
+ * The game loop owns an AnimationScheduler and calls run() once
+ * per tick. Steps whose wait is over are resumed right there, on
+ * the loop's thread, between input handling and the game update.
+ * Nothing sleeps, so keys keep being read while an animation
+ * plays.
+ *
+ * finish() (on a key press, say) runs the remaining steps at once
+ * without waiting, so whatever an animation does at its end
+ * (wiping the screen, removing lines) still happens.
+ *
+ * Build with -std=c++20.
+ **************************************************************/
+#ifndef TETRIS_ANIM_H
+#define TETRIS_ANIM_H
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+class Animation
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct promise_type
+    {
+        Clock::duration wait{0}; // asked for by the last co_yield
+
+        Animation get_return_object()
+        {
+            return Animation(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; } // the first step runs on the first run()
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(Clock::duration d)
+        {
+            wait = d;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Animation(Animation &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Animation &operator=(Animation &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    Animation(const Animation &) = delete;
+    Animation &operator=(const Animation &) = delete;
+    ~Animation()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool done() const { return !handle || handle.done(); }
+
+    // Runs up to the next co_yield (or the end); returns the wait it asked for
+    Clock::duration step()
+    {
+        handle.promise().wait = Clock::duration::zero();
+        handle.resume();
+        return handle.promise().wait;
+    }
+
+private:
+    explicit Animation(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+class AnimationScheduler
+{
+public:
+    typedef Animation::Clock Clock;
+
+    // Queues an animation; its first step runs on the next run(). Steps must
+    // not start other animations.
+    void start(Animation animation)
+    {
+        running.push_back({std::move(animation), Clock::time_point()});
+    }
+
+    bool active() const { return !running.empty(); }
+
+    // Resumes every animation whose wait is over; finished ones are dropped
+    void run(Clock::time_point now)
+    {
+        for (size_t i = 0; i < running.size();)
+        {
+            Entry &e = running[i];
+            while (!e.animation.done() && e.due <= now)
+                e.due = now + e.animation.step();
+            if (e.animation.done())
+                running.erase(running.begin() + i);
+            else
+                i++;
+        }
+    }
+
+    // Plays everything still running to the end, skipping the waits
+    void finish()
+    {
+        for (Entry &e : running)
+        {
+            while (!e.animation.done())
+                e.animation.step();
+        }
+        running.clear();
+    }
+
+private:
+    struct Entry
+    {
+        Animation animation;
+        Clock::time_point due;
+    };
+    std::vector<Entry> running;
+};
+
+#endif // TETRIS_ANIM_H
@@ -0,0 +1,194 @@
+/**************************************************************
+ * In-process bot plugins (Linux/macOS)
+ *
+ * A bot is a shared library that exports one C function,
+ * tetris_bot_api(), returning a table of callbacks. The game
+ * (--bot PATH) loads it with dlopen and, once per tick, hands
+ * it a view of the game and applies the buttons it returns,
+ * right inside the game loop: no pipes, sockets or copies.
+ *
+ * The view is read-only and zero-copy: `cells` points at the
+ * game's own board, so it is only valid during the call.
+ *
+ * Each call is timed. A call that takes longer than the budget
+ * (--bot-budget-us) has its buttons dropped, as if it had not
+ * answered in time, and a bot that overruns --bot-strikes
+ * calls in a row is switched off for the rest of the run; the
+ * keyboard keeps working either way. A call can't be cut short
+ * from the outside (it runs on the game thread), so the budget
+ * bounds what a slow bot gains, not how long it can stall.
+ *
+ * Plugin (C or C++, built with -shared -fPIC):
+ *     static uint32_t tick(void *bot, const TetrisBotView *view)
+ *     {
+ *         return TETRIS_BOT_HARD_DROP;
+ *     }
+ *     static const TetrisBotApi api = {TETRIS_BOT_ABI_VERSION, "dropper", 0, tick, 0};
+ *     TETRIS_BOT_EXPORT const TetrisBotApi *tetris_bot_api(void) { return &api; }
+ *
+ * Link the game with -ldl on glibc older than 2.34.
+ **************************************************************/
+#ifndef TETRIS_BOT_H
+#define TETRIS_BOT_H
+
+#include <stdint.h>
+
+#define TETRIS_BOT_ABI_VERSION 1
+#define TETRIS_BOT_ENTRY "tetris_bot_api"
+
+#ifdef __cplusplus
+#define TETRIS_BOT_EXPORT extern "C" __attribute__((visibility("default")))
+#else
+#define TETRIS_BOT_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* Buttons a tick may return, any combination. Applied in this order:
+   rotate, left/right, soft drop, hard drop. */
+#define TETRIS_BOT_LEFT 1u
+#define TETRIS_BOT_RIGHT 2u
+#define TETRIS_BOT_ROTATE 4u
+#define TETRIS_BOT_SOFT_DROP 8u
+#define TETRIS_BOT_HARD_DROP 16u
+
+typedef struct TetrisBotView
+{
+    uint32_t abiVersion;
+    uint32_t budgetUs; /* this call's budget */
+    uint64_t tick;     /* game loop tick */
+    uint64_t pieces;   /* pieces locked so far: changes when a new piece appears */
+    int32_t rows, cols;
+    int32_t rowStride;    /* cells[r * rowStride + c]; row 0 is the top */
+    const uint8_t *cells; /* 0 empty, else the game's color index */
+    int32_t score, level, lines;
+    uint8_t piece, next; /* piece types 0-6 in the game's own order */
+    uint8_t rotation;    /* rotation 0-3 of the falling piece */
+    uint8_t reserved;
+    int8_t minos[4][2]; /* (row, col) of each cell of the falling piece */
+} TetrisBotView;
+
+typedef struct TetrisBotApi
+{
+    uint32_t abiVersion; /* TETRIS_BOT_ABI_VERSION the plugin was built against */
+    const char *name;
+    void *(*create)(const char *args);                       /* optional; args from --bot-args */
+    uint32_t (*tick)(void *bot, const TetrisBotView *view); /* returns TETRIS_BOT_* buttons */
+    void (*destroy)(void *bot);                              /* optional */
+} TetrisBotApi;
+
+typedef const TetrisBotApi *(*TetrisBotEntry)(void);
+
+#ifdef __cplusplus
+
+#include <chrono>
+#include <string>
+#include <dlfcn.h>
+
+/**************************************************************
+ * Host side: owned by the game
+ **************************************************************/
+class TetrisBotHost
+{
+public:
+    TetrisBotHost() = default;
+    TetrisBotHost(const TetrisBotHost &) = delete;
+    TetrisBotHost &operator=(const TetrisBotHost &) = delete;
+    ~TetrisBotHost() { unload(); }
+
+    // False with a reason in `error` if the library or its table is unusable
+    bool load(const std::string &path, const std::string &args, std::string &error)
+    {
+        unload();
+        // dlopen searches the library path for a bare name; a bot next to the game is meant
+        std::string file = path.find('/') == std::string::npos ? "./" + path : path;
+        library = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!library)
+        {
+            error = dlerror();
+            return false;
+        }
+        TetrisBotEntry entry = reinterpret_cast<TetrisBotEntry>(dlsym(library, TETRIS_BOT_ENTRY));
+        api = entry ? entry() : nullptr;
+        if (!api || api->abiVersion != TETRIS_BOT_ABI_VERSION || !api->tick)
+        {
+            error = !entry ? "no " TETRIS_BOT_ENTRY "() in " + path
+                           : "incompatible bot ABI in " + path;
+            unload();
+            return false;
+        }
+        bot = api->create ? api->create(args.c_str()) : nullptr;
+        botName = api->name ? api->name : path;
+        active = true;
+        return true;
+    }
+
+    void unload()
+    {
+        if (api && api->destroy)
+            api->destroy(bot);
+        if (library)
+            dlclose(library);
+        library = nullptr;
+        api = nullptr;
+        bot = nullptr;
+        active = false;
+    }
+
+    void setBudget(uint32_t microseconds, int strikesAllowed)
+    {
+        budgetUs = microseconds;
+        strikes = strikesAllowed;
+    }
+
+    bool isActive() const { return active; }
+    const std::string &name() const { return botName; }
+    uint32_t budget() const { return budgetUs; }
+
+    // Runs one tick of the bot. Returns its buttons, or 0 if it overran the
+    // budget. lastCallNs() has how long it took either way.
+    uint32_t call(TetrisBotView &view)
+    {
+        if (!active)
+            return 0;
+        view.abiVersion = TETRIS_BOT_ABI_VERSION;
+        view.budgetUs = budgetUs;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint32_t buttons = api->tick(bot, &view);
+        lastNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+        calls++;
+        if (lastNs <= (uint64_t)budgetUs * 1000)
+        {
+            overrunStreak = 0;
+            return buttons;
+        }
+        overruns++;
+        if (++overrunStreak >= strikes)
+        {
+            active = false; // stays loaded until unload(), just never called again
+            disabled = true;
+        }
+        return 0;
+    }
+
+    uint64_t lastCallNs() const { return lastNs; }
+    uint64_t callCount() const { return calls; }
+    uint64_t overrunCount() const { return overruns; }
+    bool wasDisabled() const { return disabled; }
+
+private:
+    void *library = nullptr;
+    const TetrisBotApi *api = nullptr;
+    void *bot = nullptr;
+    std::string botName;
+    bool active = false;
+    bool disabled = false;
+    uint32_t budgetUs = 1000;
+    int strikes = 10;
+    int overrunStreak = 0;
+    uint64_t lastNs = 0, calls = 0, overruns = 0;
+};
+
+#endif /* __cplusplus */
+
+#endif /* TETRIS_BOT_H */
@@ -0,0 +1,94 @@
+/**************************************************************
+ * Embedded engine: many games stepped in one call, from C
+ *
+ * The final version's batch simulator (--batch) built as a
+ * shared library with a plain C ABI, for training and analysis
+ * tools in any language that can call C:
+ *
+ *     g++ -std=c++20 -O2 -shared -fPIC -fvisibility=hidden \
+ *         -DTETRIS_LIBRARY Tetris_Final_Version.cpp -o libtetris_engine.so
+ *
+ * One tetris_engine_step() call plays one action in every game
+ * (the move, if it fits, then a row of gravity; a piece that
+ * can't fall locks, the piece after a drop gets that row, and
+ * a game that tops out starts over). The
+ * rules are Board's and Game::lockPiece's; `Tetris_Final_Version
+ * --engine-check` plays the same inputs through both and
+ * compares every observation.
+ *
+ * Observations go straight into arrays the caller owns, one
+ * after another for every game: set the fields you want and
+ * leave the rest NULL. Stepping allocates nothing.
+ *
+ *     TetrisEngine *engine = tetris_engine_create(4096, 1, 0);
+ *     uint8_t cells[4096 * TETRIS_ENGINE_ROWS * TETRIS_ENGINE_COLS];
+ *     TetrisEngineObs obs = {0};
+ *     obs.cells = cells;
+ *     tetris_engine_reset(engine, 1, &obs);
+ *     tetris_engine_step(engine, actions, &obs);
+ *     tetris_engine_destroy(engine);
+ **************************************************************/
+#ifndef TETRIS_ENGINE_H
+#define TETRIS_ENGINE_H
+
+#include <stdint.h>
+
+#define TETRIS_ENGINE_ABI_VERSION 1
+
+#ifdef __cplusplus
+#define TETRIS_ENGINE_EXTERN extern "C"
+#else
+#define TETRIS_ENGINE_EXTERN
+#endif
+#ifdef _WIN32
+#define TETRIS_ENGINE_EXPORT TETRIS_ENGINE_EXTERN __declspec(dllexport)
+#else
+#define TETRIS_ENGINE_EXPORT TETRIS_ENGINE_EXTERN __attribute__((visibility("default")))
+#endif
+
+#define TETRIS_ENGINE_ROWS 20
+#define TETRIS_ENGINE_COLS 10
+
+/* One action per game per step. Any other value does nothing. */
+#define TETRIS_ENGINE_NONE 0
+#define TETRIS_ENGINE_LEFT 1
+#define TETRIS_ENGINE_RIGHT 2
+#define TETRIS_ENGINE_ROTATE 3
+#define TETRIS_ENGINE_SOFT_DROP 4 /* locks at once on the ground */
+#define TETRIS_ENGINE_HARD_DROP 5
+
+typedef struct TetrisEngine TetrisEngine;
+
+/* Arrays filled by reset and step, indexed by game g; NULL skips one.
+   Piece types 0-6 are I O T S Z J L. */
+typedef struct TetrisEngineObs
+{
+    uint8_t *cells;     /* [g][row][col], 1 filled, 0 empty; row 0 is the top. Locked cells only */
+    uint16_t *rowMasks; /* [g][row], bit c set if column c is filled */
+    uint8_t *piece;     /* falling piece */
+    uint8_t *next;
+    uint8_t *rotation; /* quarter turns clockwise from the spawn shape */
+    int8_t *row, *col; /* top-left of the piece's 4x4 box, may be off the board */
+    int32_t *score, *lines, *level;
+    int32_t *reward; /* points scored by this step */
+    uint8_t *done;   /* topped out this step; the game has already started over */
+} TetrisEngineObs;
+
+/* TETRIS_ENGINE_ABI_VERSION of the library, to check against the header */
+TETRIS_ENGINE_EXPORT uint32_t tetris_engine_abi_version(void);
+
+/* `games` games, game g drawing its pieces from a stream seeded by
+   (seed, g). threads 0 uses every core. NULL if games < 1 or out of memory. */
+TETRIS_ENGINE_EXPORT TetrisEngine *tetris_engine_create(int32_t games, uint64_t seed, int32_t threads);
+TETRIS_ENGINE_EXPORT void tetris_engine_destroy(TetrisEngine *engine);
+TETRIS_ENGINE_EXPORT int32_t tetris_engine_games(const TetrisEngine *engine);
+
+/* Starts every game over from `seed` and fills obs (may be NULL); reward
+   and done are zeroed */
+TETRIS_ENGINE_EXPORT void tetris_engine_reset(TetrisEngine *engine, uint64_t seed, const TetrisEngineObs *obs);
+
+/* Plays actions[g] in every game g, then fills obs (may be NULL) */
+TETRIS_ENGINE_EXPORT void tetris_engine_step(TetrisEngine *engine, const uint8_t *actions,
+                                             const TetrisEngineObs *obs);
+
+#endif /* TETRIS_ENGINE_H */
@@ -0,0 +1,648 @@
+/**************************************************************
+ * Render regression check (both games, --render-check)
+ *
+ * A script of moves is played through the game's own renderer
+ * with cout pointed at a VirtualTerminal: a small in-memory
+ * terminal that applies the ANSI output to a grid of cells and
+ * counts, per frame, the bytes written, the escape sequences in
+ * them and the write calls (flushes) they went out in.
+ *
+ * The result is compared with a golden file next to the script
+ * (name.script -> name.golden):
+ *   - the screen text and colors at every checkpoint must match
+ *     exactly;
+ *   - total bytes and escapes may not grow by more than
+ *     --max-growth percent, and neither may any single frame
+ *     (plus a little slack for a longer number on screen);
+ *   - no frame may take more write calls than before.
+ * --update rewrites the golden from the current renderer.
+ *
+ * Script format ('#' starts a comment):
+ *     seed 42
+ *     keys LLS RRUS | DDGG S |
+ * Moves: L/R left and right, U rotate, D soft drop, S hard drop,
+ * G one row of gravity, '.' an idle frame; '|' keeps a snapshot
+ * of the screen as it is. Every move draws one frame, and the
+ * last frame is always kept.
+ **************************************************************/
+#ifndef TETRIS_RENDER_CHECK_H
+#define TETRIS_RENDER_CHECK_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+struct RenderCost
+{
+    uint64_t bytes = 0;
+    uint64_t escapes = 0;
+    uint64_t writes = 0;
+};
+
+/**************************************************************
+ * In-memory terminal
+ **************************************************************/
+class VirtualTerminal : public std::streambuf
+{
+public:
+    static const int ROWS = 32;
+    static const int COLS = 100;
+
+    VirtualTerminal()
+    {
+        setp(buffer, buffer + sizeof(buffer));
+        clear();
+    }
+
+    // Blank screen, cursor home, default colors
+    void clear()
+    {
+        for (int r = 0; r < ROWS; r++)
+            for (int c = 0; c < COLS; c++)
+                cells[r][c] = Cell();
+        row = col = 0;
+        style.clear();
+        fg.clear();
+        bg.clear();
+        bold = false;
+    }
+
+    // What went out since the last call; output not flushed yet is
+    // counted too, as the write the next flush would make
+    RenderCost takeCost()
+    {
+        sync();
+        RenderCost result = cost;
+        cost = RenderCost();
+        return result;
+    }
+
+    // One line per row, trailing blanks dropped
+    std::string screenText() const
+    {
+        std::string text;
+        for (int r = 0; r < ROWS; r++)
+        {
+            std::string line;
+            size_t used = 0;
+            for (int c = 0; c < COLS; c++)
+            {
+                line += cells[r][c].glyph;
+                if (cells[r][c].glyph != " ")
+                    used = line.size();
+            }
+            text += "|" + line.substr(0, used) + "\n";
+        }
+        return text;
+    }
+
+    // Same grid with one letter per style ('.' for the default), lettered in
+    // order of first appearance across every call with the same `letters`
+    std::string styleText(std::map<std::string, char> &letters) const
+    {
+        std::string text;
+        for (int r = 0; r < ROWS; r++)
+        {
+            std::string line;
+            size_t used = 0;
+            for (int c = 0; c < COLS; c++)
+            {
+                const std::string &s = cells[r][c].style;
+                char letter = '.';
+                if (!s.empty())
+                {
+                    std::map<std::string, char>::iterator it = letters.find(s);
+                    if (it == letters.end())
+                        it = letters.insert({s, (char)('A' + letters.size() % 26)}).first;
+                    letter = it->second;
+                    used = line.size() + 1;
+                }
+                line += letter;
+            }
+            text += "|" + line.substr(0, used) + "\n";
+        }
+        return text;
+    }
+
+protected:
+    int overflow(int ch) override
+    {
+        flushBuffer();
+        if (ch != traits_type::eof())
+        {
+            *pptr() = (char)ch;
+            pbump(1);
+        }
+        return ch == traits_type::eof() ? 0 : ch;
+    }
+
+    int sync() override
+    {
+        flushBuffer();
+        return 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::string glyph = " ";
+        std::string style; // "" for default, else e.g. "bg=44 fg=37 bold"
+    };
+
+    char buffer[4096];
+    Cell cells[ROWS][COLS];
+    RenderCost cost;
+    int row = 0, col = 0;
+    std::string fg, bg, style;
+    bool bold = false;
+
+    // Parser state
+    enum
+    {
+        TEXT,
+        ESCAPE,
+        CSI
+    } state = TEXT;
+    std::string sequence;  // CSI parameters so far
+    std::string character; // UTF-8 bytes of the character so far
+    int pending = 0;       // continuation bytes it still needs
+
+    // Everything written since the last flush reaches the terminal as one write
+    void flushBuffer()
+    {
+        if (pptr() == pbase())
+            return;
+        for (const char *p = pbase(); p < pptr(); p++)
+            feed((unsigned char)*p);
+        cost.bytes += pptr() - pbase();
+        cost.writes++;
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    void feed(unsigned char ch)
+    {
+        if (state == ESCAPE)
+        {
+            state = ch == '[' ? CSI : TEXT;
+            sequence.clear();
+            if (state == TEXT)
+                cost.escapes++; // two-byte sequence, nothing this terminal draws
+            return;
+        }
+        if (state == CSI)
+        {
+            if (ch >= 0x40 && ch <= 0x7E)
+            {
+                state = TEXT;
+                cost.escapes++;
+                control((char)ch);
+            }
+            else
+            {
+                sequence += (char)ch;
+            }
+            return;
+        }
+
+        if (pending > 0 && (ch & 0xC0) == 0x80)
+        {
+            character += (char)ch;
+            if (--pending == 0)
+                put(character);
+            return;
+        }
+        pending = 0;
+        if (ch == 0x1B)
+            state = ESCAPE;
+        else if (ch == '\n')
+            lineFeed(); // the tty turns \n into \r\n
+        else if (ch == '\r')
+            col = 0;
+        else if (ch == '\b')
+            col = col > 0 ? col - 1 : 0;
+        else if (ch >= 0xC0)
+        {
+            character.assign(1, (char)ch);
+            pending = ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : 1;
+        }
+        else if (ch >= 0x20 && ch < 0x7F)
+            put(std::string(1, (char)ch));
+    }
+
+    void put(const std::string &glyph)
+    {
+        if (row < ROWS && col < COLS)
+        {
+            cells[row][col].glyph = glyph;
+            cells[row][col].style = style;
+        }
+        col++; // past the right edge characters are just lost, no wrap
+    }
+
+    void lineFeed()
+    {
+        col = 0;
+        if (++row < ROWS)
+            return;
+        row = ROWS - 1;
+        for (int r = 0; r + 1 < ROWS; r++)
+            for (int c = 0; c < COLS; c++)
+                cells[r][c] = cells[r + 1][c];
+        for (int c = 0; c < COLS; c++)
+            cells[ROWS - 1][c] = Cell();
+    }
+
+    std::vector<int> parameters() const
+    {
+        std::vector<int> values;
+        std::string digits;
+        for (size_t i = 0; i <= sequence.size(); i++)
+        {
+            if (i == sequence.size() || sequence[i] == ';')
+            {
+                values.push_back(digits.empty() ? 0 : atoi(digits.c_str()));
+                digits.clear();
+            }
+            else if (sequence[i] >= '0' && sequence[i] <= '9')
+            {
+                digits += sequence[i];
+            }
+        }
+        return values;
+    }
+
+    void control(char final)
+    {
+        if (!sequence.empty() && sequence[0] == '?')
+            return; // private modes (cursor visibility and the like)
+        std::vector<int> p = parameters();
+        int n = p[0] > 0 ? p[0] : 1;
+        switch (final)
+        {
+        case 'H':
+        case 'f':
+            row = n - 1;
+            col = (p.size() > 1 && p[1] > 0 ? p[1] : 1) - 1;
+            break;
+        case 'A':
+            row = row > n ? row - n : 0;
+            break;
+        case 'B':
+            row += n;
+            break;
+        case 'C':
+            col += n;
+            break;
+        case 'D':
+            col = col > n ? col - n : 0;
+            break;
+        case 'J':
+            for (int r = p[0] == 2 ? 0 : row; r < ROWS; r++)
+                for (int c = (p[0] == 2 || r > row) ? 0 : col; c < COLS; c++)
+                    cells[r][c] = Cell();
+            break;
+        case 'K':
+            if (row < ROWS)
+                for (int c = p[0] == 2 ? 0 : col; c < COLS; c++)
+                    cells[row][c] = Cell();
+            break;
+        case 'm':
+            graphics(p);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void graphics(const std::vector<int> &p)
+    {
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            int v = p[i];
+            if (v == 0)
+            {
+                fg.clear();
+                bg.clear();
+                bold = false;
+            }
+            else if (v == 1)
+                bold = true;
+            else if (v == 22)
+                bold = false;
+            else if ((v == 38 || v == 48) && i + 2 < p.size() && p[i + 1] == 5)
+            {
+                (v == 38 ? fg : bg) = std::to_string(v) + ";5;" + std::to_string(p[i + 2]);
+                i += 2;
+            }
+            else if ((v >= 30 && v <= 37) || (v >= 90 && v <= 97))
+                fg = std::to_string(v);
+            else if ((v >= 40 && v <= 47) || (v >= 100 && v <= 107))
+                bg = std::to_string(v);
+            else if (v == 39)
+                fg.clear();
+            else if (v == 49)
+                bg.clear();
+        }
+        style.clear();
+        if (!bg.empty())
+            style += "bg=" + bg;
+        if (!fg.empty())
+            style += (style.empty() ? "fg=" : " fg=") + fg;
+        if (bold)
+            style += style.empty() ? "bold" : " bold";
+    }
+};
+
+/**************************************************************
+ * Scripts and golden files
+ **************************************************************/
+struct RenderScript
+{
+    uint64_t seed = 1;
+    std::string moves;
+};
+
+inline bool loadRenderScript(const std::string &path, RenderScript &script)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        fprintf(stderr, "render-check: can't read %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string word;
+        if (!(words >> word))
+            continue;
+        if (word == "seed")
+        {
+            words >> script.seed;
+        }
+        else if (word == "keys")
+        {
+            while (words >> word)
+            {
+                if (word.find_first_not_of("LRUDSG.|") != std::string::npos)
+                {
+                    fprintf(stderr, "render-check: %s: unknown move in \"%s\"\n", path.c_str(), word.c_str());
+                    return false;
+                }
+                script.moves += word;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "render-check: %s: unknown line \"%s\"\n", path.c_str(), line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// What a script run produced: the cost of every frame, and the screens kept
+// at its checkpoints (as text, with the style legend at the end)
+struct RenderRecord
+{
+    std::vector<RenderCost> frames;
+    std::string screens;
+};
+
+// Records frames from `terminal`; the game's driver calls frame() after
+// drawing each one and snapshot() at the checkpoints
+class RenderRecorder
+{
+public:
+    explicit RenderRecorder(VirtualTerminal &t) : terminal(t) {}
+
+    void frame() { record.frames.push_back(terminal.takeCost()); }
+
+    void snapshot()
+    {
+        record.screens += "screen " + std::to_string(record.frames.size() - 1) + "\n";
+        record.screens += terminal.screenText();
+        record.screens += "styles\n";
+        record.screens += terminal.styleText(letters);
+    }
+
+    RenderRecord finish()
+    {
+        std::vector<std::string> legend(letters.size());
+        for (const std::pair<const std::string, char> &entry : letters)
+            legend[(entry.second - 'A') % legend.size()] = std::string(1, entry.second) + " " + entry.first;
+        for (const std::string &line : legend)
+            record.screens += "style " + line + "\n";
+        return record;
+    }
+
+private:
+    VirtualTerminal &terminal;
+    std::map<std::string, char> letters;
+    RenderRecord record;
+};
+
+inline std::string renderGoldenPath(const std::string &script)
+{
+    size_t dot = script.rfind(".script");
+    return (dot == std::string::npos ? script : script.substr(0, dot)) + ".golden";
+}
+
+inline bool writeRenderGolden(const std::string &path, const std::string &script, const RenderRecord &record)
+{
+    std::ofstream out(path);
+    out << "# Rendered from " << script << " by --render-check --update\n";
+    out << "# frame <n> <bytes> <escapes> <writes>\n";
+    for (size_t i = 0; i < record.frames.size(); i++)
+    {
+        const RenderCost &c = record.frames[i];
+        out << "frame " << i << " " << c.bytes << " " << c.escapes << " " << c.writes << "\n";
+    }
+    out << record.screens;
+    return (bool)out;
+}
+
+inline bool readRenderGolden(const std::string &path, RenderRecord &record)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line.compare(0, 6, "frame ") == 0)
+        {
+            RenderCost c;
+            unsigned long long n, bytes, escapes, writes;
+            if (sscanf(line.c_str(), "frame %llu %llu %llu %llu", &n, &bytes, &escapes, &writes) != 4)
+                return false;
+            c.bytes = bytes;
+            c.escapes = escapes;
+            c.writes = writes;
+            record.frames.push_back(c);
+        }
+        else
+        {
+            record.screens += line + "\n";
+        }
+    }
+    return true;
+}
+
+// Compares a run with its golden; prints every regression to stdout and
+// returns how many there were. Frames may grow by `growth` (0.05 for 5%).
+inline int compareRender(const RenderRecord &golden, const RenderRecord &actual, double growth)
+{
+    const uint64_t FRAME_SLACK = 32; // a score gaining digits is not a regression
+    int failures = 0;
+    RenderCost goldenTotal, actualTotal;
+    for (const RenderCost &c : golden.frames)
+    {
+        goldenTotal.bytes += c.bytes;
+        goldenTotal.escapes += c.escapes;
+        goldenTotal.writes += c.writes;
+    }
+    for (const RenderCost &c : actual.frames)
+    {
+        actualTotal.bytes += c.bytes;
+        actualTotal.escapes += c.escapes;
+        actualTotal.writes += c.writes;
+    }
+
+    if (golden.frames.size() != actual.frames.size())
+    {
+        printf("  %zu frames, golden has %zu (script changed? run with --update)\n",
+               actual.frames.size(), golden.frames.size());
+        return 1;
+    }
+    int grown = 0;
+    for (size_t i = 0; i < actual.frames.size(); i++)
+    {
+        const RenderCost &g = golden.frames[i], &a = actual.frames[i];
+        bool bigger = a.bytes > g.bytes * (1 + growth) + FRAME_SLACK;
+        if (!bigger && a.writes <= g.writes)
+            continue;
+        if (++grown <= 5) // the first few say enough
+            printf("  frame %zu: %llu bytes in %llu writes, golden %llu in %llu\n", i,
+                   (unsigned long long)a.bytes, (unsigned long long)a.writes, (unsigned long long)g.bytes,
+                   (unsigned long long)g.writes);
+    }
+    if (grown > 5)
+        printf("  ... %d frames grew in all\n", grown);
+    failures += grown;
+    if (actualTotal.bytes > goldenTotal.bytes * (1 + growth))
+    {
+        printf("  total bytes %llu, golden %llu (+%.1f%%)\n", (unsigned long long)actualTotal.bytes,
+               (unsigned long long)goldenTotal.bytes, 100.0 * actualTotal.bytes / goldenTotal.bytes - 100);
+        failures++;
+    }
+    if (actualTotal.escapes > goldenTotal.escapes * (1 + growth))
+    {
+        printf("  total escapes %llu, golden %llu\n", (unsigned long long)actualTotal.escapes,
+               (unsigned long long)goldenTotal.escapes);
+        failures++;
+    }
+
+    if (actual.screens != golden.screens)
+    {
+        // Point at the first line that differs, with the checkpoint it's in
+        std::istringstream a(actual.screens), g(golden.screens);
+        std::string lineA, lineG, section;
+        for (int n = 1;; n++)
+        {
+            bool moreA = (bool)std::getline(a, lineA), moreG = (bool)std::getline(g, lineG);
+            if (!moreA && !moreG)
+                break;
+            if (moreA && lineA[0] != '|')
+                section = lineA;
+            if (!moreA || !moreG || lineA != lineG)
+            {
+                printf("  %s differs:\n    got    %s\n    golden %s\n", section.c_str(),
+                       moreA ? lineA.c_str() : "(end)", moreG ? lineG.c_str() : "(end)");
+                break;
+            }
+        }
+        failures++;
+    }
+
+    printf("  %zu frames, %llu bytes, %llu escapes, %llu writes (golden %llu bytes)\n", actual.frames.size(),
+           (unsigned long long)actualTotal.bytes, (unsigned long long)actualTotal.escapes,
+           (unsigned long long)actualTotal.writes, (unsigned long long)goldenTotal.bytes);
+    return failures;
+}
+
+// Usage: --render-check <script>... [--update] [--max-growth PCT]
+// `play(script, terminal, recorder)` runs one script through the game's
+// renderer with cout writing to `terminal`.
+template <typename Play>
+int runRenderScripts(int argc, char *argv[], Play play)
+{
+    std::vector<std::string> scripts;
+    bool update = false;
+    double growth = 0.05;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--update")
+            update = true;
+        else if (arg == "--max-growth" && i + 1 < argc)
+            growth = atof(argv[++i]) / 100.0;
+        else
+            scripts.push_back(arg);
+    }
+    if (scripts.empty())
+    {
+        fprintf(stderr, "usage: %s --render-check <script>... [--update] [--max-growth PCT]\n", argv[0]);
+        return 2;
+    }
+
+    int failed = 0;
+    for (const std::string &path : scripts)
+    {
+        RenderScript script;
+        if (!loadRenderScript(path, script))
+            return 2;
+        VirtualTerminal terminal;
+        RenderRecorder recorder(terminal);
+        play(script, terminal, recorder);
+        RenderRecord actual = recorder.finish();
+
+        std::string goldenPath = renderGoldenPath(path);
+        if (update)
+        {
+            if (!writeRenderGolden(goldenPath, path, actual))
+            {
+                fprintf(stderr, "render-check: can't write %s\n", goldenPath.c_str());
+                return 2;
+            }
+            printf("%s: wrote %s (%zu frames)\n", path.c_str(), goldenPath.c_str(), actual.frames.size());
+            continue;
+        }
+
+        RenderRecord golden;
+        if (!readRenderGolden(goldenPath, golden))
+        {
+            printf("%s: no golden at %s (run with --update)\n", path.c_str(), goldenPath.c_str());
+            failed++;
+            continue;
+        }
+        printf("%s:\n", path.c_str());
+        if (compareRender(golden, actual, growth) > 0)
+            failed++;
+    }
+    if (!update)
+        printf("%s: %zu/%zu scripts match\n", failed ? "FAILED" : "OK", scripts.size() - failed, scripts.size());
+    return failed ? 1 : 0;
+}
+
+#endif // TETRIS_RENDER_CHECK_H
@@ -0,0 +1,237 @@
+/**************************************************************
+ * Live game state in POSIX shared memory (Linux/macOS)
+ *
+ * A running game (--shm) publishes its state once per tick into
+ * a small shared-memory segment. Any number of local readers
+ * (overlays, analytics) map the same segment read-only and take
+ * snapshots without syscalls, pipes or locks.
+ *
+ * The segment is a seqlock: the writer makes the sequence odd,
+ * stores the snapshot words, then makes it even again. A reader
+ * copies the words between two reads of the sequence and keeps
+ * the copy only if both reads are the same even number. The
+ * writer never waits for readers; a reader that races a publish
+ * just tries again.
+ *
+ * The snapshot is stored as relaxed 64-bit atomics so the copy is
+ * race-free; TetrisShmSnapshot is its plain-struct view.
+ *
+ * Reader:
+ *     TetrisShmReader reader;
+ *     if (reader.open(TETRIS_SHM_FINAL))
+ *     {
+ *         TetrisShmSnapshot s;
+ *         if (reader.read(s)) ...
+ *     }
+ *
+ * Link with -lrt on glibc older than 2.34.
+ **************************************************************/
+#ifndef TETRIS_SHM_H
+#define TETRIS_SHM_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Default segment names for the two games
+#define TETRIS_SHM_FINAL "/tetris_final"
+#define TETRIS_SHM_CLASSIC "/tetris"
+
+const uint32_t TETRIS_SHM_MAGIC = 0x4D485354; // "TSHM"
+const uint16_t TETRIS_SHM_VERSION = 1;
+const int TETRIS_SHM_ROWS = 20; // room for the larger board; `rows` says how many are used
+const int TETRIS_SHM_COLS = 10;
+
+// Flag bits in TetrisShmSnapshot::flags
+const uint8_t TETRIS_SHM_PAUSED = 1;
+const uint8_t TETRIS_SHM_GAME_OVER = 2;
+
+const uint8_t TETRIS_SHM_NO_PIECE = 0xFF;
+
+struct TetrisShmSnapshot
+{
+    uint64_t tick; // game loop tick this state is from
+    int32_t score;
+    int32_t level;
+    int32_t lines;
+    int32_t reserved0;
+    uint8_t rows, cols;      // board size in use
+    uint8_t piece, next;     // piece type 0-6 in the game's own order, or TETRIS_SHM_NO_PIECE
+    uint8_t rotation, flags; // rotation 0-3 of the falling piece; TETRIS_SHM_* flags
+    int8_t minos[4][2];      // (row, col) of each cell of the falling piece
+    uint8_t reserved1[2];
+    uint8_t cells[TETRIS_SHM_ROWS][TETRIS_SHM_COLS]; // locked cells: 0 empty, else the game's color index
+};
+
+const int TETRIS_SHM_WORDS = sizeof(TetrisShmSnapshot) / 8;
+static_assert(sizeof(TetrisShmSnapshot) % 8 == 0, "snapshot must be whole 64-bit words");
+static_assert(sizeof(TetrisShmSnapshot) == 240, "TetrisShmSnapshot layout changed: bump TETRIS_SHM_VERSION");
+
+struct TetrisShmSegment
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t snapshotSize;
+    std::atomic<uint32_t> sequence; // odd while a publish is in progress
+    int32_t writerPid;              // for readers to notice the game is gone
+    std::atomic<uint64_t> words[TETRIS_SHM_WORDS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory atomics must be lock-free");
+
+/**************************************************************
+ * Writer: owned by the game, removes the segment on exit
+ **************************************************************/
+class TetrisShmWriter
+{
+public:
+    TetrisShmWriter() = default;
+    TetrisShmWriter(const TetrisShmWriter &) = delete;
+    TetrisShmWriter &operator=(const TetrisShmWriter &) = delete;
+    ~TetrisShmWriter() { close(); }
+
+    bool create(const char *name)
+    {
+        close();
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+        if (fd < 0)
+            return false;
+        bool sized = ftruncate(fd, sizeof(TetrisShmSegment)) == 0;
+        void *map = sized ? mmap(nullptr, sizeof(TetrisShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map == MAP_FAILED)
+        {
+            shm_unlink(name);
+            return false;
+        }
+        segment = static_cast<TetrisShmSegment *>(map);
+        strncpy(segmentName, name, sizeof(segmentName) - 1);
+        segmentName[sizeof(segmentName) - 1] = 0;
+
+        // A segment left by a writer that died mid-publish stays odd: even it out
+        uint32_t seq = segment->sequence.load(std::memory_order_relaxed);
+        if (seq & 1)
+            segment->sequence.store(seq + 1, std::memory_order_release);
+        segment->magic = TETRIS_SHM_MAGIC;
+        segment->version = TETRIS_SHM_VERSION;
+        segment->snapshotSize = sizeof(TetrisShmSnapshot);
+        segment->writerPid = (int32_t)getpid();
+        return true;
+    }
+
+    bool isOpen() const { return segment != nullptr; }
+
+    void publish(const TetrisShmSnapshot &snapshot)
+    {
+        if (!segment)
+            return;
+        uint64_t words[TETRIS_SHM_WORDS];
+        memcpy(words, &snapshot, sizeof(words));
+        uint32_t seq = segment->sequence.load(std::memory_order_relaxed);
+        segment->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < TETRIS_SHM_WORDS; i++)
+            segment->words[i].store(words[i], std::memory_order_relaxed);
+        segment->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Unmaps and removes the name; readers keep whatever they have mapped
+    void close()
+    {
+        if (!segment)
+            return;
+        munmap(segment, sizeof(TetrisShmSegment));
+        shm_unlink(segmentName);
+        segment = nullptr;
+    }
+
+private:
+    TetrisShmSegment *segment = nullptr;
+    char segmentName[64] = {0};
+};
+
+/**************************************************************
+ * Reader: never blocks the writer, never writes the segment
+ **************************************************************/
+class TetrisShmReader
+{
+public:
+    TetrisShmReader() = default;
+    TetrisShmReader(const TetrisShmReader &) = delete;
+    TetrisShmReader &operator=(const TetrisShmReader &) = delete;
+    ~TetrisShmReader() { close(); }
+
+    // False if the segment doesn't exist (yet) or isn't a compatible layout
+    bool open(const char *name)
+    {
+        close();
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool sized = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TetrisShmSegment);
+        void *map = sized ? mmap(nullptr, sizeof(TetrisShmSegment), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+        segment = static_cast<const TetrisShmSegment *>(map);
+        if (segment->magic != TETRIS_SHM_MAGIC || segment->version != TETRIS_SHM_VERSION ||
+            segment->snapshotSize != sizeof(TetrisShmSnapshot))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpen() const { return segment != nullptr; }
+
+    // Changes on every publish; compare against the last value to poll cheaply
+    uint32_t sequence() const
+    {
+        return segment ? segment->sequence.load(std::memory_order_acquire) : 0;
+    }
+
+    int writerPid() const { return segment ? segment->writerPid : 0; }
+
+    // Copies a consistent snapshot. Gives up after `attempts` torn copies,
+    // which only happens if the writer publishes faster than we can copy.
+    bool read(TetrisShmSnapshot &out, int attempts = 64) const
+    {
+        if (!segment)
+            return false;
+        uint64_t words[TETRIS_SHM_WORDS];
+        for (int attempt = 0; attempt < attempts; attempt++)
+        {
+            uint32_t before = segment->sequence.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+            for (int i = 0; i < TETRIS_SHM_WORDS; i++)
+                words[i] = segment->words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (segment->sequence.load(std::memory_order_relaxed) == before)
+            {
+                memcpy(&out, words, sizeof(out));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void close()
+    {
+        if (segment)
+            munmap(const_cast<TetrisShmSegment *>(segment), sizeof(TetrisShmSegment));
+        segment = nullptr;
+    }
+
+private:
+    const TetrisShmSegment *segment = nullptr;
+};
+
+#endif // TETRIS_SHM_H
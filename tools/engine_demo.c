@@ -0,0 +1,74 @@
+/**************************************************************
+ * Embedded engine demo, in plain C
+ *
+ * Sample client for tetris_engine.h. Steps a batch of games
+ * with random actions, reading back only the rewards and the
+ * game-over flags, and prints the step rate and the points
+ * scored.
+ *
+ * Build:  g++ -std=c++20 -O2 -shared -fPIC -fvisibility=hidden -DTETRIS_LIBRARY \
+ *             Tetris_Final_Version.cpp -o libtetris_engine.so
+ *         cc -O2 -std=c99 tools/engine_demo.c -L. -ltetris_engine -Wl,-rpath,. -o engine_demo
+ * Usage:  ./engine_demo [games] [steps] [threads]
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../tetris_engine.h"
+
+int main(int argc, char **argv)
+{
+    int games = argc > 1 ? atoi(argv[1]) : 4096;
+    int steps = argc > 2 ? atoi(argv[2]) : 1000;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    if (tetris_engine_abi_version() != TETRIS_ENGINE_ABI_VERSION)
+    {
+        fprintf(stderr, "libtetris_engine ABI %u, header %d\n", tetris_engine_abi_version(), TETRIS_ENGINE_ABI_VERSION);
+        return 1;
+    }
+    TetrisEngine *engine = tetris_engine_create(games, 1, threads);
+    uint8_t *actions = malloc((size_t)games);
+    int32_t *reward = malloc((size_t)games * sizeof(int32_t));
+    uint8_t *done = malloc((size_t)games);
+    if (!engine || !actions || !reward || !done)
+    {
+        fprintf(stderr, "Cannot create %d games\n", games);
+        return 1;
+    }
+
+    TetrisEngineObs obs = {0};
+    obs.reward = reward;
+    obs.done = done;
+    tetris_engine_reset(engine, 1, &obs);
+
+    unsigned long long points = 0, finished = 0;
+    uint64_t rng = 88172645463325252ull;
+    double seconds = 0;
+    for (int s = 0; s < steps; s++)
+    {
+        for (int g = 0; g < games; g++)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            actions[g] = (uint8_t)(rng % (TETRIS_ENGINE_HARD_DROP + 1));
+        }
+        clock_t start = clock();
+        tetris_engine_step(engine, actions, &obs);
+        seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+        for (int g = 0; g < games; g++)
+        {
+            points += (unsigned long long)reward[g];
+            finished += done[g];
+        }
+    }
+
+    printf("%d games x %d steps: %.0f game-steps/sec (CPU time), %llu games finished, %llu points\n", games,
+           steps, (double)games * steps / (seconds > 0 ? seconds : 1e-9), finished, points);
+    tetris_engine_destroy(engine);
+    free(actions);
+    free(reward);
+    free(done);
+    return 0;
+}
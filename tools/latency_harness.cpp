@@ -0,0 +1,562 @@
+/**************************************************************
+ * Input-to-display latency harness (Linux/macOS)
+ *
+ * Runs one of the games on a pseudo-terminal, types movement
+ * keys into it and times each key until the frame showing the
+ * moved piece has been written to the terminal. The output is
+ * fed through a small terminal emulator that tracks only what
+ * is needed to read the board: cursor moves, background color
+ * and the character in each cell.
+ *
+ * Build:  g++ -O2 -std=c++17 tools/latency_harness.cpp -o latency_harness
+ * Usage:  ./latency_harness [--samples N] [--seed N] [--game final|classic] -- <game> [args]
+ *         ./latency_harness --samples 300 -- ./Tetris_Final_Version --new
+ *         ./latency_harness --samples 300 -- ./Tetris
+ *
+ * A key counts as shown once the piece on screen is the piece it
+ * was sent to, moved one column (left/right, gravity may have
+ * moved it down meanwhile) or turned (rotate). Soft drop is not
+ * measured because it can't be told apart from gravity.
+ **************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cmath>
+#include <map>
+#include <set>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+/**************************************************************
+ * 1) Minimal terminal emulator
+ **************************************************************/
+const int SCREEN_ROWS = 40;
+const int SCREEN_COLS = 120;
+
+class Screen
+{
+private:
+    struct Cell
+    {
+        uint32_t ch = ' ';
+        bool background = false; // any non-default background color
+    };
+
+    Cell cells[SCREEN_ROWS + 1][SCREEN_COLS + 1]; // 1-based, like the escape codes
+    int row = 1, col = 1;
+    bool background = false;
+    string pending; // an escape or UTF-8 sequence split across reads
+    uint32_t codepoint = 0;
+    int continuation = 0;
+
+    void put(uint32_t ch)
+    {
+        if (row >= 1 && row <= SCREEN_ROWS && col >= 1 && col <= SCREEN_COLS)
+        {
+            cells[row][col].ch = ch;
+            cells[row][col].background = background;
+        }
+        col++;
+    }
+
+    void clear()
+    {
+        for (auto &line : cells)
+            for (Cell &c : line)
+                c = Cell();
+    }
+
+    // SGR: only "is the background non-default" matters for the board
+    void sgr(const string &params)
+    {
+        if (params.empty())
+        {
+            background = false;
+            return;
+        }
+        vector<int> values;
+        size_t start = 0;
+        while (start <= params.size())
+        {
+            size_t end = params.find(';', start);
+            if (end == string::npos)
+                end = params.size();
+            values.push_back(atoi(params.substr(start, end - start).c_str()));
+            start = end + 1;
+        }
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            int v = values[i];
+            if (v == 0 || v == 49)
+                background = false;
+            else if ((v >= 40 && v <= 47) || (v >= 100 && v <= 107))
+                background = true;
+            else if (v == 48)
+            {
+                background = true;
+                i += (i + 1 < values.size() && values[i + 1] == 5) ? 2 : 4;
+            }
+            else if (v == 38)
+                i += (i + 1 < values.size() && values[i + 1] == 5) ? 2 : 4;
+        }
+    }
+
+    void csi(const string &params, char final)
+    {
+        if (!params.empty() && params[0] == '?')
+            return; // cursor visibility and other private modes
+        if (final == 'H' || final == 'f')
+        {
+            int r = 1, c = 1;
+            sscanf(params.c_str(), "%d;%d", &r, &c);
+            row = max(1, r);
+            col = max(1, c);
+        }
+        else if (final == 'J' && params == "2")
+            clear();
+        else if (final == 'm')
+            sgr(params);
+    }
+
+public:
+    void feed(const char *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            unsigned char b = (unsigned char)data[i];
+            if (!pending.empty())
+            {
+                pending += (char)b;
+                if (pending.size() == 2 && b != '[')
+                    pending.clear(); // not a CSI sequence; ignore it
+                else if (pending.size() > 2 && b >= 0x40 && b <= 0x7E)
+                {
+                    csi(pending.substr(2, pending.size() - 3), (char)b);
+                    pending.clear();
+                }
+                continue;
+            }
+            if (continuation > 0)
+            {
+                codepoint = (codepoint << 6) | (b & 0x3F);
+                if (--continuation == 0)
+                    put(codepoint);
+                continue;
+            }
+            if (b == 0x1B)
+                pending = "\x1b";
+            else if (b == '\n')
+            {
+                row++;
+                col = 1;
+            }
+            else if (b == '\r')
+                col = 1;
+            else if (b >= 0xF0)
+            {
+                codepoint = b & 0x07;
+                continuation = 3;
+            }
+            else if (b >= 0xE0)
+            {
+                codepoint = b & 0x0F;
+                continuation = 2;
+            }
+            else if (b >= 0xC0)
+            {
+                codepoint = b & 0x1F;
+                continuation = 1;
+            }
+            else if (b >= 0x20)
+                put(b);
+        }
+    }
+
+    uint32_t charAt(int r, int c) const { return cells[r][c].ch; }
+    bool backgroundAt(int r, int c) const { return cells[r][c].background; }
+
+    string text(int r) const
+    {
+        string line;
+        for (int c = 1; c <= SCREEN_COLS; c++)
+            line += cells[r][c].ch < 0x80 ? (char)cells[r][c].ch : '#';
+        return line;
+    }
+};
+
+/**************************************************************
+ * 2) Game layouts: where each game draws its board and which
+ *    keys it reads
+ **************************************************************/
+typedef set<pair<int, int>> CellSet; // (row, column) in board coordinates
+
+struct GameLayout
+{
+    string name;
+    int rows, cols;
+    string left, right, rotate, hardDrop;
+    bool (*filled)(const Screen &, int r, int c);
+    int (*level)(const Screen &);
+};
+
+// Tetris_Final_Version.cpp: board at screen rows 3.., columns 31.., colored cells
+bool finalFilled(const Screen &s, int r, int c) { return s.backgroundAt(3 + r, 31 + 2 * c); }
+
+int finalLevel(const Screen &s)
+{
+    string line = s.text(1);
+    size_t at = line.find("Your Level: ");
+    return at == string::npos ? 0 : atoi(line.c_str() + at + 12);
+}
+
+// Tetris.cpp: field rows 4.., play column c at screen column 2c+3, drawn as '■'
+bool classicFilled(const Screen &s, int r, int c) { return s.charAt(4 + r, 2 * c + 3) == 0x25A0; }
+
+int classicLevel(const Screen &s)
+{
+    string line = s.text(1);
+    size_t at = line.find("Level: ");
+    return at == string::npos ? 0 : atoi(line.c_str() + at + 7);
+}
+
+const GameLayout FINAL_LAYOUT = {"Tetris_Final_Version", 20, 10, "\x1b[D", "\x1b[C", "\x1b[A", " ",
+                                 finalFilled, finalLevel};
+const GameLayout CLASSIC_LAYOUT = {"Tetris", 19, 10, "a", "d", "w", " ", classicFilled, classicLevel};
+
+// The falling piece: the 4-connected group holding the topmost filled
+// cell. Empty unless it has exactly four cells (drawn, not touching the stack).
+CellSet activePiece(const Screen &s, const GameLayout &g)
+{
+    CellSet piece;
+    for (int r = 0; r < g.rows && piece.empty(); r++)
+    {
+        for (int c = 0; c < g.cols; c++)
+        {
+            if (!g.filled(s, r, c))
+                continue;
+            vector<pair<int, int>> stack = {{r, c}};
+            piece.insert({r, c});
+            while (!stack.empty() && piece.size() <= 4)
+            {
+                pair<int, int> p = stack.back();
+                stack.pop_back();
+                const int dr[4] = {1, -1, 0, 0}, dc[4] = {0, 0, 1, -1};
+                for (int k = 0; k < 4; k++)
+                {
+                    int nr = p.first + dr[k], nc = p.second + dc[k];
+                    if (nr >= 0 && nr < g.rows && nc >= 0 && nc < g.cols && g.filled(s, nr, nc) &&
+                        piece.insert({nr, nc}).second)
+                        stack.push_back({nr, nc});
+                }
+            }
+            break;
+        }
+    }
+    return piece.size() == 4 ? piece : CellSet();
+}
+
+CellSet shifted(const CellSet &cells, int dr, int dc)
+{
+    CellSet out;
+    for (const pair<int, int> &p : cells)
+        out.insert({p.first + dr, p.second + dc});
+    return out;
+}
+
+bool fallenCopyOf(const CellSet &now, const CellSet &before, int dc)
+{
+    for (int dr = 0; dr <= 3; dr++)
+        if (now == shifted(before, dr, dc))
+            return true;
+    return false;
+}
+
+/**************************************************************
+ * 3) Pseudo-terminal session
+ **************************************************************/
+class PtySession
+{
+private:
+    int master = -1;
+    pid_t child = -1;
+
+public:
+    Screen screen;
+    size_t bytesRead = 0;
+
+    // Starts the game in `directory` (saves and high scores stay out of the repo)
+    bool start(char **argv, const string &directory)
+    {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+            return false;
+        string slaveName = ptsname(master);
+        struct winsize size = {SCREEN_ROWS, SCREEN_COLS, 0, 0};
+        child = fork();
+        if (child < 0)
+            return false;
+        if (child == 0)
+        {
+            setsid();
+            int slave = open(slaveName.c_str(), O_RDWR);
+            ioctl(slave, TIOCSCTTY, 0);
+            ioctl(slave, TIOCSWINSZ, &size);
+            dup2(slave, 0);
+            dup2(slave, 1);
+            dup2(slave, 2);
+            close(slave);
+            close(master);
+            if (chdir(directory.c_str()) != 0)
+                _exit(127);
+            setenv("TERM", "xterm-256color", 1);
+            execvp(argv[0], argv);
+            _exit(127);
+        }
+        return true;
+    }
+
+    // Reads whatever is available within `timeout`; false once the game has exited
+    bool pump(chrono::microseconds timeout)
+    {
+        pollfd p = {master, POLLIN, 0};
+        int ready = ::poll(&p, 1, (int)max<int64_t>(0, (timeout.count() + 999) / 1000));
+        if (ready <= 0)
+            return ready == 0;
+        char buffer[16384];
+        ssize_t n = read(master, buffer, sizeof(buffer));
+        if (n <= 0)
+            return false;
+        screen.feed(buffer, (size_t)n);
+        bytesRead += (size_t)n;
+        return true;
+    }
+
+    void send(const string &keys)
+    {
+        if (write(master, keys.data(), keys.size()) < 0)
+            perror("latency_harness: write");
+    }
+
+    void stop()
+    {
+        if (child > 0)
+        {
+            kill(child, SIGTERM);
+            for (int i = 0; i < 100 && waitpid(child, nullptr, WNOHANG) == 0; i++)
+            {
+                pump(chrono::milliseconds(10));
+            }
+            kill(child, SIGKILL);
+            waitpid(child, nullptr, 0);
+            child = -1;
+        }
+        if (master >= 0)
+            close(master);
+        master = -1;
+    }
+
+    ~PtySession() { stop(); }
+};
+
+/**************************************************************
+ * 4) Measurement
+ **************************************************************/
+struct Samples
+{
+    vector<double> ms;
+    int timeouts = 0;
+};
+
+void report(const string &label, Samples &s)
+{
+    if (s.ms.empty() && s.timeouts == 0)
+        return;
+    sort(s.ms.begin(), s.ms.end());
+    auto pct = [&](double p)
+    { return s.ms.empty() ? 0.0 : s.ms[min(s.ms.size() - 1, (size_t)(p * (s.ms.size() - 1) + 0.5))]; };
+    double mean = 0;
+    for (double v : s.ms)
+        mean += v;
+    mean = s.ms.empty() ? 0 : mean / s.ms.size();
+    printf("  %-10s %6zu  %8.2f %8.2f %8.2f %8.2f %8.2f  %d\n", label.c_str(), s.ms.size(), pct(0.5), pct(0.9),
+           pct(0.99), s.ms.empty() ? 0.0 : s.ms.back(), mean, s.timeouts);
+}
+
+int main(int argc, char *argv[])
+{
+    int samplesWanted = 200;
+    unsigned seed = 1;
+    const GameLayout *layout = nullptr;
+    int commandStart = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--")
+        {
+            commandStart = i + 1;
+            break;
+        }
+        if (arg == "--samples" && i + 1 < argc)
+            samplesWanted = max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = (unsigned)atoi(argv[++i]);
+        else if (arg == "--game" && i + 1 < argc)
+            layout = string(argv[++i]) == "classic" ? &CLASSIC_LAYOUT : &FINAL_LAYOUT;
+    }
+    if (commandStart < 0 || commandStart >= argc)
+    {
+        fprintf(stderr, "usage: %s [--samples N] [--seed N] [--game final|classic] -- <game> [args]\n", argv[0]);
+        return 2;
+    }
+    if (!layout)
+        layout = string(argv[commandStart]).find("Final") != string::npos ? &FINAL_LAYOUT : &CLASSIC_LAYOUT;
+
+    // Run the game from a scratch directory; a relative game path must still resolve
+    char scratchTemplate[] = "/tmp/latency_harness.XXXXXX";
+    if (!mkdtemp(scratchTemplate))
+    {
+        perror("latency_harness: mkdtemp");
+        return 1;
+    }
+    string scratch = scratchTemplate;
+    string program = argv[commandStart];
+    if (program.find('/') != string::npos && program[0] != '/')
+    {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd)))
+            program = string(cwd) + "/" + program;
+    }
+    vector<char *> command(argv + commandStart, argv + argc);
+    command[0] = &program[0];
+    command.push_back(nullptr);
+
+    srand(seed);
+    map<string, Samples> byKey;
+    map<int, Samples> byLevel;
+    int measured = 0, sessions = 0;
+    const chrono::milliseconds keyTimeout(500);
+
+    while (measured < samplesWanted && sessions < 50)
+    {
+        PtySession session;
+        if (!session.start(command.data(), scratch))
+        {
+            perror("latency_harness: pty");
+            return 1;
+        }
+        sessions++;
+
+        // Skip the intro with a key neither game binds, then wait for a piece
+        session.send("z");
+        Clock::time_point giveUp = Clock::now() + chrono::seconds(20);
+        while (activePiece(session.screen, *layout).empty() && Clock::now() < giveUp)
+            if (!session.pump(chrono::milliseconds(20)))
+                break;
+
+        bool alive = true;
+        Clock::time_point lastSeen = Clock::now();
+        while (alive && measured < samplesWanted && Clock::now() - lastSeen < chrono::seconds(3))
+        {
+            // Let the piece settle on screen, pausing long enough that auto-repeat never sees a held key
+            Clock::time_point until = Clock::now() + chrono::milliseconds(120 + rand() % 80);
+            while (alive && Clock::now() < until)
+                alive = session.pump(chrono::duration_cast<chrono::microseconds>(until - Clock::now()));
+            CellSet before = activePiece(session.screen, *layout);
+            if (before.empty())
+            {
+                alive = alive && session.pump(chrono::milliseconds(20));
+                continue;
+            }
+            lastSeen = Clock::now();
+            int top = before.begin()->first, lowest = before.rbegin()->first, leftmost = layout->cols, rightmost = 0;
+            for (const pair<int, int> &p : before)
+            {
+                leftmost = min(leftmost, p.second);
+                rightmost = max(rightmost, p.second);
+            }
+
+            // Past the upper half the piece may touch the stack: drop it and take the next one
+            if (lowest > layout->rows / 2)
+            {
+                session.send(layout->hardDrop);
+                continue;
+            }
+            if (top > 0 && lowest >= layout->rows / 2 - 1 && rand() % 2)
+                continue;
+
+            bool square = lowest - top == 1 && rightmost - leftmost == 1; // O piece: rotating shows nothing
+            string keyName;
+            string keys;
+            int dc = 0;
+            if (!square && rand() % 3 == 0 && leftmost >= 2 && rightmost <= layout->cols - 3)
+            {
+                keyName = "rotate";
+                keys = layout->rotate;
+            }
+            else
+            {
+                int direction = leftmost <= 1 ? 1 : rightmost >= layout->cols - 2 ? -1 : (rand() % 2 ? 1 : -1);
+                dc = direction;
+                keyName = direction < 0 ? "left" : "right";
+                keys = direction < 0 ? layout->left : layout->right;
+            }
+            int level = layout->level(session.screen);
+
+            Clock::time_point sent = Clock::now();
+            session.send(keys);
+            bool shown = false;
+            while (alive && !shown && Clock::now() - sent < keyTimeout)
+            {
+                alive = session.pump(chrono::milliseconds(5));
+                CellSet now = activePiece(session.screen, *layout);
+                if (now.empty() || now == before)
+                    continue;
+                shown = keyName == "rotate" ? !fallenCopyOf(now, before, 0) : fallenCopyOf(now, before, dc);
+            }
+            double ms = chrono::duration<double, milli>(Clock::now() - sent).count();
+            if (shown)
+            {
+                byKey[keyName].ms.push_back(ms);
+                byLevel[level].ms.push_back(ms);
+                measured++;
+            }
+            else
+            {
+                byKey[keyName].timeouts++;
+                byLevel[level].timeouts++;
+            }
+        }
+        session.stop();
+    }
+
+    printf("%s: %d keys measured over %d session%s\n", layout->name.c_str(), measured, sessions,
+           sessions == 1 ? "" : "s");
+    printf("  %-10s %6s  %8s %8s %8s %8s %8s  %s\n", "key", "n", "p50 ms", "p90 ms", "p99 ms", "max ms", "mean ms",
+           "timeouts");
+    for (auto &entry : byKey)
+        report(entry.first, entry.second);
+    printf("  %-10s %6s  %8s %8s %8s %8s %8s  %s\n", "level", "n", "p50 ms", "p90 ms", "p99 ms", "max ms", "mean ms",
+           "timeouts");
+    for (auto &entry : byLevel)
+        report(to_string(entry.first), entry.second);
+
+    if (system(("rm -rf '" + scratch + "'").c_str()) != 0)
+        fprintf(stderr, "latency_harness: could not remove %s\n", scratch.c_str());
+    return measured > 0 ? 0 : 1;
+}
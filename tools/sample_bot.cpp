@@ -0,0 +1,161 @@
+/**************************************************************
+ * Sample bot plugin for both games (Linux/macOS)
+ *
+ * Shows the tetris_bot.h ABI. For each new piece the bot
+ * rotates it through all four orientations, one per tick,
+ * scoring every column for each by where it would land; then
+ * it turns to the best one, walks over and hard drops.
+ *
+ * Build:  g++ -O2 -std=c++17 -shared -fPIC tools/sample_bot.cpp -o sample_bot.so
+ * Usage:  ./Tetris_Final_Version --new --bot ./sample_bot.so
+ *         ./Tetris --new --bot ./sample_bot.so
+ *
+ * --bot-args "spin-us=N" makes every call busy-wait N us, to
+ * watch the game's --bot-budget-us drop late answers.
+ **************************************************************/
+
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include "../tetris_bot.h"
+
+namespace
+{
+
+struct Bot
+{
+    long spinUs = 0;
+    uint64_t pieces = UINT64_MAX; // view->pieces the current plan is for
+    int looked = 0;               // orientations scored so far
+    int bestTurns = 0, bestScore = INT_MAX, bestLeft = 0;
+    int turned = 0;
+};
+
+bool filled(const TetrisBotView *v, int r, int c)
+{
+    if (c < 0 || c >= v->cols || r >= v->rows)
+        return true;
+    return r >= 0 && v->cells[r * v->rowStride + c] != 0;
+}
+
+int leftmost(const TetrisBotView *v)
+{
+    int left = INT_MAX;
+    for (int i = 0; i < 4; i++)
+        left = v->minos[i][1] < left ? v->minos[i][1] : left;
+    return left;
+}
+
+// Lower is better: landing height, holes left under the piece, and a
+// bonus for lines it completes. INT_MAX if the shift doesn't fit.
+int scoreDrop(const TetrisBotView *v, int shift)
+{
+    int drop = 0;
+    for (;; drop++)
+    {
+        bool fits = true;
+        for (int i = 0; i < 4 && fits; i++)
+            fits = !filled(v, v->minos[i][0] + drop + 1, v->minos[i][1] + shift);
+        if (!fits)
+            break;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        if (filled(v, v->minos[i][0] + drop, v->minos[i][1] + shift))
+            return INT_MAX;
+    }
+
+    int score = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int r = v->minos[i][0] + drop, c = v->minos[i][1] + shift;
+        score += v->rows - r;
+        bool covered = false;
+        for (int j = 0; j < 4; j++)
+            covered |= v->minos[j][1] + shift == c && v->minos[j][0] + drop == r + 1;
+        for (int below = r + 1; !covered && below < v->rows && !filled(v, below, c); below++)
+            score += 4;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        int r = v->minos[i][0] + drop, count = 0;
+        for (int c = 0; c < v->cols; c++)
+        {
+            bool mino = false;
+            for (int j = 0; j < 4; j++)
+                mino |= v->minos[j][0] + drop == r && v->minos[j][1] + shift == c;
+            count += mino || filled(v, r, c);
+        }
+        score -= count == v->cols ? 6 : 0;
+    }
+    return score;
+}
+
+void *create(const char *args)
+{
+    Bot *bot = new Bot();
+    const char *spin = args ? strstr(args, "spin-us=") : nullptr;
+    if (spin)
+        bot->spinUs = atol(spin + 8);
+    return bot;
+}
+
+uint32_t tick(void *handle, const TetrisBotView *v)
+{
+    Bot *bot = static_cast<Bot *>(handle);
+    if (bot->spinUs > 0)
+    {
+        std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::microseconds(bot->spinUs);
+        while (std::chrono::steady_clock::now() < until)
+        {
+        }
+    }
+
+    if (v->pieces != bot->pieces)
+    {
+        *bot = Bot{bot->spinUs, v->pieces};
+    }
+
+    // Score this orientation, then turn to the next until all four are seen
+    if (bot->looked < 4)
+    {
+        for (int shift = -v->cols; shift <= v->cols; shift++)
+        {
+            int score = scoreDrop(v, shift);
+            if (score < bot->bestScore)
+            {
+                bot->bestScore = score;
+                bot->bestTurns = bot->looked;
+                bot->bestLeft = leftmost(v) + shift;
+            }
+        }
+        bot->looked++;
+        return TETRIS_BOT_ROTATE; // four turns bring it back to where it started
+    }
+    if (bot->turned < bot->bestTurns)
+    {
+        bot->turned++;
+        return TETRIS_BOT_ROTATE;
+    }
+    int left = leftmost(v);
+    if (left > bot->bestLeft)
+        return TETRIS_BOT_LEFT;
+    if (left < bot->bestLeft)
+        return TETRIS_BOT_RIGHT;
+    return TETRIS_BOT_HARD_DROP;
+}
+
+void destroy(void *handle)
+{
+    delete static_cast<Bot *>(handle);
+}
+
+const TetrisBotApi api = {TETRIS_BOT_ABI_VERSION, "sample", create, tick, destroy};
+
+} // namespace
+
+TETRIS_BOT_EXPORT const TetrisBotApi *tetris_bot_api(void)
+{
+    return &api;
+}
@@ -0,0 +1,139 @@
+/**************************************************************
+ * Shared-memory state reader (Linux/macOS)
+ *
+ * Sample client for tetris_shm.h. Attaches to the segment of a
+ * game started with --shm and prints one line per new state,
+ * or the whole board with --board. Waits for the game to start
+ * and stops when it exits.
+ *
+ * Build:  g++ -O2 -std=c++17 tools/shm_reader.cpp -o shm_reader
+ * Usage:  ./shm_reader [--name /tetris_final] [--interval-ms N] [--board]
+ *         ./Tetris_Final_Version --shm      (in another terminal)
+ *         ./shm_reader
+ *
+ * Polling only compares the sequence number, so an idle reader
+ * costs one load per interval. Updates published between two
+ * polls are skipped and counted.
+ **************************************************************/
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cerrno>
+#include <cstdlib>
+#include "../tetris_shm.h"
+
+using namespace std;
+
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+bool writerAlive(const TetrisShmReader &reader)
+{
+    return kill(reader.writerPid(), 0) == 0 || errno == EPERM;
+}
+
+void printLine(const TetrisShmSnapshot &s)
+{
+    cout << "tick " << s.tick << "  score " << s.score << "  level " << s.level << "  lines " << s.lines;
+    if (s.piece != TETRIS_SHM_NO_PIECE)
+        cout << "  piece " << (int)s.piece << "/" << (int)s.rotation << " at (" << (int)s.minos[0][0] << ","
+             << (int)s.minos[0][1] << ")  next " << (int)s.next;
+    if (s.flags & TETRIS_SHM_PAUSED)
+        cout << "  [paused]";
+    if (s.flags & TETRIS_SHM_GAME_OVER)
+        cout << "  [game over]";
+    cout << "\n";
+}
+
+void printBoard(const TetrisShmSnapshot &s)
+{
+    printLine(s);
+    for (int r = 0; r < s.rows && r < TETRIS_SHM_ROWS; r++)
+    {
+        string row(s.cols, '.');
+        for (int c = 0; c < s.cols && c < TETRIS_SHM_COLS; c++)
+        {
+            if (s.cells[r][c] != 0)
+                row[c] = '#';
+        }
+        for (int m = 0; m < 4 && s.piece != TETRIS_SHM_NO_PIECE; m++)
+        {
+            if (s.minos[m][0] == r && s.minos[m][1] >= 0 && s.minos[m][1] < s.cols)
+                row[s.minos[m][1]] = '@';
+        }
+        cout << "  " << row << "\n";
+    }
+    cout << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    string name = TETRIS_SHM_FINAL;
+    int intervalMs = 50;
+    bool board = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc)
+            name = argv[++i];
+        else if (arg == "--interval-ms" && i + 1 < argc)
+            intervalMs = max(1, atoi(argv[++i]));
+        else if (arg == "--board")
+            board = true;
+        else
+        {
+            cerr << "usage: shm_reader [--name /tetris_final] [--interval-ms N] [--board]\n";
+            return 2;
+        }
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    TetrisShmReader reader;
+    cerr << "Waiting for " << name << "...\n";
+    while (!stopRequested && !reader.open(name.c_str()))
+        this_thread::sleep_for(chrono::milliseconds(200));
+
+    uint32_t lastSequence = 0;
+    uint64_t shown = 0, skipped = 0, torn = 0;
+    while (!stopRequested)
+    {
+        uint32_t sequence = reader.sequence();
+        if (sequence != lastSequence && !(sequence & 1))
+        {
+            TetrisShmSnapshot state;
+            if (reader.read(state))
+            {
+                if (lastSequence != 0 && sequence > lastSequence + 2)
+                    skipped += (sequence - lastSequence) / 2 - 1;
+                lastSequence = sequence;
+                shown++;
+                if (board)
+                    printBoard(state);
+                else
+                    printLine(state);
+                cout.flush();
+                if (state.flags & TETRIS_SHM_GAME_OVER)
+                    break;
+            }
+            else
+            {
+                torn++;
+            }
+        }
+        if (!writerAlive(reader))
+            break;
+        this_thread::sleep_for(chrono::milliseconds(intervalMs));
+    }
+
+    cerr << shown << " states shown, " << skipped << " skipped between polls, " << torn << " torn reads\n";
+    return 0;
+}